@@ -9,6 +9,11 @@
  */
 typedef Matrix(*activation_func) (const Matrix &);
 
+/**
+ * typedef for pointer to activation func that changes a matrix in place
+ */
+typedef void (*activation_in_place_func) (Matrix &);
+
 /**
  * a declarative region of activation functions
  */
@@ -16,6 +21,9 @@ namespace activation
 {
     Matrix relu (const Matrix &mat);
     Matrix softmax (const Matrix &mat);
+    void relu_in_place (Matrix &mat);
+    void softmax_in_place (Matrix &mat);
+    activation_in_place_func in_place (activation_func function);
 }
 
 #endif //ACTIVATION_H
\ No newline at end of file
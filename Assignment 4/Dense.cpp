@@ -1,18 +1,30 @@
 #include "Dense.h"
+#include "Gemm.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 
 /**
  * Constructor which inits a new layer with given parameters.
- * accepts 2 matrices and activation function
+ * accepts 2 matrices and activation function. the bias is a column with an
+ * element for every row of the weights, the fused kernel reads it without
+ * checking
  * @param weight matrix of weights of this layer
  * @param bias matrix of bias of this layer
  * @param activation_function of this layer
+ * @throw length_error if bias isn't a column of the rows of weight
  */
 Dense::Dense (const Matrix &weight, const Matrix &bias,
               activation_func activation_function)
 {
+  if (bias.get_rows () != weight.get_rows () || bias.get_cols () != 1)
+  {
+    throw std::length_error (LENGTH_ERROR_MSG);
+  }
   _weights = weight;
   _bias = bias;
   _activation_func = activation_function;
+  _activation_in_place = activation::in_place (activation_function);
 }
 
 /**
@@ -43,11 +55,76 @@ activation_func Dense::get_activation () const
 }
 
 /**
- * applies the later on input
- * @param vector a vector to manipulate
- * @return output matrix
+ * applies the later on input. every column of the input is a vector, so a
+ * batch of vectors is one matrix product that reuses the weights for all
+ * of them, and the bias is added to every column
+ * @param vector a vector (or a matrix of vectors in columns) to manipulate
+ * @return output matrix, a column for every input column
  */
 Matrix Dense::operator() (const Matrix &vector) const
 {
-  return _activation_func (_weights * vector + _bias);
+  Matrix output (_weights.get_rows (), vector.get_cols ());
+  forward (vector, output);
+  return output;
+}
+
+/**
+ * applies the layer on input into a given output. a single vector goes
+ * through the fused kernel (gemm::dense): every element is the dot product
+ * of a row of the weights, plus the bias and through relu, finished while
+ * it is in a register and stored once. a batch is a matrix product written
+ * into output, and the bias and relu are applied to it in one pass. other
+ * activations are applied in place, so nothing is allocated (unless the
+ * activation function has no in place version, see activation::in_place)
+ * @param vector a vector (or a matrix of vectors in columns) to manipulate
+ * @param output matrix with the rows of the weights and the columns of
+ * vector, gets the output of the layer
+ */
+void Dense::forward (const Matrix &vector, Matrix &output) const
+{
+  bool relu = _activation_in_place == activation::relu_in_place;
+  if (vector.get_cols () == 1 && &vector != &output)
+  {
+    if (_weights.get_cols () != vector.get_rows ())
+    {
+      throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
+    }
+    if (output.get_rows () != _weights.get_rows ()
+        || output.get_cols () != 1)
+    {
+      throw std::length_error (LENGTH_ERROR_MSG);
+    }
+    gemm::dense (_weights.get_rows (), _weights.get_cols (), _weights.data (),
+                 _weights.get_cols (), vector.data (), _bias.data (), relu,
+                 output.data ());
+  }
+  else
+  {
+    output.assign_product (_weights, vector);
+    // relu is applied on the way, while the element is at hand, as a max
+    // so the random signs of the outputs aren't branches
+    float lowest = relu ? 0 : -std::numeric_limits<float>::infinity ();
+    int rows = output.get_rows (), cols = output.get_cols ();
+    for (int i = 0; i < rows; i++)
+    {
+      float bias = _bias.unchecked (i);
+      float *row = output.data () + (size_t) i * cols;
+      for (int j = 0; j < cols; j++)
+      {
+        row[j] = std::max (row[j] + bias, lowest);
+      }
+    }
+  }
+  if (relu)
+  {
+    return;
+  }
+  if (_activation_in_place != nullptr)
+  {
+    _activation_in_place (output);
+  }
+  else
+  {
+    output = _activation_func (output);
+  }
 }
\ No newline at end of file
@@ -15,11 +15,13 @@ class Dense
   Matrix get_bias () const;
   activation_func get_activation () const;
   Matrix operator() (const Matrix &mat) const;
+  void forward (const Matrix &mat, Matrix &output) const;
 
  private:
   Matrix _weights;
   Matrix _bias;
   activation_func _activation_func;
+  activation_in_place_func _activation_in_place;
 };
 
 #endif //DENSE_H
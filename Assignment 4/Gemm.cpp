@@ -0,0 +1,792 @@
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEMM_X86
+#endif
+
+// blocking of the operands: a KC x NC block of B and an MC x KC block of A
+// are packed so that the micro kernel reads both sequentially. a packed
+// block of A stays in L1/L2 while every panel of the packed B passes by it
+#define GEMM_KC 256
+#define GEMM_MC 120
+#define GEMM_NC 1024
+// rows of C computed by one call of a micro kernel, the columns (NR)
+// depend on the vector width of the kernel
+#define GEMM_MR 6
+#define SCALAR_NR 8
+#define AVX2_NR 16
+#define AVX512_NR 32
+#define AVX2_WIDTH 8
+#define AVX512_WIDTH 16
+#define MAX_NR AVX512_NR
+// products of fewer multiply-adds run on the calling thread alone, without
+// looking up the pool, others are split into blocks of rows, a few per
+// thread of the pool
+#define GEMM_PARALLEL_FLOPS (1L << 20)
+#define GEMM_CHUNKS_PER_THREAD 4
+// products of at most GEMV_MAX_COLUMNS columns (and no more than a tile of
+// the micro kernel) run column by column on the matrix-vector kernel
+#define GEMV_MAX_COLUMNS 16
+
+/***************************/
+/**     Micro kernels      */
+/***************************/
+
+/**
+ * a micro kernel computes a GEMM_MR x nr tile of C from packed panels:
+ * a holds kc columns of GEMM_MR values, b holds kc rows of nr values
+ */
+typedef void (*micro_kernel) (int kc, const float *a, const float *b,
+                              float *c, int ldc, bool accumulate);
+
+/**
+ * a row kernel computes y[i] = dot (a row i, x) for m rows, the
+ * matrix-vector case (a Dense layer on one vector). the bias (if not
+ * nullptr) and relu (if set) are applied to the sum before it is stored,
+ * see finish
+ */
+typedef void (*gemv_kernel) (int m, int k, const float *a, int lda,
+                             const float *x, const float *bias, bool relu,
+                             float *y);
+
+/**
+ * a kernel set of one instruction set
+ */
+struct kernel_set
+{
+  gemm::isa id;
+  int nr;
+  micro_kernel kernel;
+  gemv_kernel gemv;
+};
+
+/**
+ * portable micro kernel, GEMM_MR x SCALAR_NR, the compiler keeps the
+ * accumulators in registers and may vectorize the inner loop
+ */
+static void scalar_kernel (int kc, const float *a, const float *b, float *c,
+                           int ldc, bool accumulate)
+{
+  float acc[GEMM_MR][SCALAR_NR] = {};
+  for (int p = 0; p < kc; p++)
+  {
+#pragma GCC unroll 6
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+#pragma GCC unroll 8
+      for (int j = 0; j < SCALAR_NR; j++)
+      {
+        acc[r][j] += a[r] * b[j];
+      }
+    }
+    a += GEMM_MR;
+    b += SCALAR_NR;
+  }
+  for (int r = 0; r < GEMM_MR; r++)
+  {
+    for (int j = 0; j < SCALAR_NR; j++)
+    {
+      c[r * ldc + j] = accumulate ? c[r * ldc + j] + acc[r][j] : acc[r][j];
+    }
+  }
+}
+
+/**
+ * the end of a row of a matrix-vector kernel, on the sum while it is
+ * still in a register
+ * @param sum - dot product of row i
+ * @param bias - a bias for every row, nullptr for none
+ * @param i - the row
+ * @param relu - true to clamp the result at 0
+ * @return the value to store
+ */
+static inline float finish (float sum, const float *bias, int i, bool relu)
+{
+  if (bias != nullptr)
+  {
+    sum += bias[i];
+  }
+  return relu && sum < 0 ? 0 : sum;
+}
+
+/**
+ * portable matrix-vector kernel, four partial sums per row so the
+ * additions don't wait for each other
+ */
+static void scalar_gemv (int m, int k, const float *a, int lda,
+                         const float *x, const float *bias, bool relu,
+                         float *y)
+{
+  for (int i = 0; i < m; i++)
+  {
+    const float *row = a + (long) i * lda;
+    float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+    int p = 0;
+    for (; p + 4 <= k; p += 4)
+    {
+      sum0 += row[p] * x[p];
+      sum1 += row[p + 1] * x[p + 1];
+      sum2 += row[p + 2] * x[p + 2];
+      sum3 += row[p + 3] * x[p + 3];
+    }
+    for (; p < k; p++)
+    {
+      sum0 += row[p] * x[p];
+    }
+    y[i] = finish ((sum0 + sum1) + (sum2 + sum3), bias, i, relu);
+  }
+}
+
+#ifdef GEMM_X86
+
+/**
+ * AVX2 micro kernel, GEMM_MR x AVX2_NR: 12 ymm accumulators, two loads of
+ * B and one broadcast of A per row and step
+ */
+__attribute__ ((target ("avx2,fma")))
+static void avx2_kernel (int kc, const float *a, const float *b, float *c,
+                         int ldc, bool accumulate)
+{
+  __m256 acc[GEMM_MR][2];
+#pragma GCC unroll 6
+  for (int r = 0; r < GEMM_MR; r++)
+  {
+    acc[r][0] = _mm256_setzero_ps ();
+    acc[r][1] = _mm256_setzero_ps ();
+  }
+  for (int p = 0; p < kc; p++)
+  {
+    __m256 b0 = _mm256_loadu_ps (b);
+    __m256 b1 = _mm256_loadu_ps (b + AVX2_WIDTH);
+#pragma GCC unroll 6
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+      __m256 a_r = _mm256_broadcast_ss (a + r);
+      acc[r][0] = _mm256_fmadd_ps (a_r, b0, acc[r][0]);
+      acc[r][1] = _mm256_fmadd_ps (a_r, b1, acc[r][1]);
+    }
+    a += GEMM_MR;
+    b += AVX2_NR;
+  }
+#pragma GCC unroll 6
+  for (int r = 0; r < GEMM_MR; r++)
+  {
+    float *row = c + (long) r * ldc;
+    if (accumulate)
+    {
+      acc[r][0] = _mm256_add_ps (acc[r][0], _mm256_loadu_ps (row));
+      acc[r][1] = _mm256_add_ps (acc[r][1],
+                                 _mm256_loadu_ps (row + AVX2_WIDTH));
+    }
+    _mm256_storeu_ps (row, acc[r][0]);
+    _mm256_storeu_ps (row + AVX2_WIDTH, acc[r][1]);
+  }
+}
+
+/**
+ * sum of the eight lanes of an AVX2 register
+ */
+__attribute__ ((target ("avx2,fma")))
+static float avx2_sum (__m256 v)
+{
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (v),
+                           _mm256_extractf128_ps (v, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * AVX2 matrix-vector kernel, four rows at once so every load of x is
+ * used four times
+ */
+__attribute__ ((target ("avx2,fma")))
+static void avx2_gemv (int m, int k, const float *a, int lda,
+                       const float *x, const float *bias, bool relu,
+                       float *y)
+{
+  int i = 0;
+  for (; i + 4 <= m; i += 4)
+  {
+    const float *row = a + (long) i * lda;
+    __m256 acc0 = _mm256_setzero_ps (), acc1 = _mm256_setzero_ps ();
+    __m256 acc2 = _mm256_setzero_ps (), acc3 = _mm256_setzero_ps ();
+    int p = 0;
+    for (; p + AVX2_WIDTH <= k; p += AVX2_WIDTH)
+    {
+      __m256 xv = _mm256_loadu_ps (x + p);
+      acc0 = _mm256_fmadd_ps (_mm256_loadu_ps (row + p), xv, acc0);
+      acc1 = _mm256_fmadd_ps (_mm256_loadu_ps (row + lda + p), xv, acc1);
+      acc2 = _mm256_fmadd_ps (_mm256_loadu_ps (row + 2 * lda + p), xv, acc2);
+      acc3 = _mm256_fmadd_ps (_mm256_loadu_ps (row + 3 * lda + p), xv, acc3);
+    }
+    float sums[4] = {avx2_sum (acc0), avx2_sum (acc1), avx2_sum (acc2),
+                     avx2_sum (acc3)};
+    for (; p < k; p++)
+    {
+      for (int r = 0; r < 4; r++)
+      {
+        sums[r] += row[r * lda + p] * x[p];
+      }
+    }
+    for (int r = 0; r < 4; r++)
+    {
+      y[i + r] = finish (sums[r], bias, i + r, relu);
+    }
+  }
+  for (; i < m; i++)
+  {
+    const float *row = a + (long) i * lda;
+    __m256 acc = _mm256_setzero_ps ();
+    int p = 0;
+    for (; p + AVX2_WIDTH <= k; p += AVX2_WIDTH)
+    {
+      acc = _mm256_fmadd_ps (_mm256_loadu_ps (row + p),
+                             _mm256_loadu_ps (x + p), acc);
+    }
+    float sum = avx2_sum (acc);
+    for (; p < k; p++)
+    {
+      sum += row[p] * x[p];
+    }
+    y[i] = finish (sum, bias, i, relu);
+  }
+}
+
+/**
+ * AVX-512 micro kernel, GEMM_MR x AVX512_NR: 12 zmm accumulators
+ */
+__attribute__ ((target ("avx512f")))
+static void avx512_kernel (int kc, const float *a, const float *b, float *c,
+                           int ldc, bool accumulate)
+{
+  __m512 acc[GEMM_MR][2];
+#pragma GCC unroll 6
+  for (int r = 0; r < GEMM_MR; r++)
+  {
+    acc[r][0] = _mm512_setzero_ps ();
+    acc[r][1] = _mm512_setzero_ps ();
+  }
+  for (int p = 0; p < kc; p++)
+  {
+    __m512 b0 = _mm512_loadu_ps (b);
+    __m512 b1 = _mm512_loadu_ps (b + AVX512_WIDTH);
+#pragma GCC unroll 6
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+      __m512 a_r = _mm512_set1_ps (a[r]);
+      acc[r][0] = _mm512_fmadd_ps (a_r, b0, acc[r][0]);
+      acc[r][1] = _mm512_fmadd_ps (a_r, b1, acc[r][1]);
+    }
+    a += GEMM_MR;
+    b += AVX512_NR;
+  }
+#pragma GCC unroll 6
+  for (int r = 0; r < GEMM_MR; r++)
+  {
+    float *row = c + (long) r * ldc;
+    if (accumulate)
+    {
+      acc[r][0] = _mm512_add_ps (acc[r][0], _mm512_loadu_ps (row));
+      acc[r][1] = _mm512_add_ps (acc[r][1],
+                                 _mm512_loadu_ps (row + AVX512_WIDTH));
+    }
+    _mm512_storeu_ps (row, acc[r][0]);
+    _mm512_storeu_ps (row + AVX512_WIDTH, acc[r][1]);
+  }
+}
+
+/**
+ * sum of the sixteen lanes of an AVX-512 register. the halves go through
+ * memory: the gcc 12 intrinsics that extract or shuffle them trip
+ * -Wmaybe-uninitialized
+ */
+__attribute__ ((target ("avx512f")))
+static float avx512_sum (__m512 v)
+{
+  alignas (64) float lanes[AVX512_WIDTH];
+  _mm512_store_ps (lanes, v);
+  __m256 half = _mm256_add_ps (_mm256_load_ps (lanes),
+                               _mm256_load_ps (lanes + AVX2_WIDTH));
+  __m128 sum = _mm_add_ps (_mm256_castps256_ps128 (half),
+                           _mm256_extractf128_ps (half, 1));
+  sum = _mm_add_ps (sum, _mm_movehl_ps (sum, sum));
+  sum = _mm_add_ss (sum, _mm_movehdup_ps (sum));
+  return _mm_cvtss_f32 (sum);
+}
+
+/**
+ * AVX-512 matrix-vector kernel, four rows at once, the tail of a row is
+ * read with a masked load
+ */
+__attribute__ ((target ("avx512f")))
+static void avx512_gemv (int m, int k, const float *a, int lda,
+                         const float *x, const float *bias, bool relu,
+                         float *y)
+{
+  int tail = k % AVX512_WIDTH, body = k - tail;
+  __mmask16 tail_mask = (__mmask16) ((1u << tail) - 1);
+  __m512 x_tail = _mm512_maskz_loadu_ps (tail_mask, x + body);
+  int i = 0;
+  for (; i + 4 <= m; i += 4)
+  {
+    const float *row = a + (long) i * lda;
+    __m512 acc0 = _mm512_setzero_ps (), acc1 = _mm512_setzero_ps ();
+    __m512 acc2 = _mm512_setzero_ps (), acc3 = _mm512_setzero_ps ();
+    for (int p = 0; p < body; p += AVX512_WIDTH)
+    {
+      __m512 xv = _mm512_loadu_ps (x + p);
+      acc0 = _mm512_fmadd_ps (_mm512_loadu_ps (row + p), xv, acc0);
+      acc1 = _mm512_fmadd_ps (_mm512_loadu_ps (row + lda + p), xv, acc1);
+      acc2 = _mm512_fmadd_ps (_mm512_loadu_ps (row + 2 * lda + p), xv, acc2);
+      acc3 = _mm512_fmadd_ps (_mm512_loadu_ps (row + 3 * lda + p), xv, acc3);
+    }
+    acc0 = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (tail_mask, row + body),
+                            x_tail, acc0);
+    acc1 = _mm512_fmadd_ps (
+        _mm512_maskz_loadu_ps (tail_mask, row + lda + body), x_tail, acc1);
+    acc2 = _mm512_fmadd_ps (
+        _mm512_maskz_loadu_ps (tail_mask, row + 2 * lda + body), x_tail,
+        acc2);
+    acc3 = _mm512_fmadd_ps (
+        _mm512_maskz_loadu_ps (tail_mask, row + 3 * lda + body), x_tail,
+        acc3);
+    y[i] = finish (avx512_sum (acc0), bias, i, relu);
+    y[i + 1] = finish (avx512_sum (acc1), bias, i + 1, relu);
+    y[i + 2] = finish (avx512_sum (acc2), bias, i + 2, relu);
+    y[i + 3] = finish (avx512_sum (acc3), bias, i + 3, relu);
+  }
+  for (; i < m; i++)
+  {
+    const float *row = a + (long) i * lda;
+    __m512 acc = _mm512_setzero_ps ();
+    for (int p = 0; p < body; p += AVX512_WIDTH)
+    {
+      acc = _mm512_fmadd_ps (_mm512_loadu_ps (row + p),
+                             _mm512_loadu_ps (x + p), acc);
+    }
+    acc = _mm512_fmadd_ps (_mm512_maskz_loadu_ps (tail_mask, row + body),
+                           x_tail, acc);
+    y[i] = finish (avx512_sum (acc), bias, i, relu);
+  }
+}
+
+#endif
+
+/***************************/
+/**       Dispatch         */
+/***************************/
+
+static const kernel_set scalar_kernels = {gemm::isa::scalar, SCALAR_NR,
+                                          scalar_kernel, scalar_gemv};
+#ifdef GEMM_X86
+static const kernel_set avx2_kernels = {gemm::isa::avx2, AVX2_NR,
+                                        avx2_kernel, avx2_gemv};
+static const kernel_set avx512_kernels = {gemm::isa::avx512, AVX512_NR,
+                                          avx512_kernel, avx512_gemv};
+#endif
+
+/**
+ * @param kernel - an instruction set
+ * @return the kernels of the instruction set
+ */
+static const kernel_set *kernels_of (gemm::isa kernel)
+{
+#ifdef GEMM_X86
+  if (kernel == gemm::isa::avx512)
+  {
+    return &avx512_kernels;
+  }
+  if (kernel == gemm::isa::avx2)
+  {
+    return &avx2_kernels;
+  }
+#endif
+  (void) kernel;
+  return &scalar_kernels;
+}
+
+/**
+ * the kernels in use, chosen on first use by best_isa
+ * @return a reference to the pointer to the kernels in use
+ */
+static const kernel_set *&active_kernels ()
+{
+  static const kernel_set *active = kernels_of (gemm::best_isa ());
+  return active;
+}
+
+/***************************/
+/**        Packing         */
+/***************************/
+
+/**
+ * copy an mc x kc block of A into panels of GEMM_MR rows, each panel
+ * column by column, rows past mc are zero. the element (i, p) of the block
+ * is at a[i * row_stride + p * col_stride], so a transposed A is packed
+ * by swapping the strides
+ * @param packed - kc * GEMM_MR floats for every panel
+ */
+static void pack_a (int mc, int kc, const float *a, long row_stride,
+                    long col_stride, float *packed)
+{
+  for (int ir = 0; ir < mc; ir += GEMM_MR)
+  {
+    int rows = std::min (GEMM_MR, mc - ir);
+    for (int p = 0; p < kc; p++)
+    {
+      for (int r = 0; r < rows; r++)
+      {
+        packed[r] = a[(ir + r) * row_stride + p * col_stride];
+      }
+      for (int r = rows; r < GEMM_MR; r++)
+      {
+        packed[r] = 0;
+      }
+      packed += GEMM_MR;
+    }
+  }
+}
+
+/**
+ * copy a kc x nc block of B into panels of nr columns, each panel row by
+ * row, columns past nc are zero. the element (p, j) of the block is at
+ * b[p * row_stride + j * col_stride]
+ * @param packed - kc * nr floats for every panel
+ */
+static void pack_b (int kc, int nc, int nr, const float *b, long row_stride,
+                    long col_stride, float *packed)
+{
+  for (int jr = 0; jr < nc; jr += nr)
+  {
+    int cols = std::min (nr, nc - jr);
+    if (col_stride == 1)
+    {
+      for (int p = 0; p < kc; p++)
+      {
+        const float *row = b + p * row_stride + jr;
+        std::copy (row, row + cols, packed + p * nr);
+        std::fill (packed + p * nr + cols, packed + (p + 1) * nr, 0.0f);
+      }
+    }
+    else
+    {
+      // a transposed B: a column of the panel is a row in memory, it is
+      // read in order and scattered across the panel
+      for (int j = 0; j < cols; j++)
+      {
+        const float *column = b + (jr + j) * col_stride;
+        for (int p = 0; p < kc; p++)
+        {
+          packed[p * nr + j] = column[p * row_stride];
+        }
+      }
+      for (int p = 0; p < kc; p++)
+      {
+        std::fill (packed + p * nr + cols, packed + (p + 1) * nr, 0.0f);
+      }
+    }
+    packed += (long) kc * nr;
+  }
+}
+
+/***************************/
+/**     Multiplication     */
+/***************************/
+
+/**
+ * C = A * B, with A an m x k matrix, B a k x n matrix and C an m x n
+ * matrix, all row-major with leading dimensions lda, ldb and ldc.
+ */
+void gemm::multiply (int m, int n, int k, const float *a, int lda,
+                     const float *b, int ldb, float *c, int ldc)
+{
+  multiply (m, n, k, a, lda, false, b, ldb, false, c, ldc);
+}
+
+/**
+ * C = A * B, or C += A * B with accumulate, for an m x kc block of A and a
+ * kc x nc block of B that is already packed: the rows of A are packed
+ * GEMM_MC at a time and every tile of C is computed by the micro kernel.
+ * the element (i, p) of A is at a[i * a_row + p * a_col]
+ */
+static void multiply_rows (const kernel_set &kernels, int m, int nc, int kc,
+                           const float *a, long a_row, long a_col,
+                           const float *packed_b, float *c, int ldc,
+                           bool accumulate)
+{
+  // the buffer is kept between calls, a thread packs into its own
+  thread_local std::vector<float> packed_a;
+  packed_a.resize ((size_t) GEMM_KC * (GEMM_MC + GEMM_MR));
+  int nr = kernels.nr;
+  float tile[GEMM_MR * MAX_NR];
+  for (int ic = 0; ic < m; ic += GEMM_MC)
+  {
+    int mc = std::min (GEMM_MC, m - ic);
+    pack_a (mc, kc, a + ic * a_row, a_row, a_col, packed_a.data ());
+    for (int jr = 0; jr < nc; jr += nr)
+    {
+      int cols = std::min (nr, nc - jr);
+      const float *panel_b = packed_b + (long) jr * kc;
+      for (int ir = 0; ir < mc; ir += GEMM_MR)
+      {
+        int rows = std::min (GEMM_MR, mc - ir);
+        const float *panel_a = packed_a.data () + (long) ir * kc;
+        float *c_tile = c + (long) (ic + ir) * ldc + jr;
+        if (rows == GEMM_MR && cols == nr)
+        {
+          kernels.kernel (kc, panel_a, panel_b, c_tile, ldc, accumulate);
+          continue;
+        }
+        // an edge tile is computed whole and only its part inside C
+        // is written
+        kernels.kernel (kc, panel_a, panel_b, tile, nr, false);
+        for (int r = 0; r < rows; r++)
+        {
+          for (int j = 0; j < cols; j++)
+          {
+            float &out = c_tile[(long) r * ldc + j];
+            out = accumulate ? out + tile[r * nr + j] : tile[r * nr + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+/**
+ * y = A * x for an m x k matrix A with leading dimension lda, the element
+ * i of y is at y[i * ldy]. the bias and relu are applied by the kernel,
+ * see gemv_kernel. a large product splits the rows between the threads of
+ * the pool
+ */
+static void multiply_vector (const kernel_set &kernels, int m, int k,
+                             const float *a, int lda, const float *x,
+                             const float *bias, bool relu, float *y, int ldy)
+{
+  auto gemv_rows = [&] (int first, int last)
+  {
+    const float *row_bias = bias != nullptr ? bias + first : nullptr;
+    if (ldy == 1)
+    {
+      kernels.gemv (last - first, k, a + (long) first * lda, lda, x,
+                    row_bias, relu, y + first);
+      return;
+    }
+    for (int i = first; i < last; i++)
+    {
+      kernels.gemv (1, k, a + (long) i * lda, lda, x,
+                    bias != nullptr ? bias + i : nullptr, relu,
+                    y + (long) i * ldy);
+    }
+  };
+  if (m < 2 * GEMM_MR || (long) m * k < GEMM_PARALLEL_FLOPS
+      || ThreadPool::instance ().threads () == 1)
+  {
+    gemv_rows (0, m);
+    return;
+  }
+  ThreadPool &pool = ThreadPool::instance ();
+  int chunks = pool.threads () * GEMM_CHUNKS_PER_THREAD;
+  int block = ((m + chunks - 1) / chunks + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+  pool.parallel_for (0, m, block, gemv_rows);
+}
+
+/**
+ * C = A * B for a B of a few columns, every column is a matrix-vector
+ * product. the element (p, j) of B is at b[p * b_row + j * b_col]
+ */
+static void multiply_columns (const kernel_set &kernels, int m, int n, int k,
+                              const float *a, int lda, const float *b,
+                              long b_row, long b_col, float *c, int ldc)
+{
+  // the buffers are kept between calls, a thread copies into its own
+  thread_local std::vector<float> column, result;
+  column.resize (k);
+  result.resize (m);
+  for (int j = 0; j < n; j++)
+  {
+    for (int p = 0; p < k; p++)
+    {
+      column[p] = b[p * b_row + j * b_col];
+    }
+    multiply_vector (kernels, m, k, a, lda, column.data (), nullptr, false,
+                     result.data (), 1);
+    for (int i = 0; i < m; i++)
+    {
+      c[(long) i * ldc + j] = result[i];
+    }
+  }
+}
+
+/**
+ * C = op (A) * op (B), with op (A) an m x k matrix, op (B) a k x n matrix
+ * and C an m x n matrix. op (X) is X, or the transpose of X when trans_x
+ * is set: then X itself is stored as a k x m (n x k) matrix.
+ * the transpose costs nothing, the packing reads the operand transposed.
+ * a single column of B goes to the matrix-vector kernel, anything wider is
+ * packed block by block and computed by register tiles of the micro kernel.
+ * a large product splits the rows of C between the threads of the pool
+ * (ThreadPool.h): a block of B is packed once and shared, every thread
+ * packs the rows of A it computes
+ */
+void gemm::multiply (int m, int n, int k, const float *a, int lda,
+                     bool trans_a, const float *b, int ldb, bool trans_b,
+                     float *c, int ldc)
+{
+  const kernel_set &kernels = *active_kernels ();
+  if (k == 0)
+  {
+    for (int i = 0; i < m; i++)
+    {
+      std::fill (c + (long) i * ldc, c + (long) i * ldc + n, 0.0f);
+    }
+    return;
+  }
+  // strides of the elements (i, p) of op (A) and (p, j) of op (B)
+  long a_row = trans_a ? 1 : lda, a_col = trans_a ? lda : 1;
+  long b_row = trans_b ? 1 : ldb, b_col = trans_b ? ldb : 1;
+  // the buffers are kept between calls, a thread packs into its own
+  thread_local std::vector<float> packed_b, column;
+  // the matrix-vector kernels read the rows of A, a transposed A is packed
+  if (n == 1 && !trans_a)
+  {
+    const float *x = b;
+    if (b_row != 1)
+    {
+      column.resize (k);
+      for (int p = 0; p < k; p++)
+      {
+        column[p] = b[p * b_row];
+      }
+      x = column.data ();
+    }
+    multiply_vector (kernels, m, k, a, lda, x, nullptr, false, c, ldc);
+    return;
+  }
+  // a few columns go to the same kernels one by one, a tile of the micro
+  // kernel would be mostly padding
+  if (!trans_a && n <= std::min (kernels.nr, GEMV_MAX_COLUMNS))
+  {
+    multiply_columns (kernels, m, n, k, a, lda, b, b_row, b_col, c, ldc);
+    return;
+  }
+
+  bool parallel = m >= 2 * GEMM_MR && (long) m * n * k >= GEMM_PARALLEL_FLOPS
+                  && ThreadPool::instance ().threads () > 1;
+  // rows of C in a chunk of the parallel loops, whole micro kernel tiles
+  int chunks = parallel
+               ? ThreadPool::instance ().threads () * GEMM_CHUNKS_PER_THREAD
+               : 1;
+  int block = ((m + chunks - 1) / chunks + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+  int nr = kernels.nr;
+  packed_b.resize ((size_t) GEMM_KC * (GEMM_NC + MAX_NR));
+  for (int jc = 0; jc < n; jc += GEMM_NC)
+  {
+    int nc = std::min (GEMM_NC, n - jc);
+    for (int pc = 0; pc < k; pc += GEMM_KC)
+    {
+      int kc = std::min (GEMM_KC, k - pc);
+      bool accumulate = pc > 0;
+      pack_b (kc, nc, nr, b + pc * b_row + jc * b_col, b_row, b_col,
+              packed_b.data ());
+      const float *packed = packed_b.data ();
+      auto rows = [&] (int first, int last)
+      {
+        multiply_rows (kernels, last - first, nc, kc,
+                       a + first * a_row + pc * a_col, a_row, a_col, packed,
+                       c + (long) first * ldc + jc, ldc, accumulate);
+      };
+      if (parallel)
+      {
+        ThreadPool::instance ().parallel_for (0, m, block, rows);
+      }
+      else
+      {
+        rows (0, m);
+      }
+    }
+  }
+}
+
+/**
+ * y = relu (A * x + bias) in one pass, the Dense layer on one vector: A
+ * is an m x k row-major matrix with leading dimension lda, x holds k
+ * elements and bias and y hold m. every element of y is finished while
+ * its dot product is still in a register, and stored once
+ * @param bias - m elements added to the products, nullptr for none
+ * @param relu - true to clamp the results at 0
+ */
+void gemm::dense (int m, int k, const float *a, int lda, const float *x,
+                  const float *bias, bool relu, float *y)
+{
+  multiply_vector (*active_kernels (), m, k, a, lda, x, bias, relu, y, 1);
+}
+
+/**
+ * the best instruction set the cpu supports
+ * @return the instruction set
+ */
+gemm::isa gemm::best_isa ()
+{
+#ifdef GEMM_X86
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx512f"))
+  {
+    return isa::avx512;
+  }
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma"))
+  {
+    return isa::avx2;
+  }
+#endif
+  return isa::scalar;
+}
+
+/**
+ * @return the instruction set of the kernels in use
+ */
+gemm::isa gemm::active_isa ()
+{
+  return active_kernels ()->id;
+}
+
+/**
+ * choose the kernels of an instruction set, to compare kernels or to
+ * test the scalar one. not thread-safe, call it before multiplying.
+ * an instruction set the cpu doesn't support falls back to the best one
+ * it does
+ * @param kernel - an instruction set
+ * @return the instruction set in use
+ */
+gemm::isa gemm::use_isa (isa kernel)
+{
+  isa best = best_isa ();
+  if (kernel > best)
+  {
+    kernel = best;
+  }
+  active_kernels () = kernels_of (kernel);
+  return kernel;
+}
+
+/**
+ * @param kernel - an instruction set
+ * @return the name of the instruction set
+ */
+const char *gemm::isa_name (isa kernel)
+{
+  switch (kernel)
+  {
+    case isa::avx512:
+      return "avx512";
+    case isa::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
@@ -0,0 +1,37 @@
+// Gemm.h
+#ifndef GEMM_H
+#define GEMM_H
+
+/**
+ * a declarative region of the matrix multiplication kernels used by Matrix.
+ * all the kernels work on raw row-major storage: the element (i, j) of a
+ * matrix with leading dimension ld is at data[i * ld + j]. an operand can
+ * also be read transposed, its element (i, j) is then at data[j * ld + i].
+ * the kernel is chosen once at runtime by the instructions the cpu
+ * supports: AVX-512, AVX2 with FMA, or a portable scalar kernel.
+ * kernels are described in Gemm.cpp
+ */
+namespace gemm
+{
+    /**
+     * the instruction sets a kernel can be built for
+     */
+    enum class isa
+    {
+        scalar, avx2, avx512
+    };
+
+    void multiply (int m, int n, int k, const float *a, int lda,
+                   const float *b, int ldb, float *c, int ldc);
+    void multiply (int m, int n, int k, const float *a, int lda,
+                   bool trans_a, const float *b, int ldb, bool trans_b,
+                   float *c, int ldc);
+    void dense (int m, int k, const float *a, int lda, const float *x,
+                const float *bias, bool relu, float *y);
+    isa best_isa ();
+    isa active_isa ();
+    isa use_isa (isa kernel);
+    const char *isa_name (isa kernel);
+}
+
+#endif //GEMM_H
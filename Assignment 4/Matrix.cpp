@@ -1,4 +1,176 @@
 #include "Matrix.h"
+#include "MatrixView.h"
+#include "Gemm.h"
+#include "ThreadPool.h"
+#include <utility>
+#include <algorithm>
+#include <vector>
+#include <new>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#define TRANSPOSE_SSE
+#endif
+
+// the transposes work on tiles of TRANSPOSE_BLOCK x TRANSPOSE_BLOCK, a tile
+// of the source and a tile of the destination fit in L1 together. the
+// in place swap keeps two tiles of the same matrix, with a row length of a
+// power of two all their rows fall in the same cache sets, so its tiles
+// are smaller
+#define TRANSPOSE_BLOCK 32
+#define SWAP_BLOCK 8
+#define SSE_WIDTH 4
+// elementwise operators on fewer elements run on the calling thread alone
+// and never create the pool, others are split into blocks of rows, a few
+// per thread of the pool
+#define PARALLEL_ELEMENTS (1 << 17)
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+/**
+ * calls body (first, last) on ranges of the elements of a rows x cols
+ * matrix that are made of whole rows, all the elements together, or in
+ * parallel on the threads of the pool (ThreadPool.h) for a large matrix
+ */
+template<class Body>
+static void for_row_blocks (int rows, int cols, const Body &body)
+{
+  if ((long) rows * cols < PARALLEL_ELEMENTS
+      || ThreadPool::instance ().threads () == ONE)
+  {
+    body (0, rows * cols);
+    return;
+  }
+  ThreadPool &pool = ThreadPool::instance ();
+  int chunks = pool.threads () * PARALLEL_CHUNKS_PER_THREAD;
+  pool.parallel_for (0, rows, (rows + chunks - 1) / chunks,
+                     [&body, cols] (int first, int last)
+                     {
+                       body (first * cols, last * cols);
+                     });
+}
+
+/***************************/
+/**   Transpose kernels    */
+/***************************/
+
+/**
+ * transpose a rows x cols tile of src into dst, dst (j, i) = src (i, j).
+ * 4 x 4 squares are transposed in registers: four loads and four stores
+ * instead of sixteen of each
+ * @param lds - elements between the rows of src
+ * @param ldd - elements between the rows of dst
+ */
+static void transpose_tile (const float *src, int lds, float *dst, int ldd,
+                            int rows, int cols)
+{
+  int i = 0;
+#ifdef TRANSPOSE_SSE
+  for (; i + SSE_WIDTH <= rows; i += SSE_WIDTH)
+  {
+    const float *in = src + (long) i * lds;
+    int j = 0;
+    for (; j + SSE_WIDTH <= cols; j += SSE_WIDTH)
+    {
+      __m128 row0 = _mm_loadu_ps (in + j);
+      __m128 row1 = _mm_loadu_ps (in + lds + j);
+      __m128 row2 = _mm_loadu_ps (in + 2 * lds + j);
+      __m128 row3 = _mm_loadu_ps (in + 3 * lds + j);
+      _MM_TRANSPOSE4_PS (row0, row1, row2, row3);
+      float *out = dst + (long) j * ldd + i;
+      _mm_storeu_ps (out, row0);
+      _mm_storeu_ps (out + ldd, row1);
+      _mm_storeu_ps (out + 2 * ldd, row2);
+      _mm_storeu_ps (out + 3 * ldd, row3);
+    }
+    for (; j < cols; j++)
+    {
+      for (int r = 0; r < SSE_WIDTH; r++)
+      {
+        dst[(long) j * ldd + i + r] = in[(long) r * lds + j];
+      }
+    }
+  }
+#endif
+  for (; i < rows; i++)
+  {
+    for (int j = 0; j < cols; j++)
+    {
+      dst[(long) j * ldd + i] = src[(long) i * lds + j];
+    }
+  }
+}
+
+/**
+ * transpose a rows x cols matrix src into the cols x rows matrix dst, tile
+ * by tile, so the strided side of the copy stays in the cache
+ */
+static void transpose_blocked (const float *src, int rows, int cols,
+                               float *dst)
+{
+  for (int ib = 0; ib < rows; ib += TRANSPOSE_BLOCK)
+  {
+    for (int jb = 0; jb < cols; jb += TRANSPOSE_BLOCK)
+    {
+      transpose_tile (src + (long) ib * cols + jb, cols,
+                      dst + (long) jb * rows + ib, rows,
+                      std::min (TRANSPOSE_BLOCK, rows - ib),
+                      std::min (TRANSPOSE_BLOCK, cols - jb));
+    }
+  }
+}
+
+/**
+ * transpose an n x n matrix in place: every tile above the diagonal swaps
+ * its elements with the mirrored tile below it
+ */
+static void transpose_square (float *elements, int n)
+{
+  for (int ib = 0; ib < n; ib += SWAP_BLOCK)
+  {
+    int i_end = std::min (ib + SWAP_BLOCK, n);
+    for (int jb = ib; jb < n; jb += SWAP_BLOCK)
+    {
+      int j_end = std::min (jb + SWAP_BLOCK, n);
+      for (int i = ib; i < i_end; i++)
+      {
+        for (int j = ib == jb ? i + 1 : jb; j < j_end; j++)
+        {
+          std::swap (elements[(long) i * n + j], elements[(long) j * n + i]);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * transpose a rows x cols matrix in place by following the cycles of the
+ * permutation: the element at index i * cols + j moves to j * rows + i,
+ * which is index * rows modulo (rows * cols - 1). every cycle is walked
+ * once, carrying one element, a bit per element marks the moved ones.
+ * every step is a cache miss, it is much slower than a blocked copy and
+ * only used when there is no memory for one
+ */
+static void transpose_cycles (float *elements, int rows, int cols)
+{
+  long last = (long) rows * cols - 1;
+  std::vector<bool> moved (last + 1, false);
+  for (long start = 1; start < last; start++)
+  {
+    if (moved[start])
+    {
+      continue;
+    }
+    float carried = elements[start];
+    long index = start;
+    do
+    {
+      index = index * rows % last;
+      std::swap (carried, elements[index]);
+      moved[index] = true;
+    }
+    while (index != start);
+  }
+}
 
 /***************************/
 /**    Constructors        */
@@ -54,6 +226,21 @@ Matrix::Matrix (const Matrix &mat)
   }
 }
 
+// move constructor
+/**
+ * constructs a new matrix that takes the elements of mat (matrix in param)
+ * without copying them, mat is left as an empty 0 x 0 matrix
+ * @param mat - mat to take its data from
+ */
+Matrix::Matrix (Matrix &&mat) noexcept
+    : _rows (mat._rows), _cols (mat._cols),
+      _matrix_elements (mat._matrix_elements)
+{
+  mat._rows = 0;
+  mat._cols = 0;
+  mat._matrix_elements = nullptr;
+}
+
 /**
  * destructor that deletes all allocated memory that was allocated in
  * Matrix class
@@ -86,24 +273,47 @@ int Matrix::get_cols () const
 }
 
 /**
- * transpose a given matrix
+ * transpose a given matrix. a square matrix swaps its elements across the
+ * diagonal tile by tile and a vector only swaps its dimensions, both in
+ * place. any other matrix is copied tile by tile into new elements, or
+ * transposed in place by following its cycles if they can't be allocated
  * @return a transformed transposed matrix
  */
 Matrix &Matrix::transpose ()
 {
-  int trans_rows = this->_cols, trans_cols = this->_rows;
-  Matrix trans (trans_rows, trans_cols);
-  for (int i = 0; i < trans_rows; i++)
+  if (_rows == _cols)
   {
-    for (int j = 0; j < trans_cols; j++)
+    transpose_square (_matrix_elements, _rows);
+  }
+  else if (_rows > ONE && _cols > ONE)
+  {
+    float *trans = new (std::nothrow) float[_rows * _cols];
+    if (trans == nullptr)
+    {
+      transpose_cycles (_matrix_elements, _rows, _cols);
+    }
+    else
     {
-      trans (i, j) = (*this) (j, i);
+      transpose_blocked (_matrix_elements, _rows, _cols, trans);
+      delete[] _matrix_elements;
+      _matrix_elements = trans;
     }
   }
-  (*this) = trans;
+  std::swap (_rows, _cols);
   return (*this);
 }
 
+/**
+ * the transpose of a given matrix as a new matrix, copied tile by tile
+ * @return a new transposed matrix
+ */
+Matrix Matrix::transposed () const
+{
+  Matrix trans (_cols, _rows);
+  transpose_blocked (_matrix_elements, _rows, _cols, trans._matrix_elements);
+  return trans;
+}
+
 /**
  * change a given matrix to a vector as follows:
  * vector rows = number of rows in matrix * number of cols in matrix.
@@ -126,7 +336,7 @@ void Matrix::plain_print () const
   {
     for (int j = 0; j < this->_cols; j++)
     {
-      std::cout << (*this) (i, j) << SPACE;
+      std::cout << unchecked (i, j) << SPACE;
     }
     std::cout << std::endl;
   }
@@ -134,7 +344,8 @@ void Matrix::plain_print () const
 
 /**
  * given 2 matrices (mark them A, B), create a new matrix C with elements
- * C[i][j] = A[i][j] * B[i][j] for every i, j
+ * C[i][j] = A[i][j] * B[i][j] for every i, j. the rows of a large matrix
+ * are split between the threads of the pool
  * @param mat a new matrix with multiplied elements
  * @return a new matrix
  */
@@ -145,13 +356,14 @@ Matrix Matrix::dot (const Matrix &mat) const
     throw std::length_error (DIFFERENT_SIZE_MATRIX_ERROR_MSG);
   }
   Matrix new_mat (this->_rows, this->_cols);
-  for (int i = 0; i < _rows; i++)
+  for_row_blocks (_rows, _cols, [&] (int first, int last)
   {
-    for (int j = 0; j < _cols; j++)
+#pragma GCC ivdep
+    for (int i = first; i < last; i++)
     {
-      new_mat (i, j) = (*this) (i, j) * mat (i, j);
+      new_mat.unchecked (i) = unchecked (i) * mat.unchecked (i);
     }
-  }
+  });
   return new_mat;
 }
 
@@ -164,7 +376,7 @@ float Matrix::norm () const
   float normal = 0;
   for (int i = 0; i < _rows * _cols; i++)
   {
-    normal += (*this)[i] * (*this)[i];
+    normal += unchecked (i) * unchecked (i);
   }
   return std::sqrt (normal);
 }
@@ -174,7 +386,8 @@ float Matrix::norm () const
 /***************************/
 
 /**
- * given two matrices (A, B), creates a new matrix C such that C = A + B
+ * given two matrices (A, B), creates a new matrix C such that C = A + B.
+ * the rows of a large matrix are split between the threads of the pool
  * @param mat - a given matrix to add with matrix that was called from class
  * method
  * @return new matrix
@@ -186,13 +399,14 @@ Matrix Matrix::operator+ (const Matrix &mat) const
     throw std::length_error (DIFFERENT_SIZE_MATRIX_ERROR_MSG);
   }
   Matrix new_mat (this->_rows, this->_cols);
-  for (int i = 0; i < _rows; i++)
+  for_row_blocks (_rows, _cols, [&] (int first, int last)
   {
-    for (int j = 0; j < _cols; j++)
+#pragma GCC ivdep
+    for (int i = first; i < last; i++)
     {
-      new_mat (i, j) = (*this) (i, j) + mat (i, j);
+      new_mat.unchecked (i) = unchecked (i) + mat.unchecked (i);
     }
-  }
+  });
   return new_mat;
 }
 
@@ -204,9 +418,10 @@ Matrix Matrix::operator+ (const Matrix &mat) const
 Matrix Matrix::operator* (float scalar) const
 {
   Matrix new_mat (this->_rows, this->_cols);
+#pragma GCC ivdep
   for (int i = 0; i < new_mat._rows * new_mat._cols; i++)
   {
-    new_mat[i] = (*this)[i] * scalar;
+    new_mat.unchecked (i) = unchecked (i) * scalar;
   }
   return new_mat;
 }
@@ -220,15 +435,19 @@ Matrix Matrix::operator* (float scalar) const
 Matrix operator* (float scalar, const Matrix &mat)
 {
   Matrix new_mat (mat._rows, mat._cols);
+#pragma GCC ivdep
   for (int i = 0; i < new_mat._cols * new_mat._rows; i++)
   {
-    new_mat[i] = mat[i] * scalar;
+    new_mat.unchecked (i) = mat.unchecked (i) * scalar;
   }
   return new_mat;
 }
 
 /**
- * given two matrices (A, B), creates a new matrix C such that C = A * B
+ * given two matrices (A, B), creates a new matrix C such that C = A * B.
+ * the product runs on the raw elements with the gemm kernels (Gemm.h),
+ * blocked for the cache, vectorized for the cpu and split between the
+ * threads of the pool (ThreadPool.h) when it is large
  * @param mat matrix to manipulate with another matrix
  * @return a new matrix
  */
@@ -239,19 +458,81 @@ Matrix Matrix::operator* (const Matrix &mat) const
     throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
   }
   Matrix multiply_mat (this->_rows, mat.get_cols ());
-  for (int i = 0; i < this->_rows; i++)
+  gemm::multiply (_rows, mat._cols, _cols, _matrix_elements, _cols,
+                  mat._matrix_elements, mat._cols,
+                  multiply_mat._matrix_elements, multiply_mat._cols);
+  return multiply_mat;
+}
+
+/**
+ * given a matrix A and a transposed view of a matrix B, creates a new
+ * matrix C such that C = A * B^T, B is read transposed without copying it
+ * @param mat transposed view to manipulate with the matrix
+ * @return a new matrix
+ */
+Matrix Matrix::operator* (const TransposedView &mat) const
+{
+  if (this->_cols != mat.rows ())
   {
-    for (int j = 0; j < mat.get_cols (); j++)
-    {
-      for (int m = 0; m < this->get_cols (); m++)
-      {
-        multiply_mat (i, j) += (*this) (i, m) * mat (m, j);
-      }
-    }
+    throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
   }
+  ConstMatrixView source = mat.source ();
+  Matrix multiply_mat (this->_rows, mat.cols ());
+  gemm::multiply (_rows, mat.cols (), _cols, _matrix_elements, _cols, false,
+                  source.data (), source.stride (), true,
+                  multiply_mat._matrix_elements, multiply_mat._cols);
   return multiply_mat;
 }
 
+/**
+ * given a transposed view of a matrix A and a matrix B, creates a new
+ * matrix C such that C = A^T * B, A is read transposed without copying it
+ * @param lhs transposed view to manipulate with rhs
+ * @param rhs matrix to manipulate with the view
+ * @return a new matrix
+ */
+Matrix operator* (const TransposedView &lhs, const Matrix &rhs)
+{
+  if (lhs.cols () != rhs._rows)
+  {
+    throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
+  }
+  ConstMatrixView source = lhs.source ();
+  Matrix multiply_mat (lhs.rows (), rhs._cols);
+  gemm::multiply (lhs.rows (), rhs._cols, lhs.cols (), source.data (),
+                  source.stride (), true, rhs._matrix_elements, rhs._cols,
+                  false, multiply_mat._matrix_elements, multiply_mat._cols);
+  return multiply_mat;
+}
+
+/**
+ * assign the product lhs * rhs to the matrix that called the method,
+ * without allocating: the matrix must already have the rows of lhs and the
+ * columns of rhs. a matrix that is lhs or rhs itself gets a new product
+ * @param lhs left matrix of the product
+ * @param rhs right matrix of the product
+ * @return a reference to the matrix that called the method
+ */
+Matrix &Matrix::assign_product (const Matrix &lhs, const Matrix &rhs)
+{
+  if (lhs._cols != rhs._rows)
+  {
+    throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
+  }
+  if (_rows != lhs._rows || _cols != rhs._cols)
+  {
+    throw std::length_error (LENGTH_ERROR_MSG);
+  }
+  if (this == &lhs || this == &rhs)
+  {
+    return (*this) = lhs * rhs;
+  }
+  gemm::multiply (lhs._rows, rhs._cols, lhs._cols, lhs._matrix_elements,
+                  lhs._cols, rhs._matrix_elements, rhs._cols,
+                  _matrix_elements, _cols);
+  return *this;
+}
+
 /**
  * assign the matrix that called the method with elements in mat
  * @param mat mat to assign to the class matrix
@@ -263,14 +544,30 @@ Matrix &Matrix::operator= (const Matrix &mat)
   {
     return *this;
   }
-  delete[] this->_matrix_elements;
-  _rows = mat._rows;
-  _cols = mat._cols;
-  _matrix_elements = new float[_rows * _cols];
-  for (int i = 0; i < _rows * _cols; i++)
+  // a matrix with as many elements keeps its memory
+  if (_rows * _cols != mat._rows * mat._cols)
   {
-    (*this)[i] = mat[i];
+    delete[] this->_matrix_elements;
+    _matrix_elements = new float[mat._rows * mat._cols];
   }
+  _rows = mat._rows;
+  _cols = mat._cols;
+  std::copy (mat.data (), mat.data () + _rows * _cols, data ());
+  return *this;
+}
+
+/**
+ * assign the matrix that called the method with the elements of mat
+ * without copying them, the elements are swapped so mat frees the old
+ * elements of the matrix
+ * @param mat mat to take the elements of
+ * @return a reference to the matrix that called the method
+ */
+Matrix &Matrix::operator= (Matrix &&mat) noexcept
+{
+  std::swap (_rows, mat._rows);
+  std::swap (_cols, mat._cols);
+  std::swap (_matrix_elements, mat._matrix_elements);
   return *this;
 }
 
@@ -282,16 +579,14 @@ Matrix &Matrix::operator= (const Matrix &mat)
  */
 Matrix &Matrix::operator+= (const Matrix &mat)
 {
-  if ((mat._cols != this->_cols) && (mat._rows != this->_rows))
+  if ((mat._cols != this->_cols) || (mat._rows != this->_rows))
   {
     throw std::length_error (LENGTH_ERROR_MSG);
   }
-  for (int i = 0; i < _rows; i++)
+#pragma GCC ivdep
+  for (int i = 0; i < _rows * _cols; i++)
   {
-    for (int j = 0; j < _cols; j++)
-    {
-      (*this) (i, j) += mat (i, j);
-    }
+    unchecked (i) += mat.unchecked (i);
   }
   return *this;
 }
@@ -371,7 +666,7 @@ std::ostream &operator<< (std::ostream &stream, const Matrix &mat)
   {
     for (int j = 0; j < mat.get_cols (); j++)
     {
-      if (mat (i, j) > TENTH)
+      if (mat.unchecked (i, j) > TENTH)
       {
         std::cout << DOUBLE_DOT;
       }
@@ -27,9 +27,28 @@ typedef struct matrix_dims
     int rows, cols;
 } matrix_dims;
 
+/**
+ * lazy matrix expressions, opt in by including MatrixExpression.h
+ */
+namespace lazy
+{
+    template<class E>
+    struct expression;
+}
+
+/**
+ * non-owning views of matrix elements, see MatrixView.h
+ */
+template<class T>
+class basic_matrix_view;
+typedef basic_matrix_view<float> MatrixView;
+typedef basic_matrix_view<const float> ConstMatrixView;
+class TransposedView;
+
 /**
  * class of matrix with floats in it's elements
- * All methods and operators function description are in Matrix.cpp
+ * All methods and operators function description are in Matrix.cpp,
+ * except the inline element accessors that are described below the class
  */
 class Matrix
 {
@@ -41,6 +60,13 @@ class Matrix
   // copy constructor
   Matrix (const Matrix &mat);
 
+  // move constructor
+  Matrix (Matrix &&mat) noexcept;
+
+  // evaluates a lazy expression, see MatrixExpression.h
+  template<class E>
+  Matrix (const lazy::expression<E> &expr);
+
   // destructor
   ~Matrix ();
 
@@ -50,6 +76,8 @@ class Matrix
 
   // methods on called matrix
   Matrix &transpose ();
+  Matrix transposed () const;
+  TransposedView transposed_view () const;
   Matrix &vectorize ();
   void plain_print () const;
   float norm () const;
@@ -62,7 +90,13 @@ class Matrix
   Matrix operator* (float scalar) const;
   friend Matrix operator* (float scalar, const Matrix &mat);
   Matrix operator* (const Matrix &mat) const;
+  Matrix operator* (const TransposedView &mat) const;
+  friend Matrix operator* (const TransposedView &lhs, const Matrix &rhs);
+  Matrix &assign_product (const Matrix &lhs, const Matrix &rhs);
   Matrix &operator= (const Matrix &mat);
+  Matrix &operator= (Matrix &&mat) noexcept;
+  template<class E>
+  Matrix &operator= (const lazy::expression<E> &expr);
   Matrix &operator+= (const Matrix &mat);
 
   // index operators
@@ -71,6 +105,18 @@ class Matrix
   float operator[] (int i) const;
   float &operator[] (int i);
 
+  // raw elements and unchecked index operators, for kernels
+  float *data ();
+  const float *data () const;
+  float unchecked (int i, int j) const;
+  float &unchecked (int i, int j);
+  float unchecked (int i) const;
+  float &unchecked (int i);
+
+  // views of the elements, see MatrixView.h
+  MatrixView view ();
+  ConstMatrixView view () const;
+
   // streams operator
   friend std::ostream &operator<< (std::ostream &stream, const Matrix &mat);
   friend std::istream &operator>> (std::istream &stream, Matrix &mat);
@@ -81,5 +127,61 @@ class Matrix
   float *_matrix_elements;
 };
 
+/**
+ * the elements of the matrix, row after row: the element (i, j) is at
+ * data ()[i * get_cols () + j]
+ * @return a pointer to the first element
+ */
+inline float *Matrix::data ()
+{
+  return _matrix_elements;
+}
+
+inline const float *Matrix::data () const
+{
+  return _matrix_elements;
+}
+
+/**
+ * the unchecked index operators are the index operators without the range
+ * check, for the inner loops of kernels that keep their indices in range
+ * themselves. building with MATRIX_CHECK_BOUNDS checks them too
+ */
+inline float Matrix::unchecked (int i, int j) const
+{
+#ifdef MATRIX_CHECK_BOUNDS
+  return (*this) (i, j);
+#else
+  return _matrix_elements[i * _cols + j];
+#endif
+}
+
+inline float &Matrix::unchecked (int i, int j)
+{
+#ifdef MATRIX_CHECK_BOUNDS
+  return (*this) (i, j);
+#else
+  return _matrix_elements[i * _cols + j];
+#endif
+}
+
+inline float Matrix::unchecked (int i) const
+{
+#ifdef MATRIX_CHECK_BOUNDS
+  return (*this)[i];
+#else
+  return _matrix_elements[i];
+#endif
+}
+
+inline float &Matrix::unchecked (int i)
+{
+#ifdef MATRIX_CHECK_BOUNDS
+  return (*this)[i];
+#else
+  return _matrix_elements[i];
+#endif
+}
+
 #endif //MATRIX_H
 
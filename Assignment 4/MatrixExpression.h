@@ -0,0 +1,214 @@
+// MatrixExpression.h
+#ifndef MATRIX_EXPRESSION_H
+#define MATRIX_EXPRESSION_H
+
+#include "Matrix.h"
+
+/**
+ * a declarative region of lazy elementwise matrix expressions.
+ * the operators of Matrix build a new matrix for every step, so
+ * a * s + b allocates and walks the memory twice. the operators here only
+ * record the expression, the whole expression is computed in one loop when
+ * it is assigned to a Matrix, without any temporary matrix:
+ *
+ *     Matrix c = lazy::of (a) * s + b;
+ *     c = lazy::dot (a, b) + c;
+ *
+ * an expression keeps pointers to its matrices, so it must be assigned to a
+ * Matrix in the statement that built it, don't keep it in an auto variable.
+ * assigning to one of the matrices of the expression is safe, every element
+ * is read only by the loop step that writes it.
+ */
+namespace lazy
+{
+    /**
+     * base of all expressions, E is the expression itself
+     */
+    template<class E>
+    struct expression
+    {
+      const E &self () const
+      {
+        return static_cast<const E &> (*this);
+      }
+    };
+
+    /**
+     * a leaf of an expression, the elements of a matrix
+     */
+    class operand : public expression<operand>
+    {
+     public:
+      explicit operand (const Matrix &mat)
+          : _rows (mat.get_rows ()), _cols (mat.get_cols ()),
+            _elements (mat.data ())
+      {}
+      int rows () const
+      { return _rows; }
+      int cols () const
+      { return _cols; }
+      float operator[] (int i) const
+      { return _elements[i]; }
+
+     private:
+      int _rows;
+      int _cols;
+      const float *_elements;
+    };
+
+    /**
+     * an elementwise binary expression, op is applied to each pair of
+     * elements of lhs and rhs
+     */
+    template<class L, class R, class Op>
+    class binary : public expression<binary<L, R, Op>>
+    {
+     public:
+      binary (const L &lhs, const R &rhs) : _lhs (lhs), _rhs (rhs)
+      {
+        if (lhs.rows () != rhs.rows () || lhs.cols () != rhs.cols ())
+        {
+          throw std::length_error (DIFFERENT_SIZE_MATRIX_ERROR_MSG);
+        }
+      }
+      int rows () const
+      { return _lhs.rows (); }
+      int cols () const
+      { return _lhs.cols (); }
+      float operator[] (int i) const
+      { return Op::apply (_lhs[i], _rhs[i]); }
+
+     private:
+      L _lhs;
+      R _rhs;
+    };
+
+    /**
+     * an expression with each element multiplied by a scalar
+     */
+    template<class E>
+    class scaled : public expression<scaled<E>>
+    {
+     public:
+      scaled (const E &expr, float scalar) : _expr (expr), _scalar (scalar)
+      {}
+      int rows () const
+      { return _expr.rows (); }
+      int cols () const
+      { return _expr.cols (); }
+      float operator[] (int i) const
+      { return _expr[i] * _scalar; }
+
+     private:
+      E _expr;
+      float _scalar;
+    };
+
+    struct add
+    {
+      static float apply (float lhs, float rhs)
+      { return lhs + rhs; }
+    };
+
+    struct multiply
+    {
+      static float apply (float lhs, float rhs)
+      { return lhs * rhs; }
+    };
+
+    /**
+     * starts an expression from a matrix
+     */
+    inline operand of (const Matrix &mat)
+    {
+      return operand (mat);
+    }
+
+    template<class L, class R>
+    binary<L, R, add> operator+ (const expression<L> &lhs,
+                                 const expression<R> &rhs)
+    {
+      return binary<L, R, add> (lhs.self (), rhs.self ());
+    }
+
+    template<class L>
+    binary<L, operand, add> operator+ (const expression<L> &lhs,
+                                       const Matrix &rhs)
+    {
+      return binary<L, operand, add> (lhs.self (), operand (rhs));
+    }
+
+    template<class R>
+    binary<operand, R, add> operator+ (const Matrix &lhs,
+                                       const expression<R> &rhs)
+    {
+      return binary<operand, R, add> (operand (lhs), rhs.self ());
+    }
+
+    template<class E>
+    scaled<E> operator* (const expression<E> &expr, float scalar)
+    {
+      return scaled<E> (expr.self (), scalar);
+    }
+
+    template<class E>
+    scaled<E> operator* (float scalar, const expression<E> &expr)
+    {
+      return scaled<E> (expr.self (), scalar);
+    }
+
+    /**
+     * lazy Matrix::dot, multiplies each element of lhs by the element of rhs
+     */
+    template<class L, class R>
+    binary<L, R, multiply> dot (const expression<L> &lhs,
+                                const expression<R> &rhs)
+    {
+      return binary<L, R, multiply> (lhs.self (), rhs.self ());
+    }
+
+    inline binary<operand, operand, multiply> dot (const Matrix &lhs,
+                                                   const Matrix &rhs)
+    {
+      return dot (of (lhs), of (rhs));
+    }
+}
+
+/**
+ * constructs a matrix from the value of a lazy expression
+ * @param expr - the expression to compute
+ */
+template<class E>
+Matrix::Matrix (const lazy::expression<E> &expr)
+    : _rows (0), _cols (0), _matrix_elements (nullptr)
+{
+  *this = expr;
+}
+
+/**
+ * assign the value of a lazy expression to the matrix that called the
+ * method, computing all of its elements in one loop
+ * @param expr - the expression to compute
+ * @return a reference to the matrix that called the method
+ */
+template<class E>
+Matrix &Matrix::operator= (const lazy::expression<E> &expr)
+{
+  const E &value = expr.self ();
+  int size = value.rows () * value.cols ();
+  if (_rows * _cols != size)
+  {
+    // the expression can't read this matrix, its shape is different
+    delete[] _matrix_elements;
+    _matrix_elements = new float[size];
+  }
+  _rows = value.rows ();
+  _cols = value.cols ();
+  for (int i = 0; i < size; i++)
+  {
+    _matrix_elements[i] = value[i];
+  }
+  return *this;
+}
+
+#endif //MATRIX_EXPRESSION_H
@@ -0,0 +1,151 @@
+// MatrixView.h
+#ifndef MATRIX_VIEW_H
+#define MATRIX_VIEW_H
+
+#include "Matrix.h"
+#include <stdexcept>
+
+/**
+ * a view of rows x cols elements that are owned by someone else, a Matrix
+ * or any row-major buffer. consecutive rows of the view are stride elements
+ * apart, so a view can be a block of a bigger matrix: the element (i, j)
+ * is at data ()[i * stride () + j].
+ * T is float for a view that can change the elements, const float for a
+ * read only view. a view is valid while the elements it views are, the
+ * index operator doesn't check its indices, block () does
+ */
+template<class T>
+class basic_matrix_view
+{
+ public:
+  /**
+   * constructor
+   * @param data - the first element
+   * @param rows - number of rows
+   * @param cols - number of columns
+   * @param stride - number of elements between the starts of two rows,
+   * at least cols
+   */
+  basic_matrix_view (T *data, int rows, int cols, int stride)
+      : _data (data), _rows (rows), _cols (cols), _stride (stride)
+  {
+    if (rows < 0 || cols < 0 || stride < cols)
+    {
+      throw std::length_error (LENGTH_ERROR_MSG);
+    }
+  }
+
+  /**
+   * a view that can change its elements is also a read only view
+   */
+  template<class U>
+  basic_matrix_view (const basic_matrix_view<U> &view)
+      : _data (view.data ()), _rows (view.rows ()), _cols (view.cols ()),
+        _stride (view.stride ())
+  {}
+
+  int rows () const
+  { return _rows; }
+  int cols () const
+  { return _cols; }
+  int stride () const
+  { return _stride; }
+  T *data () const
+  { return _data; }
+
+  /**
+   * @param i - a row of the view
+   * @return a pointer to the first element of row i
+   */
+  T *row (int i) const
+  {
+    return _data + (long) i * _stride;
+  }
+
+  /**
+   * the element in row i and column j, unchecked
+   */
+  T &operator() (int i, int j) const
+  {
+    return _data[(long) i * _stride + j];
+  }
+
+  /**
+   * a view of a block of this view
+   * @param row - first row of the block
+   * @param col - first column of the block
+   * @param rows - number of rows in the block
+   * @param cols - number of columns in the block
+   * @return a view of the block, with the stride of this view
+   */
+  basic_matrix_view block (int row, int col, int rows, int cols) const
+  {
+    if (row < 0 || col < 0 || rows < 0 || cols < 0
+        || row + rows > _rows || col + cols > _cols)
+    {
+      throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+    }
+    return basic_matrix_view (this->row (row) + col, rows, cols, _stride);
+  }
+
+ private:
+  T *_data;
+  int _rows;
+  int _cols;
+  int _stride;
+};
+
+/**
+ * a matrix read as its transpose, without moving its elements: the
+ * element (i, j) of the view is the element (j, i) of the matrix.
+ * the product operators of Matrix take it as it is, the multiplication
+ * kernels read the matrix transposed while they pack it (see Gemm.h), so
+ * a * b.transposed_view () never builds the transpose of b.
+ * like any view, it is valid while the matrix is
+ */
+class TransposedView
+{
+ public:
+  explicit TransposedView (ConstMatrixView view) : _view (view)
+  {}
+  int rows () const
+  { return _view.cols (); }
+  int cols () const
+  { return _view.rows (); }
+  float operator() (int i, int j) const
+  { return _view (j, i); }
+
+  /**
+   * @return a view of the matrix itself, not transposed
+   */
+  ConstMatrixView source () const
+  { return _view; }
+
+ private:
+  ConstMatrixView _view;
+};
+
+/**
+ * a view of all the elements of the matrix
+ * @return a view with the stride of the columns of the matrix
+ */
+inline MatrixView Matrix::view ()
+{
+  return MatrixView (_matrix_elements, _rows, _cols, _cols);
+}
+
+inline ConstMatrixView Matrix::view () const
+{
+  return ConstMatrixView (_matrix_elements, _rows, _cols, _cols);
+}
+
+/**
+ * the transpose of the matrix, without moving its elements
+ * @return a transposed view of the matrix
+ */
+inline TransposedView Matrix::transposed_view () const
+{
+  return TransposedView (view ());
+}
+
+#endif //MATRIX_VIEW_H
@@ -1,48 +1,144 @@
 #include "MlpNetwork.h"
+#include <algorithm>
 
 using namespace activation;
 
 /**
  * constructor that accepts 2 arrays of matrices, size of MLP_SIZE each.
- * one for weights and one for biases.
+ * one for weights and one for biases. the layers are built once here, with
+ * relu on all but the last one which has softmax.
  * @param weight
  * @param biases
  */
 MlpNetwork::MlpNetwork (Matrix weight[], Matrix biases[])
+    : _quantized (false)
 {
+  _layers.reserve (MLP_SIZE);
   for (int i = 0; i < MLP_SIZE; i++)
   {
-    _weight[i] = weight[i];
-    _biases[i] = biases[i];
+    _layers.emplace_back (weight[i], biases[i],
+                          i < MLP_SIZE - 1 ? relu : softmax);
+    _outputs[i] = Matrix (weight[i].get_rows (), ONE);
   }
 }
 
 /**
  * applies the entire network on a matrix.
- * given matrix vector in param, copy the matrix and applies relu and softmax
- * function (namespace activation )based on MLP_SIZE to copied matrix
+ * given matrix vector in param, applies the layers (relu and softmax
+ * function of namespace activation) one after the other, each layer writes
+ * into its output buffer, so nothing is copied or allocated.
  * finally: adds to digit struct the highest probability number and its value
- * @param vector matrix to copy from and apply layers of dense to the matrix.
+ * @param vector matrix to apply layers of dense to.
  * @return a digit struct.
  */
 digit MlpNetwork::operator() (const Matrix &vector)
 {
-  Matrix copied_vector (vector);
-  int size_of_mlp = MLP_SIZE - 1;
-  for (int i = 0; i < size_of_mlp; i++)
+  const Matrix *input = &vector;
+  for (int i = 0; i < MLP_SIZE; i++)
   {
-    Dense cur (_weight[i], _biases[i], activation::relu);
-    copied_vector = cur (copied_vector);
+    if (_quantized)
+    {
+      _quantized_layers[i].forward (*input, _outputs[i]);
+    }
+    else
+    {
+      _layers[i].forward (*input, _outputs[i]);
+    }
+    input = &_outputs[i];
   }
-  Dense cur (_weight[size_of_mlp], _biases[size_of_mlp], activation::softmax);
-  copied_vector = cur (copied_vector);
+  const Matrix &output = _outputs[MLP_SIZE - 1];
   digit result_dig = digit{0, 0};
   for (int i = 0; i < NUMBERS_OF_DIGITS; i++)
   {
-    if (copied_vector[i] > result_dig.probability)
+    if (output[i] > result_dig.probability)
     {
-      result_dig.value = i, result_dig.probability = copied_vector[i];
+      result_dig.value = i, result_dig.probability = output[i];
     }
   }
   return result_dig;
+}
+
+/**
+ * applies the entire network on a batch of images at once. every column of
+ * images is a vectorized image, every layer is a single matrix product over
+ * all the columns, so each weight is read once per batch instead of once
+ * per image.
+ * @param images matrix with an image in every column.
+ * @return a digit struct for every column, in order.
+ */
+std::vector<digit> MlpNetwork::classify_batch (const Matrix &images)
+{
+  Matrix outputs = _quantized ? _quantized_layers[0] (images)
+                              : _layers[0] (images);
+  for (int i = 1; i < MLP_SIZE; i++)
+  {
+    outputs = _quantized ? _quantized_layers[i] (outputs)
+                         : _layers[i] (outputs);
+  }
+  std::vector<digit> results (outputs.get_cols (), digit{0, 0});
+  for (int j = 0; j < outputs.get_cols (); j++)
+  {
+    for (int i = 0; i < NUMBERS_OF_DIGITS; i++)
+    {
+      if (outputs (i, j) > results[j].probability)
+      {
+        results[j].value = i, results[j].probability = outputs (i, j);
+      }
+    }
+  }
+  return results;
+}
+
+/**
+ * switches the network between the float layers and 8 bit copies of them
+ * (QuantizedDense), which read a quarter of the memory per image at the
+ * cost of some precision in the probabilities. the 8 bit layers are
+ * calibrated from the weights the first time they are used
+ * @param quantized true to classify with the 8 bit layers
+ */
+void MlpNetwork::set_quantized (bool quantized)
+{
+  if (quantized && _quantized_layers.empty ())
+  {
+    _quantized_layers.reserve (MLP_SIZE);
+    for (const Dense &layer : _layers)
+    {
+      _quantized_layers.emplace_back (layer);
+    }
+  }
+  _quantized = quantized;
+}
+
+/**
+ * applies the entire network on many images. the images are gathered into
+ * batches of MLP_BATCH_SIZE columns, see classify_batch.
+ * @param images images of any shape with as many elements as an image.
+ * @return a digit struct for every image, in order.
+ */
+std::vector<digit> MlpNetwork::operator() (const std::vector<Matrix> &images)
+{
+  std::vector<digit> results;
+  results.reserve (images.size ());
+  int image_size = img_dims.rows * img_dims.cols;
+  for (int first = 0; first < (int) images.size (); first += MLP_BATCH_SIZE)
+  {
+    int count = std::min (MLP_BATCH_SIZE, (int) images.size () - first);
+    Matrix batch (image_size, count);
+    for (int j = 0; j < count; j++)
+    {
+      const Matrix &image = images[first + j];
+      if (image.get_rows () * image.get_cols () != image_size)
+      {
+        throw std::length_error (LENGTH_ERROR_MSG);
+      }
+      for (int i = 0; i < image_size; i++)
+      {
+        batch.unchecked (i, j) = image.unchecked (i);
+      }
+    }
+    std::vector<digit> batch_results = classify_batch (batch);
+    results.insert (results.end (), batch_results.begin (),
+                    batch_results.end ());
+  }
+  return results;
 }
\ No newline at end of file
@@ -3,9 +3,11 @@
 #ifndef MLPNETWORK_H
 #define MLPNETWORK_H
 
-#include "Dense.h"
+#include "QuantizedDense.h"
+#include <vector>
 
 #define MLP_SIZE 4
+#define MLP_BATCH_SIZE 128
 
 #define NUMBERS_OF_DIGITS 10
 /**
@@ -41,10 +43,19 @@ class MlpNetwork
  public:
   MlpNetwork (Matrix weight[], Matrix _biases[]);
   digit operator() (const Matrix &vector);
+  std::vector<digit> operator() (const std::vector<Matrix> &images);
+  std::vector<digit> classify_batch (const Matrix &images);
+  void set_quantized (bool quantized);
 
  private:
-  Matrix _weight[MLP_SIZE];
-  Matrix _biases[MLP_SIZE];
+  // the layers own a copy of the weights, made once
+  std::vector<Dense> _layers;
+  // the output of every layer for a single vector, allocated once so that
+  // classifying a vector allocates nothing
+  Matrix _outputs[MLP_SIZE];
+  // 8 bit copies of the layers, calibrated on the first set_quantized
+  std::vector<QuantizedDense> _quantized_layers;
+  bool _quantized;
 };
 
 #endif // MLPNETWORK_H
\ No newline at end of file
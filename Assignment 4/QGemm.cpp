@@ -0,0 +1,467 @@
+#include "QGemm.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QGEMM_X86
+#endif
+
+#define AVX2_BYTES 32
+#define AVX512_BYTES 64
+#define AVX2_LANES 8
+#define AVX512_LANES 16
+// rows of W that share every load of a column of X, and columns of X that
+// share every load of a row of W, in a tile. AVX2 has half the registers
+// of AVX-512 for the accumulators
+#define QGEMM_ROWS 4
+#define AVX2_COLS 2
+#define AVX512_COLS 4
+
+/***************************/
+/**        Kernels         */
+/***************************/
+
+/**
+ * a tile kernel computes y[i * ldy + j] = dot (w row i, x column j) for
+ * QGEMM_ROWS rows and a fixed number of columns, over a depth k that is a
+ * multiple of QGEMM_K_ALIGN. column j of x starts at x + j * ldx
+ */
+typedef void (*qtile_kernel) (int k, const int8_t *w, int ldw,
+                              const uint8_t *x, int ldx, int32_t *y,
+                              int ldy);
+
+/**
+ * the kernels of one instruction set: tiles of cols columns, and tiles of
+ * one column for the columns left over
+ */
+struct qkernel
+{
+  qgemm::isa id;
+  int cols;
+  qtile_kernel tile;
+  qtile_kernel column;
+};
+
+/**
+ * portable kernel for m rows and one column, the products fit 16 bits and
+ * are summed in 32 bits
+ */
+static void scalar_qgemv (int m, int k, const int8_t *w, int ldw,
+                          const uint8_t *x, int32_t *y, int ldy)
+{
+  for (int i = 0; i < m; i++)
+  {
+    const int8_t *row = w + (long) i * ldw;
+    int32_t sum = 0;
+    for (int p = 0; p < k; p++)
+    {
+      sum += (int32_t) row[p] * (int32_t) x[p];
+    }
+    y[(long) i * ldy] = sum;
+  }
+}
+
+/**
+ * portable tile kernel, a column at a time
+ */
+static void scalar_tile (int k, const int8_t *w, int ldw, const uint8_t *x,
+                         int, int32_t *y, int ldy)
+{
+  scalar_qgemv (QGEMM_ROWS, k, w, ldw, x, y, ldy);
+}
+
+#ifdef QGEMM_X86
+
+/**
+ * the sums of the eight 32 bit lanes of four AVX2 registers, in order.
+ * hadd adds neighbouring lanes of two registers within each 128 bit half,
+ * three of them leave a sum of four lanes of every register in each half
+ */
+__attribute__ ((target ("avx2")))
+static __m128i avx2_sum4 (const __m256i *v)
+{
+  __m256i sums = _mm256_hadd_epi32 (_mm256_hadd_epi32 (v[0], v[1]),
+                                    _mm256_hadd_epi32 (v[2], v[3]));
+  return _mm_add_epi32 (_mm256_castsi256_si128 (sums),
+                        _mm256_extracti128_si256 (sums, 1));
+}
+
+/**
+ * stores the sums of a tile in y
+ * @param sums - QGEMM_ROWS x cols sums, row after row
+ */
+static void store_tile (const int32_t *sums, int cols, int32_t *y, int ldy)
+{
+  for (int r = 0; r < QGEMM_ROWS; r++)
+  {
+    for (int c = 0; c < cols; c++)
+    {
+      y[(long) r * ldy + c] = sums[r * cols + c];
+    }
+  }
+}
+
+/**
+ * AVX2 kernel: pmaddubsw multiplies the unsigned x by the signed w and
+ * adds pairs into 16 bits, pmaddwd by ones widens the pairs to 32 bits.
+ * every load of w is used for COLS columns, every load of x for
+ * QGEMM_ROWS rows
+ */
+template<int COLS>
+__attribute__ ((target ("avx2")))
+static void avx2_tile (int k, const int8_t *w, int ldw, const uint8_t *x,
+                       int ldx, int32_t *y, int ldy)
+{
+  const __m256i ones = _mm256_set1_epi16 (1);
+  __m256i acc[QGEMM_ROWS][COLS];
+#pragma GCC unroll 4
+  for (int r = 0; r < QGEMM_ROWS; r++)
+  {
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      acc[r][c] = _mm256_setzero_si256 ();
+    }
+  }
+  for (int p = 0; p < k; p += AVX2_BYTES)
+  {
+    __m256i xv[COLS];
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      xv[c] = _mm256_loadu_si256 ((const __m256i *) (x + (long) c * ldx + p));
+    }
+#pragma GCC unroll 4
+    for (int r = 0; r < QGEMM_ROWS; r++)
+    {
+      __m256i wv = _mm256_loadu_si256 (
+          (const __m256i *) (w + (long) r * ldw + p));
+#pragma GCC unroll 4
+      for (int c = 0; c < COLS; c++)
+      {
+        __m256i pairs = _mm256_maddubs_epi16 (xv[c], wv);
+        acc[r][c] = _mm256_add_epi32 (acc[r][c],
+                                      _mm256_madd_epi16 (pairs, ones));
+      }
+    }
+  }
+  // QGEMM_ROWS accumulators at a time
+  alignas (16) int32_t sums[QGEMM_ROWS * COLS];
+#pragma GCC unroll 4
+  for (int g = 0; g < QGEMM_ROWS * COLS; g += QGEMM_ROWS)
+  {
+    _mm_store_si128 ((__m128i *) (sums + g), avx2_sum4 (acc[0] + g));
+  }
+  store_tile (sums, COLS, y, ldy);
+}
+
+/**
+ * AVX-VNNI kernel: vpdpbusd multiplies the unsigned x by the signed w and
+ * adds groups of four straight into 32 bits, in one instruction
+ */
+template<int COLS>
+__attribute__ ((target ("avx2,avxvnni")))
+static void avx_vnni_tile (int k, const int8_t *w, int ldw, const uint8_t *x,
+                           int ldx, int32_t *y, int ldy)
+{
+  __m256i acc[QGEMM_ROWS][COLS];
+#pragma GCC unroll 4
+  for (int r = 0; r < QGEMM_ROWS; r++)
+  {
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      acc[r][c] = _mm256_setzero_si256 ();
+    }
+  }
+  for (int p = 0; p < k; p += AVX2_BYTES)
+  {
+    __m256i xv[COLS];
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      xv[c] = _mm256_loadu_si256 ((const __m256i *) (x + (long) c * ldx + p));
+    }
+#pragma GCC unroll 4
+    for (int r = 0; r < QGEMM_ROWS; r++)
+    {
+      __m256i wv = _mm256_loadu_si256 (
+          (const __m256i *) (w + (long) r * ldw + p));
+#pragma GCC unroll 4
+      for (int c = 0; c < COLS; c++)
+      {
+        acc[r][c] = _mm256_dpbusd_avx_epi32 (acc[r][c], xv[c], wv);
+      }
+    }
+  }
+  // QGEMM_ROWS accumulators at a time
+  alignas (16) int32_t sums[QGEMM_ROWS * COLS];
+#pragma GCC unroll 4
+  for (int g = 0; g < QGEMM_ROWS * COLS; g += QGEMM_ROWS)
+  {
+    _mm_store_si128 ((__m128i *) (sums + g), avx2_sum4 (acc[0] + g));
+  }
+  store_tile (sums, COLS, y, ldy);
+}
+
+/**
+ * the sums of the sixteen 32 bit lanes of four AVX-512 registers, in
+ * order. the registers are folded to 256 bits through memory, as in
+ * Gemm.cpp: gcc 12 flags every 512 bit shuffle and extract with
+ * -Wuninitialized
+ */
+__attribute__ ((target ("avx512f")))
+static __m128i avx512_sum4 (const __m512i *v)
+{
+  alignas (64) int32_t lanes[4][AVX512_LANES];
+  __m256i halves[4];
+#pragma GCC unroll 4
+  for (int i = 0; i < 4; i++)
+  {
+    _mm512_store_si512 (lanes[i], v[i]);
+    halves[i] = _mm256_add_epi32 (
+        _mm256_load_si256 ((const __m256i *) lanes[i]),
+        _mm256_load_si256 ((const __m256i *) (lanes[i] + AVX2_LANES)));
+  }
+  return avx2_sum4 (halves);
+}
+
+/**
+ * AVX512-VNNI kernel, vpdpbusd on 64 bytes at a time
+ */
+template<int COLS>
+__attribute__ ((target ("avx512f,avx512vnni")))
+static void avx512_vnni_tile (int k, const int8_t *w, int ldw,
+                              const uint8_t *x, int ldx, int32_t *y, int ldy)
+{
+  __m512i acc[QGEMM_ROWS][COLS];
+#pragma GCC unroll 4
+  for (int r = 0; r < QGEMM_ROWS; r++)
+  {
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      acc[r][c] = _mm512_setzero_si512 ();
+    }
+  }
+  for (int p = 0; p < k; p += AVX512_BYTES)
+  {
+    __m512i xv[COLS];
+#pragma GCC unroll 4
+    for (int c = 0; c < COLS; c++)
+    {
+      xv[c] = _mm512_loadu_si512 (x + (long) c * ldx + p);
+    }
+#pragma GCC unroll 4
+    for (int r = 0; r < QGEMM_ROWS; r++)
+    {
+      __m512i wv = _mm512_loadu_si512 (w + (long) r * ldw + p);
+#pragma GCC unroll 4
+      for (int c = 0; c < COLS; c++)
+      {
+        acc[r][c] = _mm512_dpbusd_epi32 (acc[r][c], xv[c], wv);
+      }
+    }
+  }
+  // QGEMM_ROWS accumulators at a time
+  alignas (16) int32_t sums[QGEMM_ROWS * COLS];
+#pragma GCC unroll 4
+  for (int g = 0; g < QGEMM_ROWS * COLS; g += QGEMM_ROWS)
+  {
+    _mm_store_si128 ((__m128i *) (sums + g), avx512_sum4 (acc[0] + g));
+  }
+  store_tile (sums, COLS, y, ldy);
+}
+
+#endif
+
+/***************************/
+/**       Dispatch         */
+/***************************/
+
+static const qkernel scalar_kernel = {qgemm::isa::scalar, 1, scalar_tile,
+                                      scalar_tile};
+#ifdef QGEMM_X86
+static const qkernel avx2_kernel = {qgemm::isa::avx2, AVX2_COLS,
+                                    avx2_tile<AVX2_COLS>, avx2_tile<1>};
+static const qkernel avx_vnni_kernel = {qgemm::isa::avx_vnni, AVX2_COLS,
+                                        avx_vnni_tile<AVX2_COLS>,
+                                        avx_vnni_tile<1>};
+static const qkernel avx512_vnni_kernel = {
+    qgemm::isa::avx512_vnni, AVX512_COLS, avx512_vnni_tile<AVX512_COLS>,
+    avx512_vnni_tile<1>};
+#endif
+
+/**
+ * @param kernel - an instruction set
+ * @return the kernel of the instruction set
+ */
+static const qkernel *kernel_of (qgemm::isa kernel)
+{
+#ifdef QGEMM_X86
+  switch (kernel)
+  {
+    case qgemm::isa::avx512_vnni:
+      return &avx512_vnni_kernel;
+    case qgemm::isa::avx_vnni:
+      return &avx_vnni_kernel;
+    case qgemm::isa::avx2:
+      return &avx2_kernel;
+    default:
+      break;
+  }
+#endif
+  (void) kernel;
+  return &scalar_kernel;
+}
+
+/**
+ * @param kernel - an instruction set
+ * @return true if the cpu supports the instruction set
+ */
+static bool supported (qgemm::isa kernel)
+{
+#ifdef QGEMM_X86
+  __builtin_cpu_init ();
+  switch (kernel)
+  {
+    case qgemm::isa::avx512_vnni:
+      return __builtin_cpu_supports ("avx512f")
+             && __builtin_cpu_supports ("avx512vnni");
+    case qgemm::isa::avx_vnni:
+      return __builtin_cpu_supports ("avx2")
+             && __builtin_cpu_supports ("avxvnni");
+    case qgemm::isa::avx2:
+      return __builtin_cpu_supports ("avx2");
+    default:
+      break;
+  }
+#endif
+  return kernel == qgemm::isa::scalar;
+}
+
+/**
+ * the kernel in use, chosen on first use by best_isa
+ * @return a reference to the pointer to the kernel in use
+ */
+static const qkernel *&active_kernel ()
+{
+  static const qkernel *active = kernel_of (qgemm::best_isa ());
+  return active;
+}
+
+/***************************/
+/**     Multiplication     */
+/***************************/
+
+/**
+ * @param k - depth of a product
+ * @return k rounded up to a multiple of QGEMM_K_ALIGN
+ */
+int qgemm::padded_depth (int k)
+{
+  return (k + QGEMM_K_ALIGN - 1) / QGEMM_K_ALIGN * QGEMM_K_ALIGN;
+}
+
+/**
+ * Y = W * X in 32 bit integers, with W an m x k matrix of signed 8 bit
+ * weights, row-major with leading dimension ldw, and X a k x n matrix of
+ * 8 bit activations up to QGEMM_MAX_ACTIVATION stored column by column:
+ * column j starts at x + j * ldx. Y is an m x n row-major matrix with
+ * leading dimension ldy. k must be padded (see padded_depth), the padding
+ * of W or of X must be zero
+ */
+void qgemm::multiply (int m, int n, int k, const int8_t *w, int ldw,
+                      const uint8_t *x, int ldx, int32_t *y, int ldy)
+{
+  const qkernel &kernel = *active_kernel ();
+  int rows = m / QGEMM_ROWS * QGEMM_ROWS;
+  // a tile of columns stays in L1 while the weights of the layer pass by
+  // it from L2, so the weights are read once per tile instead of once per
+  // column
+  int j = 0;
+  for (; j + kernel.cols <= n; j += kernel.cols)
+  {
+    for (int i = 0; i < rows; i += QGEMM_ROWS)
+    {
+      kernel.tile (k, w + (long) i * ldw, ldw, x + (long) j * ldx, ldx,
+                   y + (long) i * ldy + j, ldy);
+    }
+  }
+  for (; j < n; j++)
+  {
+    for (int i = 0; i < rows; i += QGEMM_ROWS)
+    {
+      kernel.column (k, w + (long) i * ldw, ldw, x + (long) j * ldx, ldx,
+                     y + (long) i * ldy + j, ldy);
+    }
+  }
+  // the last rows, fewer than a tile
+  for (j = 0; j < n && rows < m; j++)
+  {
+    scalar_qgemv (m - rows, k, w + (long) rows * ldw, ldw,
+                  x + (long) j * ldx, y + (long) rows * ldy + j, ldy);
+  }
+}
+
+/**
+ * the best instruction set the cpu supports
+ * @return the instruction set
+ */
+qgemm::isa qgemm::best_isa ()
+{
+  static const isa best_first[] = {isa::avx512_vnni, isa::avx_vnni,
+                                   isa::avx2};
+  for (isa kernel : best_first)
+  {
+    if (supported (kernel))
+    {
+      return kernel;
+    }
+  }
+  return isa::scalar;
+}
+
+/**
+ * @return the instruction set of the kernel in use
+ */
+qgemm::isa qgemm::active_isa ()
+{
+  return active_kernel ()->id;
+}
+
+/**
+ * choose the kernel of an instruction set, to compare kernels or to test
+ * the scalar one. not thread-safe, call it before multiplying.
+ * an instruction set the cpu doesn't support falls back to the best one
+ * it does
+ * @param kernel - an instruction set
+ * @return the instruction set in use
+ */
+qgemm::isa qgemm::use_isa (isa kernel)
+{
+  if (!supported (kernel))
+  {
+    kernel = best_isa ();
+  }
+  active_kernel () = kernel_of (kernel);
+  return kernel;
+}
+
+/**
+ * @param kernel - an instruction set
+ * @return the name of the instruction set
+ */
+const char *qgemm::isa_name (isa kernel)
+{
+  switch (kernel)
+  {
+    case isa::avx512_vnni:
+      return "avx512_vnni";
+    case isa::avx_vnni:
+      return "avx_vnni";
+    case isa::avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
@@ -0,0 +1,43 @@
+// QGemm.h
+#ifndef QGEMM_H
+#define QGEMM_H
+
+#include <cstdint>
+
+// the depth of a quantized product is padded with zeros to a multiple of
+// QGEMM_K_ALIGN, so the kernels never handle a tail
+#define QGEMM_K_ALIGN 64
+// the largest quantized activation: with 7 bits the pairs of products that
+// pmaddubsw adds never saturate 16 bits, 2 * 127 * 127 < 32767
+#define QGEMM_MAX_ACTIVATION 127
+#define QGEMM_MAX_WEIGHT 127
+
+/**
+ * a declarative region of the 8 bit matrix multiplication kernels used by
+ * QuantizedDense. the weights are signed 8 bit integers, the activations
+ * unsigned 8 bit integers up to QGEMM_MAX_ACTIVATION, and the products
+ * are accumulated in 32 bit integers, so every kernel computes exactly the
+ * same result. the kernel is chosen once at runtime by the instructions
+ * the cpu supports: AVX512-VNNI, AVX-VNNI, AVX2 or a portable scalar one.
+ * kernels are described in QGemm.cpp
+ */
+namespace qgemm
+{
+    /**
+     * the instruction sets a kernel can be built for
+     */
+    enum class isa
+    {
+        scalar, avx2, avx_vnni, avx512_vnni
+    };
+
+    int padded_depth (int k);
+    void multiply (int m, int n, int k, const int8_t *w, int ldw,
+                   const uint8_t *x, int ldx, int32_t *y, int ldy);
+    isa best_isa ();
+    isa active_isa ();
+    isa use_isa (isa kernel);
+    const char *isa_name (isa kernel);
+}
+
+#endif //QGEMM_H
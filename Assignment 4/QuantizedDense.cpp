@@ -0,0 +1,305 @@
+#include "QuantizedDense.h"
+#include "QGemm.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define QUANTIZE_SSE
+#endif
+
+// independent partial ranges of a column, see column_range
+#define RANGE_LANES 8
+#define SSE_WIDTH 4
+
+/**
+ * the range of a column of a matrix, widened to include 0 so that a
+ * column of positive values (the output of relu) is quantized from 0.
+ * RANGE_LANES independent minimums and maximums, so the loop isn't one
+ * long chain of dependent comparisons
+ * @param x - the first element of the column
+ * @param k - number of elements
+ * @param stride - distance between two elements, the columns of the matrix
+ * @param low - gets the lowest value, 0 at most
+ * @param high - gets the highest value, 0 at least
+ */
+static void column_range (const float *x, int k, int stride, float &low,
+                          float &high)
+{
+  float lows[RANGE_LANES] = {}, highs[RANGE_LANES] = {};
+  int p = 0;
+  for (; p + RANGE_LANES <= k; p += RANGE_LANES)
+  {
+    for (int l = 0; l < RANGE_LANES; l++)
+    {
+      float value = x[(size_t) (p + l) * stride];
+      lows[l] = std::min (lows[l], value);
+      highs[l] = std::max (highs[l], value);
+    }
+  }
+  for (; p < k; p++)
+  {
+    lows[0] = std::min (lows[0], x[(size_t) p * stride]);
+    highs[0] = std::max (highs[0], x[(size_t) p * stride]);
+  }
+  low = *std::min_element (lows, lows + RANGE_LANES);
+  high = *std::max_element (highs, highs + RANGE_LANES);
+}
+
+/**
+ * the ranges of all the columns of a matrix, as column_range, read row by
+ * row. a batch is stored with its columns side by side, so this reads
+ * every row once and in order, and the columns are independent lanes
+ * @param x - the matrix
+ * @param k - number of rows
+ * @param n - number of columns
+ * @param low - gets the lowest value of every column, 0 at most
+ * @param high - gets the highest value of every column, 0 at least
+ */
+static void column_ranges (const float *x, int k, int n, float *low,
+                           float *high)
+{
+  std::fill (low, low + n, 0.0f);
+  std::fill (high, high + n, 0.0f);
+  for (int p = 0; p < k; p++)
+  {
+    const float *row = x + (size_t) p * n;
+    int j = 0;
+#ifdef QUANTIZE_SSE
+    for (; j + SSE_WIDTH <= n; j += SSE_WIDTH)
+    {
+      __m128 values = _mm_loadu_ps (row + j);
+      _mm_storeu_ps (low + j, _mm_min_ps (_mm_loadu_ps (low + j), values));
+      _mm_storeu_ps (high + j, _mm_max_ps (_mm_loadu_ps (high + j), values));
+    }
+#endif
+    for (; j < n; j++)
+    {
+      low[j] = std::min (low[j], row[j]);
+      high[j] = std::max (high[j], row[j]);
+    }
+  }
+}
+
+/**
+ * quantizes the columns of a matrix, x = low + step * q rounded to the
+ * nearest q up to QGEMM_MAX_ACTIVATION, every column into a row of
+ * quantized. the matrix is read row by row as in column_ranges. with SSE
+ * a block of four rows and four columns is transposed in registers, so a
+ * column gets its four bytes in one store
+ * @param x - the matrix
+ * @param k - number of rows
+ * @param n - number of columns
+ * @param low - the lowest value of every column
+ * @param inverse - 1 / step of every column, 0 for a constant column
+ * @param quantized - gets the columns, one after the other
+ * @param depth - the distance between two columns in quantized
+ */
+static void quantize_columns (const float *x, int k, int n, const float *low,
+                              const float *inverse, uint8_t *quantized,
+                              int depth)
+{
+  int p = 0;
+#ifdef QUANTIZE_SSE
+  __m128 half = _mm_set1_ps (0.5f);
+  __m128 top = _mm_set1_ps ((float) QGEMM_MAX_ACTIVATION);
+  for (; p + SSE_WIDTH <= k; p += SSE_WIDTH)
+  {
+    const float *rows = x + (size_t) p * n;
+    int j = 0;
+    for (; j + SSE_WIDTH <= n; j += SSE_WIDTH)
+    {
+      __m128 lows = _mm_loadu_ps (low + j);
+      __m128 inverses = _mm_loadu_ps (inverse + j);
+      __m128 v[SSE_WIDTH];
+      for (int r = 0; r < SSE_WIDTH; r++)
+      {
+        __m128 values = _mm_loadu_ps (rows + (size_t) r * n + j);
+        v[r] = _mm_min_ps (_mm_add_ps (_mm_mul_ps (_mm_sub_ps (values, lows),
+                                                   inverses), half), top);
+      }
+      _MM_TRANSPOSE4_PS (v[0], v[1], v[2], v[3]);
+      // the values are in [0, QGEMM_MAX_ACTIVATION], the packs don't clip
+      __m128i bytes = _mm_packus_epi16 (
+          _mm_packs_epi32 (_mm_cvttps_epi32 (v[0]), _mm_cvttps_epi32 (v[1])),
+          _mm_packs_epi32 (_mm_cvttps_epi32 (v[2]), _mm_cvttps_epi32 (v[3])));
+      alignas (16) uint8_t block[SSE_WIDTH * SSE_WIDTH];
+      _mm_store_si128 ((__m128i *) block, bytes);
+      for (int c = 0; c < SSE_WIDTH; c++)
+      {
+        std::memcpy (quantized + (size_t) (j + c) * depth + p,
+                     block + c * SSE_WIDTH, SSE_WIDTH);
+      }
+    }
+    for (; j < n; j++)
+    {
+      for (int r = 0; r < SSE_WIDTH; r++)
+      {
+        float value = (rows[(size_t) r * n + j] - low[j]) * inverse[j] + 0.5f;
+        quantized[(size_t) j * depth + p + r] =
+            (uint8_t) std::min (value, (float) QGEMM_MAX_ACTIVATION);
+      }
+    }
+  }
+#endif
+  for (; p < k; p++)
+  {
+    const float *row = x + (size_t) p * n;
+    for (int j = 0; j < n; j++)
+    {
+      float value = (row[j] - low[j]) * inverse[j] + 0.5f;
+      quantized[(size_t) j * depth + p] =
+          (uint8_t) std::min (value, (float) QGEMM_MAX_ACTIVATION);
+    }
+  }
+}
+
+/**
+ * Constructor which calibrates the 8 bit weights of a layer: every row of
+ * the weights is scaled so its largest magnitude is QGEMM_MAX_WEIGHT and
+ * rounded. the bias and activation function are kept as they are
+ * @param layer the float layer to quantize
+ */
+QuantizedDense::QuantizedDense (const Dense &layer)
+    : _bias (layer.get_bias ()), _activation_func (layer.get_activation ()),
+      _activation_in_place (activation::in_place (layer.get_activation ()))
+{
+  Matrix weights = layer.get_weights ();
+  _rows = weights.get_rows ();
+  _cols = weights.get_cols ();
+  _depth = qgemm::padded_depth (_cols);
+  _weights.assign ((size_t) _rows * _depth, 0);
+  _scales.assign (_rows, 0);
+  _row_sums.assign (_rows, 0);
+  for (int i = 0; i < _rows; i++)
+  {
+    float max_abs = 0;
+    for (int j = 0; j < _cols; j++)
+    {
+      max_abs = std::max (max_abs, std::fabs (weights.unchecked (i, j)));
+    }
+    if (max_abs == 0)
+    {
+      // a row of zeros stays zero, its output is the bias
+      continue;
+    }
+    _scales[i] = max_abs / QGEMM_MAX_WEIGHT;
+    for (int j = 0; j < _cols; j++)
+    {
+      long quantized = std::lround (weights.unchecked (i, j) / _scales[i]);
+      _weights[(size_t) i * _depth + j] = (int8_t) quantized;
+      _row_sums[i] += (int32_t) quantized;
+    }
+  }
+}
+
+/**
+ * applies the layer on input, see forward
+ * @param vector a vector (or a matrix of vectors in columns) to manipulate
+ * @return output matrix, a column for every input column
+ */
+Matrix QuantizedDense::operator() (const Matrix &vector) const
+{
+  Matrix output (_rows, vector.get_cols ());
+  forward (vector, output);
+  return output;
+}
+
+/**
+ * applies the layer on input into a given output. every column of the
+ * input is quantized on its own: from the lowest value of the column (or
+ * 0) to the highest one in QGEMM_MAX_ACTIVATION steps, so x = low + step
+ * * q. with the row scale s of the weights, the output before the bias is
+ * s * (step * sum (w_q * q) + low * sum (w_q)), the sum of each row of the
+ * quantized weights is computed once in the constructor.
+ * the buffers of the quantized input are kept between calls, so like
+ * Dense::forward nothing is allocated once they are large enough
+ * @param vector a vector (or a matrix of vectors in columns) to manipulate
+ * @param output matrix with the rows of the weights and the columns of
+ * vector, gets the output of the layer
+ */
+void QuantizedDense::forward (const Matrix &vector, Matrix &output) const
+{
+  int n = vector.get_cols ();
+  if (vector.get_rows () != _cols)
+  {
+    throw std::length_error (MULTIPLY_LENGTH_ERROR_MSG);
+  }
+  if (output.get_rows () != _rows || output.get_cols () != n)
+  {
+    throw std::length_error (LENGTH_ERROR_MSG);
+  }
+  // a thread quantizes into its own buffers
+  thread_local std::vector<uint8_t> input;
+  thread_local std::vector<float> lows, highs, steps, inverses;
+  thread_local std::vector<int32_t> products;
+  input.resize ((size_t) n * _depth);
+  lows.resize (n);
+  highs.resize (n);
+  steps.resize (n);
+  inverses.resize (n);
+  products.resize ((size_t) _rows * n);
+
+  // the buffers are reached through a thread_local lookup, only once
+  uint8_t *quantized = input.data ();
+  float *low = lows.data (), *high = highs.data ();
+  float *step = steps.data (), *inverse = inverses.data ();
+  int32_t *product = products.data ();
+
+  // a few columns are too few lanes for column_ranges
+  if (n < RANGE_LANES)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      column_range (vector.data () + j, _cols, n, low[j], high[j]);
+    }
+  }
+  else
+  {
+    column_ranges (vector.data (), _cols, n, low, high);
+  }
+  for (int j = 0; j < n; j++)
+  {
+    step[j] = (high[j] - low[j]) / QGEMM_MAX_ACTIVATION;
+    inverse[j] = step[j] > 0 ? 1 / step[j] : 0;
+  }
+  quantize_columns (vector.data (), _cols, n, low, inverse, quantized,
+                    _depth);
+  for (int j = 0; j < n; j++)
+  {
+    uint8_t *column_q = quantized + (size_t) j * _depth;
+    std::fill (column_q + _cols, column_q + _depth, 0);
+  }
+
+  qgemm::multiply (_rows, n, _depth, _weights.data (), _depth, quantized,
+                   _depth, product, n);
+  bool relu = _activation_in_place == activation::relu_in_place;
+  // relu as a max without a branch, the signs of the outputs are random
+  float lowest = relu ? 0 : -std::numeric_limits<float>::infinity ();
+  for (int i = 0; i < _rows; i++)
+  {
+    float scale = _scales[i], offset = (float) _row_sums[i];
+    float bias = _bias.unchecked (i);
+    float *out = output.data () + (size_t) i * n;
+    for (int j = 0; j < n; j++)
+    {
+      float value = scale * (step[j] * (float) product[(size_t) i * n + j]
+                             + low[j] * offset) + bias;
+      out[j] = std::max (value, lowest);
+    }
+  }
+  if (relu)
+  {
+    return;
+  }
+  if (_activation_in_place != nullptr)
+  {
+    _activation_in_place (output);
+  }
+  else
+  {
+    output = _activation_func (output);
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef QUANTIZEDDENSE_H
+#define QUANTIZEDDENSE_H
+
+#include "Dense.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * QuantizedDense is a Dense layer with 8 bit weights, a quarter of the
+ * memory to stream per vector. every row of the weights has its own scale,
+ * the inputs are quantized per column when the layer is applied, and the
+ * products are accumulated in 32 bit integers (QGemm.h)
+ * methods and constructors description in QuantizedDense.cpp
+ */
+class QuantizedDense
+{
+ public:
+  explicit QuantizedDense (const Dense &layer);
+  Matrix operator() (const Matrix &mat) const;
+  void forward (const Matrix &mat, Matrix &output) const;
+
+ private:
+  int _rows;
+  int _cols;
+  // _cols padded for the kernels, the length of a row of _weights
+  int _depth;
+  std::vector<int8_t> _weights;
+  std::vector<float> _scales;
+  std::vector<int32_t> _row_sums;
+  Matrix _bias;
+  activation_func _activation_func;
+  activation_in_place_func _activation_in_place;
+};
+
+#endif //QUANTIZEDDENSE_H
@@ -0,0 +1,194 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// set on a thread while it runs chunks of a loop, a loop inside a loop
+// runs serially instead of waiting for threads that are all busy
+static thread_local bool in_loop = false;
+
+/**
+ * the pool of the process, created on first use with a thread for every
+ * core, the calling thread being one of them
+ * @return a reference to the pool
+ */
+ThreadPool &ThreadPool::instance ()
+{
+  static ThreadPool pool (
+      (int) std::max (1u, std::thread::hardware_concurrency ()));
+  return pool;
+}
+
+/**
+ * constructor, starts threads - 1 workers: the thread that runs a loop
+ * works on it too
+ * @param threads - number of threads that run a loop
+ */
+ThreadPool::ThreadPool (int threads)
+    : _loop (nullptr), _generation (0), _busy (0), _stop (false)
+{
+  start (std::max (threads, 1) - 1);
+}
+
+/**
+ * destructor, stops and joins the workers
+ */
+ThreadPool::~ThreadPool ()
+{
+  stop ();
+}
+
+/**
+ * @return number of threads that run a loop, the caller included
+ */
+int ThreadPool::threads () const
+{
+  return (int) _workers.size () + 1;
+}
+
+/**
+ * replace the workers, to compare the kernels on different numbers of
+ * threads. not thread-safe, call it while no loop runs
+ * @param threads - number of threads that run a loop, 1 runs serially
+ */
+void ThreadPool::set_threads (int threads)
+{
+  stop ();
+  start (std::max (threads, 1) - 1);
+}
+
+/**
+ * runs a loop, see parallel_for
+ * @param chunk - runs body on a chunk
+ * @param body - the body of the loop
+ */
+void ThreadPool::run (int begin, int end, int grain, chunk_func chunk,
+                      const void *body)
+{
+  if (end <= begin)
+  {
+    return;
+  }
+  grain = std::max (grain, 1);
+  std::unique_lock<std::mutex> caller (_caller, std::defer_lock);
+  if (_workers.empty () || in_loop || end - begin <= grain
+      || !caller.try_lock ())
+  {
+    chunk (body, begin, end);
+    return;
+  }
+  loop job;
+  job.run = chunk;
+  job.body = body;
+  job.end = end;
+  job.grain = grain;
+  job.next.store (begin);
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _loop = &job;
+    _generation++;
+  }
+  _start.notify_all ();
+  work (job);
+  {
+    // workers that didn't wake up yet won't join a loop that is done
+    std::unique_lock<std::mutex> lock (_mutex);
+    _loop = nullptr;
+    _done.wait (lock, [this]
+    { return _busy == 0; });
+  }
+  if (job.error)
+  {
+    std::rethrow_exception (job.error);
+  }
+}
+
+/**
+ * claims chunks of a loop and runs them until none are left. a chunk that
+ * throws ends the loop, its exception is kept for the caller
+ * @param job - the loop
+ */
+void ThreadPool::work (loop &job)
+{
+  in_loop = true;
+  for (;;)
+  {
+    int first = job.next.fetch_add (job.grain);
+    if (first >= job.end)
+    {
+      break;
+    }
+    int last = (int) std::min ((long) first + job.grain, (long) job.end);
+    try
+    {
+      job.run (job.body, first, last);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock (_mutex);
+      if (!job.error)
+      {
+        job.error = std::current_exception ();
+      }
+      job.next.store (job.end);
+    }
+  }
+  in_loop = false;
+}
+
+/**
+ * the loop of a worker: waits for a new loop, works on it, and tells the
+ * caller when it is out of it
+ */
+void ThreadPool::worker ()
+{
+  std::unique_lock<std::mutex> lock (_mutex);
+  unsigned long seen = _generation;
+  for (;;)
+  {
+    _start.wait (lock, [this, &seen]
+    { return _stop || (_loop != nullptr && _generation != seen); });
+    if (_stop)
+    {
+      return;
+    }
+    seen = _generation;
+    loop &job = *_loop;
+    _busy++;
+    lock.unlock ();
+    work (job);
+    lock.lock ();
+    if (--_busy == 0)
+    {
+      _done.notify_all ();
+    }
+  }
+}
+
+/**
+ * starts workers
+ * @param workers - number of workers
+ */
+void ThreadPool::start (int workers)
+{
+  _stop = false;
+  for (int i = 0; i < workers; i++)
+  {
+    _workers.emplace_back (&ThreadPool::worker, this);
+  }
+}
+
+/**
+ * stops and joins all the workers
+ */
+void ThreadPool::stop ()
+{
+  {
+    std::lock_guard<std::mutex> lock (_mutex);
+    _stop = true;
+  }
+  _start.notify_all ();
+  for (std::thread &worker : _workers)
+  {
+    worker.join ();
+  }
+  _workers.clear ();
+}
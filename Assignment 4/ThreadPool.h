@@ -0,0 +1,95 @@
+// ThreadPool.h
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * a pool of worker threads shared by the whole process, that runs the
+ * parallel loops of the matrix kernels. a loop is cut into chunks of rows,
+ * the calling thread and all the workers claim chunks from a shared
+ * counter until none are left, so a thread that finishes early takes the
+ * work that the slow ones didn't get to.
+ * a loop that is started inside a loop, or while another thread runs one,
+ * runs serially on its thread.
+ * All methods description are in ThreadPool.cpp
+ */
+class ThreadPool
+{
+ public:
+  // the pool of the process, with a thread for every core
+  static ThreadPool &instance ();
+
+  explicit ThreadPool (int threads);
+  ThreadPool (const ThreadPool &) = delete;
+  ThreadPool &operator= (const ThreadPool &) = delete;
+  ~ThreadPool ();
+
+  int threads () const;
+  void set_threads (int threads);
+
+  // calls body (first, last) on chunks of [begin, end) of at most grain
+  template<class Body>
+  void parallel_for (int begin, int end, int grain, const Body &body);
+
+ private:
+  /**
+   * a chunk body without its type, so a loop allocates nothing
+   */
+  typedef void (*chunk_func) (const void *body, int first, int last);
+
+  /**
+   * a running loop
+   */
+  struct loop
+  {
+    chunk_func run;
+    const void *body;
+    int end;
+    int grain;
+    std::atomic<int> next;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::mutex _caller;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  loop *_loop;
+  unsigned long _generation;
+  int _busy;
+  bool _stop;
+
+  void run (int begin, int end, int grain, chunk_func run, const void *body);
+  void work (loop &job);
+  void worker ();
+  void start (int workers);
+  void stop ();
+};
+
+/**
+ * calls body (first, last) on chunks of [begin, end) of at most grain,
+ * spread over the threads of the pool. returns when all the chunks are
+ * done, an exception of a chunk is thrown again here
+ * @param begin - first index of the loop
+ * @param end - the index after the last one
+ * @param grain - size of a chunk
+ * @param body - callable with (int first, int last)
+ */
+template<class Body>
+void ThreadPool::parallel_for (int begin, int end, int grain,
+                               const Body &body)
+{
+  run (begin, end, grain, [] (const void *loop_body, int first, int last)
+  {
+    (*static_cast<const Body *> (loop_body)) (first, last);
+  }, &body);
+}
+
+#endif //THREADPOOL_H
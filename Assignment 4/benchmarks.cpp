@@ -0,0 +1,573 @@
+#include "MlpNetwork.h"
+#include "MatrixExpression.h"
+#include "Activation.h"
+#include "MatrixView.h"
+#include "Gemm.h"
+#include "QGemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+#define BENCH_ROUNDS 5
+// work of one timed round, in floating point operations
+#define GEMM_ROUND_FLOPS 2e8
+#define BENCH_IMAGES 4096
+// elements visited in one timed round of an elementwise benchmark
+#define ELEMENT_ROUND_ELEMENTS 5e7
+#define TRANSPOSE_ROUND_ELEMENTS 2e7
+#define PRODUCT_REPEATS 20
+#define MAX_BENCH_THREADS 8
+
+/**
+ * seconds since an arbitrary point, to time a benchmark
+ * @return the seconds
+ */
+static double now ()
+{
+  return std::chrono::duration<double> (
+      std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/**
+ * a matrix of uniform random elements in [-1, 1]
+ * @param rows - rows of the matrix
+ * @param cols - columns of the matrix
+ * @param seed - seed of the elements
+ * @return the matrix
+ */
+static Matrix random_matrix (int rows, int cols, unsigned seed)
+{
+  std::mt19937 generator (seed);
+  std::uniform_real_distribution<float> uniform (-1, 1);
+  Matrix mat (rows, cols);
+  for (int i = 0; i < rows * cols; i++)
+  {
+    mat.unchecked (i) = uniform (generator);
+  }
+  return mat;
+}
+
+/**
+ * weights and biases of the weights_dims shapes, scaled like a trained
+ * network so the activations stay in range
+ * @param weights - gets MLP_SIZE weight matrices
+ * @param biases - gets MLP_SIZE bias vectors
+ */
+static void random_layers (Matrix weights[], Matrix biases[])
+{
+  for (int l = 0; l < MLP_SIZE; l++)
+  {
+    weights[l] = random_matrix (weights_dims[l].rows, weights_dims[l].cols,
+                                2 * l + 1)
+                 * (1 / std::sqrt ((float) weights_dims[l].cols));
+    biases[l] = random_matrix (bias_dims[l].rows, bias_dims[l].cols, 2 * l + 2)
+                * TENTH;
+  }
+}
+
+/**
+ * images of random pixels in [0, 1]
+ * @param n - number of images
+ * @return n images of img_dims
+ */
+static std::vector<Matrix> random_images (int n)
+{
+  std::vector<Matrix> images;
+  images.reserve (n);
+  for (int i = 0; i < n; i++)
+  {
+    Matrix image = random_matrix (img_dims.rows, img_dims.cols, 1000 + i);
+    for (int p = 0; p < img_dims.rows * img_dims.cols; p++)
+    {
+      image.unchecked (p) = (image.unchecked (p) + 1) / 2;
+    }
+    images.push_back (image);
+  }
+  return images;
+}
+
+/**
+ * the fastest of BENCH_ROUNDS rounds of an operation
+ * @param repeats - calls of the operation in a round
+ * @param operation - the operation
+ * @return seconds of one call in the fastest round
+ */
+template<class Operation>
+static double best_seconds (int repeats, const Operation &operation)
+{
+  double best = 0;
+  for (int round = 0; round < BENCH_ROUNDS; round++)
+  {
+    double start = now ();
+    for (int i = 0; i < repeats; i++)
+    {
+      operation ();
+    }
+    double seconds = (now () - start) / repeats;
+    best = round == 0 ? seconds : std::min (best, seconds);
+  }
+  return best;
+}
+
+/**
+ * GFLOP/s of Matrix::operator* for the layer shapes of weights_dims, on
+ * one image (n = 1) and on 64 of them, and for large squares, with every
+ * instruction set of the gemm kernels the cpu supports. the time includes
+ * allocating the result
+ */
+static void bench_gemm ()
+{
+  const int shapes[][3] = {{128, 784, 1}, {64, 128, 1}, {20, 64, 1},
+                           {10, 20, 1}, {128, 784, 64}, {64, 128, 64},
+                           {256, 256, 256}, {512, 512, 512},
+                           {1024, 1024, 1024}};
+  gemm::isa best = gemm::best_isa ();
+  for (int kernel = (int) gemm::isa::scalar; kernel <= (int) best; kernel++)
+  {
+    gemm::use_isa ((gemm::isa) kernel);
+    for (const int *shape : shapes)
+    {
+      int m = shape[0], k = shape[1], n = shape[2];
+      Matrix a = random_matrix (m, k, 1), b = random_matrix (k, n, 2);
+      double flops = 2.0 * m * n * k;
+      float sum = 0;
+      double seconds = best_seconds (
+          std::max (1, (int) (GEMM_ROUND_FLOPS / flops)), [&] ()
+          {
+            Matrix c = a * b;
+            sum += c.unchecked (0);
+          });
+      std::printf ("%-7s %4dx%4dx%-4d %7.1f GFLOP/s (%d)\n",
+                   gemm::isa_name ((gemm::isa) kernel), m, k, n,
+                   flops / seconds / 1e9, sum > 0);
+    }
+  }
+  gemm::use_isa (best);
+}
+
+/**
+ * images per second of MlpNetwork: one image per operator() call, batches
+ * of 1 to 1024 columns through classify_batch, and a vector of images
+ * through operator(), which gathers them into batches of MLP_BATCH_SIZE
+ */
+static void bench_batch ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  MlpNetwork network (weights, biases);
+  std::vector<Matrix> images = random_images (BENCH_IMAGES);
+  long sum = 0;
+  double seconds = best_seconds (1, [&] ()
+  {
+    for (const Matrix &image : images)
+    {
+      Matrix vector (image);
+      sum += network (vector.vectorize ()).value;
+    }
+  });
+  std::printf ("single      %8.0f img/s\n", BENCH_IMAGES / seconds);
+  for (int n = 1; n <= 1024; n *= 2)
+  {
+    int image_size = img_dims.rows * img_dims.cols;
+    Matrix batch (image_size, n);
+    for (int j = 0; j < n; j++)
+    {
+      for (int i = 0; i < image_size; i++)
+      {
+        batch.unchecked (i, j) = images[j].unchecked (i);
+      }
+    }
+    seconds = best_seconds (std::max (1, BENCH_IMAGES / n), [&] ()
+    {
+      sum += network.classify_batch (batch)[0].value;
+    });
+    std::printf ("batch %-5d %8.0f img/s\n", n, n / seconds);
+  }
+  seconds = best_seconds (1, [&] ()
+  {
+    sum += network (images)[0].value;
+  });
+  std::printf ("vector      %8.0f img/s (%ld)\n", BENCH_IMAGES / seconds,
+               sum % 10);
+}
+
+/**
+ * float against 8 bit MlpNetwork: images per second one image at a time
+ * and in batches of MLP_BATCH_SIZE columns, the 8 bit layers with every
+ * instruction set of the qgemm kernels the cpu supports, and how many
+ * images the 8 bit network gives the digit of the float one
+ */
+static void bench_quantized ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  MlpNetwork network (weights, biases);
+  std::vector<Matrix> images = random_images (BENCH_IMAGES);
+  int image_size = img_dims.rows * img_dims.cols;
+  Matrix batch (image_size, MLP_BATCH_SIZE);
+  for (int j = 0; j < MLP_BATCH_SIZE; j++)
+  {
+    for (int i = 0; i < image_size; i++)
+    {
+      batch.unchecked (i, j) = images[j].unchecked (i);
+    }
+  }
+  long sum = 0;
+  auto measure = [&] (const char *name)
+  {
+    double single = best_seconds (1, [&] ()
+    {
+      for (const Matrix &image : images)
+      {
+        Matrix vector (image);
+        sum += network (vector.vectorize ()).value;
+      }
+    });
+    double batched = best_seconds (BENCH_IMAGES / MLP_BATCH_SIZE, [&] ()
+    {
+      sum += network.classify_batch (batch)[0].value;
+    });
+    std::printf ("%-11s single %8.0f img/s, batch %8.0f img/s\n", name,
+                 BENCH_IMAGES / single, MLP_BATCH_SIZE / batched);
+  };
+  measure ("float");
+  std::vector<digit> floats = network (images);
+  network.set_quantized (true);
+  qgemm::isa best = qgemm::best_isa ();
+  for (int kernel = (int) qgemm::isa::scalar; kernel <= (int) best; kernel++)
+  {
+    if (qgemm::use_isa ((qgemm::isa) kernel) == (qgemm::isa) kernel)
+    {
+      measure (qgemm::isa_name ((qgemm::isa) kernel));
+    }
+  }
+  qgemm::use_isa (best);
+  std::vector<digit> quantized = network (images);
+  int same = 0;
+  for (int n = 0; n < BENCH_IMAGES; n++)
+  {
+    same += quantized[n].value == floats[n].value;
+  }
+  std::printf ("same digit  %.2f%% of the images (%ld)\n",
+               100.0 * same / BENCH_IMAGES, sum % 10);
+}
+
+/**
+ * the layer shapes of weights_dims, for the elementwise benchmarks
+ */
+static const int layer_shapes[][2] = {{128, 784}, {64, 128}, {20, 64},
+                                      {10, 20}};
+
+/**
+ * repeats of an elementwise operation in one timed round
+ * @param rows - rows of the operands
+ * @param cols - columns of the operands
+ * @return the repeats
+ */
+static int element_repeats (int rows, int cols)
+{
+  return std::max (1, (int) (ELEMENT_ROUND_ELEMENTS / rows / cols));
+}
+
+/**
+ * ns per expression of a * s + b and a.dot (b) + c assigned to a matrix,
+ * with the eager operators (a temporary per operator, moved) and with the
+ * lazy ones of MatrixExpression.h (one loop, no temporary)
+ */
+static void bench_lazy ()
+{
+  for (const int *shape : layer_shapes)
+  {
+    int rows = shape[0], cols = shape[1];
+    int repeats = element_repeats (rows, cols);
+    Matrix a = random_matrix (rows, cols, 1), b = random_matrix (rows, cols, 2);
+    Matrix c = random_matrix (rows, cols, 3), out (rows, cols);
+    double eager_scale = best_seconds (repeats, [&] ()
+    {
+      out = a * 0.5f + b;
+    });
+    double lazy_scale = best_seconds (repeats, [&] ()
+    {
+      out = lazy::of (a) * 0.5f + b;
+    });
+    double eager_dot = best_seconds (repeats, [&] ()
+    {
+      out = a.dot (b) + c;
+    });
+    double lazy_dot = best_seconds (repeats, [&] ()
+    {
+      out = lazy::dot (a, b) + c;
+    });
+    std::printf ("%4dx%-4d a*s+b      %9.0f eager %9.0f lazy ns\n", rows, cols,
+                 eager_scale * 1e9, lazy_scale * 1e9);
+    std::printf ("%9s a.dot(b)+c %9.0f eager %9.0f lazy ns (%d)\n", "",
+                 eager_dot * 1e9, lazy_dot * 1e9, out.unchecked (0) > 0);
+  }
+}
+
+/**
+ * ns per elementwise operator of Matrix and per activation, on the
+ * weights_dims shapes. the results are assigned to a matrix of the same
+ * shape, so only the operators that return a new matrix allocate
+ */
+static void bench_elementwise ()
+{
+  for (const int *shape : layer_shapes)
+  {
+    int rows = shape[0], cols = shape[1];
+    int repeats = element_repeats (rows, cols);
+    Matrix a = random_matrix (rows, cols, 1), b = random_matrix (rows, cols, 2);
+    Matrix out (rows, cols);
+    float norm = 0;
+    std::printf ("%dx%d\n", rows, cols);
+    std::printf ("  a + b      %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out = a + b;
+    }));
+    std::printf ("  a * s      %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out = a * 0.5f;
+    }));
+    std::printf ("  a.dot (b)  %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out = a.dot (b);
+    }));
+    std::printf ("  out += b   %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out += b;
+    }));
+    std::printf ("  out = b    %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out = b;
+    }));
+    std::printf ("  norm       %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      norm += a.norm ();
+    }));
+    std::printf ("  relu       %9.0f ns\n", 1e9 * best_seconds (repeats, [&] ()
+    {
+      out = activation::relu (a);
+    }));
+    std::printf ("  softmax    %9.0f ns (%d)\n",
+                 1e9 * best_seconds (repeats, [&] ()
+                 {
+                   out = activation::softmax (a);
+                 }), norm > 0);
+  }
+}
+
+/**
+ * the transpose of a matrix through the checked index operators, the way
+ * Matrix::transpose used to be done
+ * @param mat - the matrix
+ * @return the transpose
+ */
+static Matrix naive_transpose (const Matrix &mat)
+{
+  Matrix transposed (mat.get_cols (), mat.get_rows ());
+  for (int i = 0; i < mat.get_rows (); i++)
+  {
+    for (int j = 0; j < mat.get_cols (); j++)
+    {
+      transposed (j, i) = mat (i, j);
+    }
+  }
+  return transposed;
+}
+
+/**
+ * ns per in place transpose, per out of place transposed () and per naive
+ * copy, on square and non-square matrices, then a Dense-sized product
+ * with a transposed operand: copied first or read through transposed_view
+ */
+static void bench_transpose ()
+{
+  const int shapes[][2] = {{28, 28}, {128, 784}, {784, 128}, {1000, 1000},
+                           {1024, 1024}, {500, 2000}};
+  for (const int *shape : shapes)
+  {
+    int rows = shape[0], cols = shape[1];
+    int repeats = std::max (1, (int) (TRANSPOSE_ROUND_ELEMENTS / rows / cols));
+    Matrix mat = random_matrix (rows, cols, 1);
+    float sum = 0;
+    double in_place = best_seconds (repeats, [&] ()
+    {
+      mat.transpose ();
+    });
+    double out_of_place = best_seconds (repeats, [&] ()
+    {
+      sum += mat.transposed ().unchecked (1);
+    });
+    double naive = best_seconds (repeats, [&] ()
+    {
+      sum += naive_transpose (mat).unchecked (1);
+    });
+    std::printf ("%4dx%-4d transpose %9.0f  transposed %9.0f  naive %9.0f "
+                 "ns (%d)\n", rows, cols, in_place * 1e9, out_of_place * 1e9,
+                 naive * 1e9, sum > 0);
+  }
+  Matrix w = random_matrix (128, 784, 1), x = random_matrix (784, 128, 2);
+  Matrix xt = x.transposed ();
+  float sum = 0;
+  double plain = best_seconds (PRODUCT_REPEATS, [&] ()
+  {
+    sum += (w * x).unchecked (0);
+  });
+  double copied = best_seconds (PRODUCT_REPEATS, [&] ()
+  {
+    sum += (w * xt.transposed ()).unchecked (0);
+  });
+  double viewed = best_seconds (PRODUCT_REPEATS, [&] ()
+  {
+    sum += (w * xt.transposed_view ()).unchecked (0);
+  });
+  std::printf ("128x784 * 784x128: w * x %.0f  w * xt.transposed () %.0f  "
+               "w * xt.transposed_view () %.0f ns (%d)\n", plain * 1e9,
+               copied * 1e9, viewed * 1e9, sum > 0);
+}
+
+/**
+ * ns per product, sum and dot of the parallel kernels on 1, 2, 4 and 8
+ * threads of the pool: the 10x20 layer, which stays serial at any count,
+ * a batch of 128 through the first layer and a large square. the times
+ * only scale up to the number of cores, which is printed first
+ */
+static void bench_threads ()
+{
+  const int shapes[][3] = {{10, 20, 1}, {128, 784, 128}, {1024, 1024, 1024}};
+  ThreadPool &pool = ThreadPool::instance ();
+  int threads = pool.threads ();
+  std::printf ("%u cores\n", std::thread::hardware_concurrency ());
+  for (int t = 1; t <= MAX_BENCH_THREADS; t *= 2)
+  {
+    pool.set_threads (t);
+    for (const int *shape : shapes)
+    {
+      int m = shape[0], k = shape[1], n = shape[2];
+      Matrix a = random_matrix (m, k, 1), b = random_matrix (k, n, 2);
+      Matrix c = random_matrix (m, k, 3), out (m, k);
+      int repeats = element_repeats (m, k);
+      float sum = 0;
+      double product = best_seconds (
+          std::max (1, (int) (GEMM_ROUND_FLOPS / (2.0 * m * n * k))), [&] ()
+          {
+            sum += (a * b).unchecked (0);
+          });
+      double add = best_seconds (repeats, [&] ()
+      {
+        out = a + c;
+      });
+      double dot = best_seconds (repeats, [&] ()
+      {
+        out = a.dot (c);
+      });
+      std::printf ("threads %d %4dx%4dx%-4d a*b %11.0f  a+b %9.0f  "
+                   "a.dot(b) %9.0f ns (%d)\n", t, m, k, n, product * 1e9,
+                   add * 1e9, dot * 1e9, sum > 0);
+    }
+  }
+  pool.set_threads (threads);
+}
+
+/**
+ * latency of the Dense layers of the network, relu for the hidden layers
+ * and softmax for the last one: forward on one vector, the fused kernel,
+ * against activation (weights * vector + bias) as separate operators, and
+ * forward per column of a batch of MLP_BATCH_SIZE
+ */
+static void bench_layers ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  for (int l = 0; l < MLP_SIZE; l++)
+  {
+    int rows = weights_dims[l].rows, cols = weights_dims[l].cols;
+    activation_func function = l + 1 < MLP_SIZE ? activation::relu
+                                                : activation::softmax;
+    Dense layer (weights[l], biases[l], function);
+    Matrix vector = random_matrix (cols, 1, 3), output (rows, 1);
+    Matrix batch = random_matrix (cols, MLP_BATCH_SIZE, 4);
+    Matrix batch_output (rows, MLP_BATCH_SIZE);
+    int repeats = std::max (1, (int) (GEMM_ROUND_FLOPS
+                                      / (2.0 * rows * cols)));
+    double fused = best_seconds (repeats, [&] ()
+    {
+      layer.forward (vector, output);
+    });
+    double separate = best_seconds (repeats, [&] ()
+    {
+      output = function (weights[l] * vector + biases[l]);
+    });
+    int batches = std::max (1, repeats / MLP_BATCH_SIZE);
+    double batched = best_seconds (batches, [&] ()
+    {
+      layer.forward (batch, batch_output);
+    });
+    std::printf ("%4dx%-4d %-7s %8.0f fused %8.0f separate %8.0f batch ns"
+                 " (%d)\n", rows, cols, l + 1 < MLP_SIZE ? "relu" : "softmax",
+                 fused * 1e9, separate * 1e9, batched / MLP_BATCH_SIZE * 1e9,
+                 output.unchecked (0) >= 0);
+  }
+}
+
+/**
+ * a benchmark and its name
+ */
+struct named_benchmark
+{
+  const char *name;
+  void (*run) ();
+};
+
+static const named_benchmark benchmarks[] = {
+    {"gemm", bench_gemm},
+    {"batch", bench_batch},
+    {"quantized", bench_quantized},
+    {"lazy", bench_lazy},
+    {"elementwise", bench_elementwise},
+    {"transpose", bench_transpose},
+    {"threads", bench_threads},
+    {"layers", bench_layers},
+};
+
+/**
+ * runs the benchmarks named in the arguments, all of them without arguments
+ * @return EXIT_FAILURE if a name isn't a benchmark
+ * @return EXIT_SUCCESS otherwise
+ */
+int main (int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    bool found = false;
+    for (const named_benchmark &benchmark : benchmarks)
+    {
+      found = found || std::strcmp (argv[i], benchmark.name) == 0;
+    }
+    if (!found)
+    {
+      std::fprintf (stderr, "Unknown benchmark: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  for (const named_benchmark &benchmark : benchmarks)
+  {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; i++)
+    {
+      selected = selected || std::strcmp (argv[i], benchmark.name) == 0;
+    }
+    if (selected)
+    {
+      std::printf ("== %s\n", benchmark.name);
+      benchmark.run ();
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,705 @@
+#include "MlpNetwork.h"
+#include "MatrixExpression.h"
+#include "MatrixView.h"
+#include "Activation.h"
+#include "Gemm.h"
+#include "QGemm.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#define GEMM_SHAPES 400
+#define GEMM_PADDING 123.0f
+#define GEMM_TOLERANCE 1e-3
+#define QGEMM_SHAPES 200
+#define QGEMM_PADDING 12345
+#define TEST_IMAGES 300
+#define PROBABILITY_TOLERANCE 1e-4
+#define STEADY_INFERENCES 1000
+#define LAZY_ROWS 7
+#define LAZY_COLS 9
+#define LAZY_TOLERANCE 1e-5
+#define VIEW_ROWS 5
+#define VIEW_COLS 6
+#define RELU_MAX_COLS 9
+#define PRODUCT_TOLERANCE 1e-4
+#define POOL_MAX_THREADS 8
+#define POOL_LOOP_END 100
+#define DENSE_BATCH 3
+#define SOFTMAX_STEP 100.0f
+
+static std::atomic<long> allocations{0};
+
+/**
+ * counting replacements of the global operator new and new[], the tests
+ * read allocations before and after an operation. the counter is atomic
+ * since the thread pool may allocate from its threads. the replacements
+ * are never inlined, so g++ doesn't pair the malloc of one with the free
+ * of the other (-Wmismatched-new-delete)
+ */
+__attribute__ ((noinline)) void *operator new (size_t size)
+{
+  allocations++;
+  void *memory = std::malloc (size ? size : 1);
+  if (memory == nullptr)
+  {
+    throw std::bad_alloc ();
+  }
+  return memory;
+}
+
+__attribute__ ((noinline)) void *operator new[] (size_t size)
+{
+  return operator new (size);
+}
+
+__attribute__ ((noinline)) void operator delete (void *memory) noexcept
+{
+  std::free (memory);
+}
+
+__attribute__ ((noinline)) void operator delete (void *memory,
+                                                  size_t) noexcept
+{
+  std::free (memory);
+}
+
+__attribute__ ((noinline)) void operator delete[] (void *memory) noexcept
+{
+  std::free (memory);
+}
+
+__attribute__ ((noinline)) void operator delete[] (void *memory,
+                                                    size_t) noexcept
+{
+  std::free (memory);
+}
+
+/**
+ * the product of two row-major matrices in double precision
+ * @param c - gets the m x n product, with a leading dimension of n
+ */
+static void reference_multiply (int m, int n, int k, const float *a, int lda,
+                                const float *b, int ldb, double *c)
+{
+  for (int i = 0; i < m; i++)
+  {
+    for (int j = 0; j < n; j++)
+    {
+      double sum = 0;
+      for (int p = 0; p < k; p++)
+      {
+        sum += (double) a[(size_t) i * lda + p] * b[(size_t) p * ldb + j];
+      }
+      c[(size_t) i * n + j] = sum;
+    }
+  }
+}
+
+/**
+ * a matrix of uniform random elements in [low, high]
+ * @param seed - seed of the elements
+ * @return the matrix
+ */
+static Matrix random_matrix (int rows, int cols, unsigned seed, float low,
+                             float high)
+{
+  std::mt19937 generator (seed);
+  std::uniform_real_distribution<float> uniform (low, high);
+  Matrix mat (rows, cols);
+  for (int i = 0; i < rows * cols; i++)
+  {
+    mat.unchecked (i) = uniform (generator);
+  }
+  return mat;
+}
+
+/**
+ * weights and biases of the weights_dims shapes, scaled like a trained
+ * network so the activations stay in range
+ * @param weights - gets MLP_SIZE weight matrices
+ * @param biases - gets MLP_SIZE bias vectors
+ */
+static void random_layers (Matrix weights[], Matrix biases[])
+{
+  for (int l = 0; l < MLP_SIZE; l++)
+  {
+    float scale = 1 / std::sqrt ((float) weights_dims[l].cols);
+    weights[l] = random_matrix (weights_dims[l].rows, weights_dims[l].cols,
+                                2 * l + 1, -scale, scale);
+    biases[l] = random_matrix (bias_dims[l].rows, bias_dims[l].cols,
+                               2 * l + 2, -TENTH, TENTH);
+  }
+}
+
+/**
+ * Tests every instruction set of gemm::multiply against a double
+ * precision product on random shapes with padded leading dimensions: one
+ * column, edge tiles and depths past a block, and that the padding of the
+ * result is left alone.
+ * @return 0 upon success.
+ */
+int test_gemm_kernels ()
+{
+  std::mt19937 generator (3);
+  std::uniform_real_distribution<float> uniform (-1, 1);
+  gemm::isa best = gemm::best_isa ();
+  int failed = 0;
+  for (int kernel = (int) gemm::isa::scalar; kernel <= (int) best; kernel++)
+  {
+    gemm::use_isa ((gemm::isa) kernel);
+    for (int t = 0; t < GEMM_SHAPES && !failed; t++)
+    {
+      bool small = t < GEMM_SHAPES / 2;
+      int m = 1 + (int) (generator () % (small ? 20 : 300));
+      int n = t % 7 == 0 ? 1 : 1 + (int) (generator () % (small ? 40 : 300));
+      int k = 1 + (int) (generator () % (small ? 30 : 600));
+      int lda = k + (int) (generator () % 3);
+      int ldb = n + (int) (generator () % 3);
+      int ldc = n + (int) (generator () % 3);
+      std::vector<float> a ((size_t) m * lda), b ((size_t) k * ldb);
+      std::vector<float> c ((size_t) m * ldc, GEMM_PADDING);
+      std::vector<double> expected ((size_t) m * n);
+      for (float &x : a)
+      {
+        x = uniform (generator);
+      }
+      for (float &x : b)
+      {
+        x = uniform (generator);
+      }
+      reference_multiply (m, n, k, a.data (), lda, b.data (), ldb,
+                          expected.data ());
+      gemm::multiply (m, n, k, a.data (), lda, b.data (), ldb, c.data (),
+                      ldc);
+      for (int i = 0; i < m; i++)
+      {
+        for (int j = 0; j < ldc; j++)
+        {
+          float value = c[(size_t) i * ldc + j];
+          failed |= j < n ? std::fabs (value - expected[(size_t) i * n + j])
+                            > GEMM_TOLERANCE * std::sqrt (k)
+                          : value != GEMM_PADDING;
+        }
+      }
+    }
+  }
+  gemm::use_isa (best);
+  return failed;
+}
+
+/**
+ * Tests every instruction set of qgemm::multiply against an exact integer
+ * product on random shapes: tiles of columns with a leftover column and
+ * rows past the last tile, and that the padding of the result is left
+ * alone.
+ * @return 0 upon success.
+ */
+int test_qgemm_kernels ()
+{
+  std::mt19937 generator (4);
+  qgemm::isa best = qgemm::best_isa ();
+  int failed = 0;
+  for (int kernel = (int) qgemm::isa::scalar; kernel <= (int) best; kernel++)
+  {
+    qgemm::use_isa ((qgemm::isa) kernel);
+    for (int t = 0; t < QGEMM_SHAPES && !failed; t++)
+    {
+      int m = 1 + (int) (generator () % 150);
+      int n = 1 + (int) (generator () % (t % 2 ? 9 : 70));
+      int k = qgemm::padded_depth (1 + (int) (generator () % 800));
+      int ldy = n + (int) (generator () % 3);
+      std::vector<int8_t> w ((size_t) m * k);
+      std::vector<uint8_t> x ((size_t) n * k);
+      std::vector<int32_t> y ((size_t) m * ldy, QGEMM_PADDING);
+      for (int8_t &value : w)
+      {
+        value = (int8_t) ((int) (generator () % (2 * QGEMM_MAX_WEIGHT + 1))
+                          - QGEMM_MAX_WEIGHT);
+      }
+      for (uint8_t &value : x)
+      {
+        value = (uint8_t) (generator () % (QGEMM_MAX_ACTIVATION + 1));
+      }
+      qgemm::multiply (m, n, k, w.data (), k, x.data (), k, y.data (), ldy);
+      for (int i = 0; i < m; i++)
+      {
+        for (int j = 0; j < ldy; j++)
+        {
+          long expected = 0;
+          for (int p = 0; p < k && j < n; p++)
+          {
+            expected += (long) w[(size_t) i * k + p] * x[(size_t) j * k + p];
+          }
+          failed |= y[(size_t) i * ldy + j] != (j < n ? expected
+                                                      : QGEMM_PADDING);
+        }
+      }
+    }
+  }
+  qgemm::use_isa (best);
+  return failed;
+}
+
+/**
+ * Tests that classify_batch and the vector operator() of MlpNetwork give
+ * every image the digit and probability of a single image operator(), with
+ * the float layers and with the 8 bit ones.
+ * @return 0 upon success.
+ */
+int test_batch_matches_single ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  MlpNetwork network (weights, biases);
+  int image_size = img_dims.rows * img_dims.cols;
+  std::vector<Matrix> images;
+  for (int n = 0; n < TEST_IMAGES; n++)
+  {
+    images.push_back (random_matrix (img_dims.rows, img_dims.cols, 100 + n,
+                                     0, 1));
+  }
+  int failed = 0;
+  // the 8 bit layers quantize a batch with vector instructions and a
+  // single image without them
+  for (bool quantized : {false, true})
+  {
+    network.set_quantized (quantized);
+    std::vector<digit> all = network (images);
+    failed |= all.size () != images.size ();
+    for (int first = 0; first < TEST_IMAGES && !failed; first += first + 1)
+    {
+      // batches of 1, 2, 4, ... columns
+      int n = std::min (first + 1, TEST_IMAGES - first);
+      Matrix batch (image_size, n);
+      for (int j = 0; j < n; j++)
+      {
+        for (int i = 0; i < image_size; i++)
+        {
+          batch.unchecked (i, j) = images[first + j].unchecked (i);
+        }
+      }
+      std::vector<digit> batched = network.classify_batch (batch);
+      for (int j = 0; j < n; j++)
+      {
+        Matrix vector (images[first + j]);
+        digit single = network (vector.vectorize ());
+        for (const digit &other : {batched[j], all[first + j]})
+        {
+          failed |= other.value != single.value
+                    || std::fabs (other.probability - single.probability)
+                       > PROBABILITY_TOLERANCE;
+        }
+      }
+    }
+  }
+  return failed;
+}
+
+/**
+ * Tests that classifying single images allocates nothing once the network
+ * is built and has classified an image, with the float layers and with the
+ * 8 bit ones.
+ * @return 0 upon success.
+ */
+int test_steady_inference_allocates_nothing ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  MlpNetwork network (weights, biases);
+  std::vector<Matrix> images;
+  for (int n = 0; n < TEST_IMAGES; n++)
+  {
+    images.push_back (random_matrix (img_dims.rows * img_dims.cols, 1,
+                                     100 + n, 0, 1));
+  }
+  int failed = 0;
+  for (bool quantized : {false, true})
+  {
+    network.set_quantized (quantized);
+    unsigned sum = network (images[0]).value;
+    long before = allocations;
+    for (int n = 0; n < STEADY_INFERENCES; n++)
+    {
+      sum += network (images[n % TEST_IMAGES]).value;
+    }
+    failed |= allocations != before || sum == 0;
+  }
+  return failed;
+}
+
+/**
+ * Tests that the lazy expressions of MatrixExpression.h give the elements
+ * of the eager operators, also when the result is an operand of the
+ * expression, and that they throw on mismatched shapes like them.
+ * @return 0 upon success.
+ */
+int test_lazy_matches_eager ()
+{
+  Matrix a = random_matrix (LAZY_ROWS, LAZY_COLS, 1, -1, 1);
+  Matrix b = random_matrix (LAZY_ROWS, LAZY_COLS, 2, -1, 1);
+  Matrix c = random_matrix (LAZY_ROWS, LAZY_COLS, 3, -1, 1);
+  Matrix eager_scale = a * 1.5f + b, lazy_scale = lazy::of (a) * 1.5f + b;
+  Matrix eager_dot = a.dot (b) + c, lazy_dot = lazy::dot (a, b) + c;
+  Matrix eager_mixed = 2.0f * (a + b) + c.dot (a);
+  Matrix lazy_mixed = 2.0f * (lazy::of (a) + b) + lazy::dot (c, a);
+  c = lazy::dot (a, b) + c;
+  int failed = 0;
+  for (int i = 0; i < LAZY_ROWS * LAZY_COLS; i++)
+  {
+    failed |= eager_scale[i] != lazy_scale[i] || eager_dot[i] != lazy_dot[i]
+              || eager_dot[i] != c[i]
+              || std::fabs (eager_mixed[i] - lazy_mixed[i]) > LAZY_TOLERANCE;
+  }
+  try
+  {
+    Matrix mismatched = lazy::of (a) + Matrix (LAZY_COLS, LAZY_ROWS);
+    failed = 1;
+  }
+  catch (const std::length_error &)
+  {}
+  return failed;
+}
+
+/**
+ * Tests that a block of a view reads and writes the elements of the
+ * matrix through its stride, and that the public index operators, blocks
+ * and operators still check their ranges and shapes.
+ * @return 0 upon success.
+ */
+int test_views_and_bounds ()
+{
+  Matrix mat = random_matrix (VIEW_ROWS, VIEW_COLS, 1, -1, 1);
+  ConstMatrixView whole = mat.view ();
+  MatrixView block = mat.view ().block (1, 2, 3, 4);
+  int failed = block (2, 3) != mat (3, 5) || block.stride () != VIEW_COLS
+               || whole (4, 5) != mat (4, 5);
+  block (0, 0) = 42;
+  failed |= mat (1, 2) != 42 || mat.data ()[VIEW_COLS + 2] != 42;
+  int thrown = 0;
+  try
+  {
+    mat.view ().block (3, 0, 3, 1);
+  }
+  catch (const std::out_of_range &)
+  {
+    thrown++;
+  }
+  try
+  {
+    mat (VIEW_ROWS, 0);
+  }
+  catch (const std::out_of_range &)
+  {
+    thrown++;
+  }
+  try
+  {
+    mat[VIEW_ROWS * VIEW_COLS];
+  }
+  catch (const std::out_of_range &)
+  {
+    thrown++;
+  }
+  try
+  {
+    mat += Matrix (VIEW_ROWS, VIEW_COLS + 1);
+  }
+  catch (const std::length_error &)
+  {
+    thrown++;
+  }
+  return failed || thrown != 4;
+}
+
+/**
+ * Tests relu_in_place on rows of every length up to RELU_MAX_COLS, so both
+ * the four-wide loop and the loop on the last elements run, including -0
+ * and NaN, which become 0.
+ * @return 0 upon success.
+ */
+int test_relu_in_place ()
+{
+  int failed = 0;
+  for (int cols = 1; cols <= RELU_MAX_COLS; cols++)
+  {
+    Matrix mat = random_matrix (3, cols, cols, -1, 1);
+    mat[0] = -0.0f;
+    mat[mat.get_rows () * cols - 1] = std::numeric_limits<float>::quiet_NaN ();
+    Matrix expected (mat);
+    for (int i = 0; i < mat.get_rows () * cols; i++)
+    {
+      expected[i] = expected[i] > 0 ? expected[i] : 0;
+    }
+    activation::relu_in_place (mat);
+    for (int i = 0; i < mat.get_rows () * cols; i++)
+    {
+      failed |= mat[i] != expected[i] || std::signbit (mat[i]);
+    }
+  }
+  return failed;
+}
+
+/**
+ * @return true if a and b have the same shape and their elements differ by
+ * at most tolerance, relative to the element of b
+ */
+static bool close (const Matrix &a, const Matrix &b, double tolerance)
+{
+  if (a.get_rows () != b.get_rows () || a.get_cols () != b.get_cols ())
+  {
+    return false;
+  }
+  for (int i = 0; i < a.get_rows () * a.get_cols (); i++)
+  {
+    if (std::fabs (a[i] - b[i]) > tolerance * (1 + std::fabs (b[i])))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Tests that a Dense layer gives the output of its activation on the
+ * product plus the bias, for the layers of the network with relu and with
+ * softmax, on one vector (the fused kernel) and on a batch. softmax has to
+ * stay finite on outputs far past where exp overflows, and a bias that
+ * isn't a column of the rows of the weights throws.
+ * @return 0 upon success.
+ */
+int test_dense_layers ()
+{
+  Matrix weights[MLP_SIZE], biases[MLP_SIZE];
+  random_layers (weights, biases);
+  int failed = 0;
+  for (int l = 0; l < MLP_SIZE; l++)
+  {
+    for (activation_func function : {activation::relu, activation::softmax})
+    {
+      Dense layer (weights[l], biases[l], function);
+      for (int n : {1, DENSE_BATCH})
+      {
+        Matrix input = random_matrix (weights[l].get_cols (), n, 10 + l, 0,
+                                      1);
+        Matrix expected = weights[l] * input;
+        for (int i = 0; i < expected.get_rows (); i++)
+        {
+          for (int j = 0; j < n; j++)
+          {
+            expected (i, j) += biases[l] (i, 0);
+          }
+        }
+        failed |= !close (layer (input), function (expected),
+                          PRODUCT_TOLERANCE);
+      }
+    }
+  }
+  Matrix large (10, 1);
+  for (int i = 0; i < large.get_rows (); i++)
+  {
+    large[i] = SOFTMAX_STEP * i;
+  }
+  Matrix probabilities = activation::softmax (large);
+  float sum = 0;
+  for (int i = 0; i < large.get_rows (); i++)
+  {
+    failed |= !std::isfinite (probabilities[i]);
+    sum += probabilities[i];
+  }
+  failed |= std::fabs (sum - 1) > PROBABILITY_TOLERANCE
+            || std::fabs (probabilities[9] - 1) > PROBABILITY_TOLERANCE;
+  int thrown = 0;
+  Matrix wrong_biases[] = {Matrix (weights[0].get_rows () + 1, 1),
+                           Matrix (weights[0].get_rows (), 2)};
+  for (const Matrix &bias : wrong_biases)
+  {
+    try
+    {
+      Dense layer (weights[0], bias, activation::relu);
+    }
+    catch (const std::length_error &)
+    {
+      thrown++;
+    }
+  }
+  return failed || thrown != 2;
+}
+
+/**
+ * Tests transposed () and the in place transpose against the checked
+ * index operators on sizes around the tiles, twice in place gives the
+ * matrix back, and products with a transposed_view operand match the
+ * products with a copied transpose with every instruction set.
+ * @return 0 upon success.
+ */
+int test_transposes ()
+{
+  const int sizes[] = {1, 2, 3, 4, 5, 7, 8, 31, 32, 33, 64, 65, 100, 128, 300};
+  int failed = 0;
+  for (int rows : sizes)
+  {
+    for (int cols : sizes)
+    {
+      Matrix mat = random_matrix (rows, cols, rows * cols, -1, 1);
+      Matrix expected (cols, rows);
+      for (int i = 0; i < rows; i++)
+      {
+        for (int j = 0; j < cols; j++)
+        {
+          expected (j, i) = mat (i, j);
+        }
+      }
+      Matrix in_place (mat);
+      failed |= !close (mat.transposed (), expected, 0)
+                || !close (in_place.transpose (), expected, 0)
+                || !close (in_place.transpose (), mat, 0);
+    }
+  }
+  const int depths[] = {1, 2, 6, 7, 17, 33, 130};
+  gemm::isa best = gemm::best_isa ();
+  for (int kernel = (int) gemm::isa::scalar; kernel <= (int) best; kernel++)
+  {
+    gemm::use_isa ((gemm::isa) kernel);
+    for (int m : depths)
+    {
+      for (int n : depths)
+      {
+        for (int k : depths)
+        {
+          Matrix a = random_matrix (m, k, 1, -1, 1);
+          Matrix b = random_matrix (k, n, 2, -1, 1);
+          Matrix expected = a * b;
+          Matrix at = a.transposed (), bt = b.transposed ();
+          failed |= !close (a * bt.transposed_view (), expected,
+                            PRODUCT_TOLERANCE)
+                    || !close (at.transposed_view () * b, expected,
+                               PRODUCT_TOLERANCE);
+        }
+      }
+    }
+  }
+  gemm::use_isa (best);
+  try
+  {
+    Matrix (3, 4) * Matrix (4, 3).transposed_view ();
+    failed = 1;
+  }
+  catch (const std::length_error &)
+  {}
+  return failed;
+}
+
+/**
+ * Tests that the parallel products and elementwise operators give the
+ * serial results bit for bit on 2 to POOL_MAX_THREADS threads, that an
+ * exception of a chunk reaches the caller, and that a loop inside a loop
+ * runs every index once.
+ * @return 0 upon success.
+ */
+int test_thread_pool ()
+{
+  ThreadPool &pool = ThreadPool::instance ();
+  int threads = pool.threads ();
+  Matrix a = random_matrix (700, 500, 1, -1, 1);
+  Matrix b = random_matrix (500, 300, 2, -1, 1);
+  Matrix c = random_matrix (700, 500, 3, -1, 1);
+  Matrix w = random_matrix (2048, 600, 4, -1, 1);
+  Matrix v = random_matrix (600, 1, 5, -1, 1);
+  pool.set_threads (1);
+  Matrix product = a * b, vector_product = w * v, sum = a + c;
+  Matrix dot = a.dot (c);
+  int failed = 0;
+  for (int t = 2; t <= POOL_MAX_THREADS; t++)
+  {
+    pool.set_threads (t);
+    failed |= !close (a * b, product, 0) || !close (w * v, vector_product, 0)
+              || !close (a + c, sum, 0) || !close (a.dot (c), dot, 0);
+  }
+  pool.set_threads (4);
+  try
+  {
+    pool.parallel_for (0, POOL_LOOP_END, 1, [] (int first, int)
+    {
+      if (first == POOL_LOOP_END / 2)
+      {
+        throw std::runtime_error ("chunk");
+      }
+    });
+    failed = 1;
+  }
+  catch (const std::runtime_error &)
+  {}
+  std::atomic<long> total{0};
+  pool.parallel_for (0, POOL_LOOP_END, 3, [&] (int first, int last)
+  {
+    pool.parallel_for (first, last, 1, [&] (int inner_first, int inner_last)
+    {
+      for (int i = inner_first; i < inner_last; i++)
+      {
+        total += i;
+      }
+    });
+  });
+  failed |= total != POOL_LOOP_END * (POOL_LOOP_END - 1) / 2;
+  pool.set_threads (threads);
+  return failed;
+}
+
+/**
+ * a test and its name
+ */
+struct named_test
+{
+  const char *name;
+  int (*run) ();
+};
+
+static const named_test tests[] = {
+    {"gemm_kernels", test_gemm_kernels},
+    {"qgemm_kernels", test_qgemm_kernels},
+    {"batch_matches_single", test_batch_matches_single},
+    {"steady_inference_allocates_nothing",
+     test_steady_inference_allocates_nothing},
+    {"lazy_matches_eager", test_lazy_matches_eager},
+    {"views_and_bounds", test_views_and_bounds},
+    {"relu_in_place", test_relu_in_place},
+    {"dense_layers", test_dense_layers},
+    {"transposes", test_transposes},
+    {"thread_pool", test_thread_pool},
+};
+
+/**
+ * runs the tests named in the arguments, all of them without arguments
+ * @return EXIT_FAILURE if a test failed
+ * @return EXIT_SUCCESS if all the tests passed successfully
+ */
+int main (int argc, char *argv[])
+{
+  int failed = 0;
+  for (const named_test &test : tests)
+  {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; i++)
+    {
+      selected = selected || std::strcmp (argv[i], test.name) == 0;
+    }
+    if (!selected)
+    {
+      continue;
+    }
+    int result = test.run ();
+    std::cout << (result ? "FAIL " : "ok   ") << test.name << std::endl;
+    failed += result != 0;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#ifndef _ARENA_HPP_
+#define _ARENA_HPP_
+
+#include <cstddef>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#define ARENA_BLOCK_SIZE 65536
+
+/**
+ * a monotonic arena: memory is handed out by bumping a pointer inside large
+ * blocks and is only given back all at once, by release or when the arena is
+ * destroyed. building a map in an arena costs one allocation per block
+ * instead of one per bucket, and the whole map is freed in one go.
+ * the arena never reuses freed memory, so bucket arrays left behind by a
+ * rehash stay in it until release - reserve the map first when its size is
+ * known.
+ */
+class MonotonicArena
+{
+ public:
+  /**
+   * constructor
+   * @param block_size - size in bytes of every block the arena takes from
+   * the heap, larger requests get a block of their own
+   */
+  explicit MonotonicArena (size_t block_size = ARENA_BLOCK_SIZE);
+  /**
+   * an arena owns the memory of everything allocated from it, it can't be
+   * copied
+   */
+  MonotonicArena (const MonotonicArena &) = delete;
+  MonotonicArena &operator= (const MonotonicArena &) = delete;
+  /**
+   * destructor, frees all the blocks
+   */
+  ~MonotonicArena ();
+  /**
+   * allocate bytes from the current block, taking a new block if it is full
+   * @param bytes - number of bytes
+   * @param alignment - alignment of the memory, a power of two
+   * @return pointer to the memory
+   */
+  void *allocate (size_t bytes, size_t alignment);
+  /**
+   * free all the blocks at once, everything allocated from the arena is
+   * invalid afterwards
+   */
+  void release ();
+  /**
+   * @return number of bytes handed out since construction or last release
+   */
+  size_t bytes_allocated () const;
+  /**
+   * @return number of blocks the arena took from the heap
+   */
+  size_t block_count () const;
+
+ private:
+  size_t _block_size;
+  std::vector<char *> _blocks;
+  char *_current;
+  size_t _left;
+  size_t _bytes_allocated;
+};
+
+/**
+ * a standard allocator that takes its memory from a MonotonicArena,
+ * deallocate does nothing. a HashMap with an ArenaAllocator allocates both
+ * its bucket array and its pairs from the arena. the arena must outlive
+ * every container that uses it.
+ */
+template<class T>
+class ArenaAllocator
+{
+ public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  /**
+   * constructor
+   * @param arena - arena to allocate from
+   */
+  ArenaAllocator (MonotonicArena &arena) noexcept
+      : _arena (&arena)
+  {}
+  /**
+   * converting constructor, used when a container rebinds the allocator
+   * @param other - allocator of another type that uses the same arena
+   */
+  template<class U>
+  ArenaAllocator (const ArenaAllocator<U> &other) noexcept
+      : _arena (&other.arena ())
+  {}
+  /**
+   * allocate memory for n objects of type T, raise exception if the size
+   * of n objects doesn't fit in size_t
+   * @param n - number of objects
+   * @return pointer to the memory
+   */
+  T *allocate (size_t n)
+  {
+    if (n > max_size ())
+    {
+      throw std::bad_array_new_length ();
+    }
+    return static_cast<T *> (_arena->allocate (n * sizeof (T), alignof (T)));
+  }
+  /**
+   * @return the largest number of objects allocate accepts
+   */
+  size_t max_size () const noexcept
+  {
+    return std::numeric_limits<size_t>::max () / sizeof (T);
+  }
+  /**
+   * the arena frees its memory only on release, nothing to do
+   */
+  void deallocate (T *, size_t) noexcept
+  {}
+  /**
+   * @return the arena of the allocator
+   */
+  MonotonicArena &arena () const
+  {
+    return *_arena;
+  }
+
+ private:
+  MonotonicArena *_arena;
+};
+
+/**
+ * two arena allocators are equal if they allocate from the same arena
+ */
+template<class T, class U>
+bool operator== (const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+  return &lhs.arena () == &rhs.arena ();
+}
+
+template<class T, class U>
+bool operator!= (const ArenaAllocator<T> &lhs, const ArenaAllocator<U> &rhs)
+{
+  return !(lhs == rhs);
+}
+
+/** function implementation for MonotonicArena class - documentation in
+ * class */
+
+inline MonotonicArena::MonotonicArena (size_t block_size)
+    : _block_size (block_size), _current (nullptr), _left (0),
+      _bytes_allocated (0)
+{}
+
+inline MonotonicArena::~MonotonicArena ()
+{
+  release ();
+}
+
+inline void *MonotonicArena::allocate (size_t bytes, size_t alignment)
+{
+  size_t padding = (alignment - (size_t) _current % alignment) % alignment;
+  if (_current == nullptr || padding + bytes > _left)
+  {
+    // new blocks come from operator new, aligned for any fundamental type
+    size_t size = bytes > _block_size ? bytes : _block_size;
+    // make room for the block first, so storing it can't throw and leak it
+    if (_blocks.size () == _blocks.capacity ())
+    {
+      _blocks.reserve (2 * _blocks.size () + 1);
+    }
+    _blocks.push_back (static_cast<char *> (::operator new (size)));
+    _current = _blocks.back ();
+    _left = size;
+    padding = 0;
+  }
+  void *memory = _current + padding;
+  _current += padding + bytes;
+  _left -= padding + bytes;
+  _bytes_allocated += bytes;
+  return memory;
+}
+
+inline void MonotonicArena::release ()
+{
+  for (char *block : _blocks)
+  {
+    ::operator delete (block);
+  }
+  _blocks.clear ();
+  _current = nullptr;
+  _left = 0;
+  _bytes_allocated = 0;
+}
+
+inline size_t MonotonicArena::bytes_allocated () const
+{
+  return _bytes_allocated;
+}
+
+inline size_t MonotonicArena::block_count () const
+{
+  return _blocks.size ();
+}
+
+#endif //_ARENA_HPP_
@@ -0,0 +1,258 @@
+#ifndef _CONCURRENTHASHMAP_HPP_
+#define _CONCURRENTHASHMAP_HPP_
+
+#include "HashMap.hpp"
+#include <shared_mutex>
+#include <mutex>
+
+#define DEFAULT_SHARDS 64
+#define CACHE_LINE_SIZE 64
+#define SHARDS_ERROR_MSG "Number of shards must be a positive power of two"
+
+/**
+ * a hash map that can be used by many threads at once. the keys are split
+ * between independent HashMap shards, each with its own reader / writer
+ * lock, so threads that work on different shards never wait for each other,
+ * readers of the same shard share its lock, and every shard rehashes alone.
+ * values are returned by copy, a reference into a shard would outlive the
+ * lock that protects it.
+ */
+template<class KeyT, class ValueT, class Hash = std::hash<KeyT>,
+    class KeyEqual = std::equal_to<>>
+class ConcurrentHashMap
+{
+ public:
+  typedef HashMap<KeyT, ValueT, Hash, KeyEqual> HashMapT;
+
+  /**
+   * constructor
+   * @param shards - number of shards, a power of two. more shards than
+   * threads keeps the chance of two threads sharing a lock low
+   */
+  explicit ConcurrentHashMap (int shards = DEFAULT_SHARDS);
+  /**
+   * the shards hold locks, a concurrent map can't be copied
+   */
+  ConcurrentHashMap (const ConcurrentHashMap &) = delete;
+  ConcurrentHashMap &operator= (const ConcurrentHashMap &) = delete;
+  /**
+   * destructor for the concurrent hash map
+   */
+  ~ConcurrentHashMap ();
+  /**
+   * number of pairs in all the shards, while other threads write it is
+   * only a snapshot
+   * @return an int that represents the size
+   */
+  int size () const;
+  /**
+   * check if the hash map is empty
+   * @return true - the hash map is empty
+   * @return false - the hash map is not empty
+   */
+  bool empty () const;
+  /**
+   * insert a pair of key and value to the hash map,
+   * if key already exist doesn't change the key that was already in hash map
+   * @param key - key to insert
+   * @param value - value to insert
+   * @return true - inserted the key
+   * @return false - the key already exist in hash map
+   */
+  bool insert (const KeyT &key, const ValueT &value);
+  /**
+   * insert a pair of key and value to the hash map,
+   * if key already exist assigns value to it
+   * @param key - key to insert
+   * @param value - value to insert or assign
+   * @return true - inserted the key
+   * @return false - the key existed and value was assigned to it
+   */
+  bool insert_or_assign (const KeyT &key, const ValueT &value);
+  /**
+   * check if a key is in the hash map
+   * @param key - a hash map key
+   * @return true - if key exist in map
+   * @return false - key doesn't exist in map
+   */
+  bool contains_key (const KeyT &key) const;
+  /**
+   * gets a key as parameter and return a copy of the value attached to key
+   * if key isn't found, raise exception
+   * @param key - a hash map key
+   * @return the value attached to key
+   */
+  ValueT at (const KeyT &key) const;
+  /**
+   * gets a key as parameter, if the key exist in the hash map, erases
+   * the key from the hash map
+   * @return true - the key was removed
+   * @return false - the key doesn't exist in hash map
+   */
+  bool erase (const KeyT &key);
+  /**
+   * clear all the shards, removing all the elements
+   */
+  void clear ();
+  /**
+   * set the incremental rehash step of every shard, see
+   * HashMap::set_rehash_step
+   * @param step - number of buckets to migrate per operation
+   */
+  void set_rehash_step (int step);
+  /**
+   * set the load factor policy of every shard, see
+   * HashMap::set_load_factor_policy
+   * @param policy - the load factor policy
+   */
+  void set_load_factor_policy (const LoadFactorPolicy &policy);
+
+ private:
+  /**
+   * a shard, aligned to a cache line so the locks of neighbour shards don't
+   * share one
+   */
+  struct alignas (CACHE_LINE_SIZE) shard
+  {
+    mutable std::shared_mutex mutex;
+    HashMapT map;
+  };
+
+  int _shards_count;
+  Hash _hash;
+  shard *_shards;
+  /**
+   * find the shard of a key. the shard maps index their buckets by the low
+   * bits of the hash, so the shard is chosen by the high bits of the mixed
+   * hash, otherwise all keys of a shard would share their low bits
+   * @param key - hash map's key
+   * @return the shard that holds key
+   */
+  shard &shard_for (const KeyT &key) const;
+};
+
+/** function implementation for ConcurrentHashMap class - documentation in
+ * class */
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::ConcurrentHashMap (int shards)
+{
+  if (shards <= 0 || (shards & (shards - 1)) != 0)
+  {
+    throw std::invalid_argument (SHARDS_ERROR_MSG);
+  }
+  _shards_count = shards;
+  _shards = new shard[shards];
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::~ConcurrentHashMap ()
+{
+  delete[] _shards;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::size () const
+{
+  int size = 0;
+  for (int i = 0; i < _shards_count; i++)
+  {
+    std::shared_lock<std::shared_mutex> lock (_shards[i].mutex);
+    size += _shards[i].map.size ();
+  }
+  return size;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::empty () const
+{
+  return size () == 0;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::insert (
+    const KeyT &key, const ValueT &value)
+{
+  shard &key_shard = shard_for (key);
+  std::unique_lock<std::shared_mutex> lock (key_shard.mutex);
+  return key_shard.map.insert (key, value);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::insert_or_assign (
+    const KeyT &key, const ValueT &value)
+{
+  shard &key_shard = shard_for (key);
+  std::unique_lock<std::shared_mutex> lock (key_shard.mutex);
+  return key_shard.map.insert_or_assign (key, value).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::contains_key (
+    const KeyT &key) const
+{
+  const shard &key_shard = shard_for (key);
+  std::shared_lock<std::shared_mutex> lock (key_shard.mutex);
+  return key_shard.map.contains_key (key);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+ValueT ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::at (
+    const KeyT &key) const
+{
+  const shard &key_shard = shard_for (key);
+  std::shared_lock<std::shared_mutex> lock (key_shard.mutex);
+  return key_shard.map.at (key);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::erase (const KeyT &key)
+{
+  shard &key_shard = shard_for (key);
+  std::unique_lock<std::shared_mutex> lock (key_shard.mutex);
+  return key_shard.map.erase (key);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::clear ()
+{
+  for (int i = 0; i < _shards_count; i++)
+  {
+    std::unique_lock<std::shared_mutex> lock (_shards[i].mutex);
+    _shards[i].map.clear ();
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::set_rehash_step (
+    int step)
+{
+  for (int i = 0; i < _shards_count; i++)
+  {
+    std::unique_lock<std::shared_mutex> lock (_shards[i].mutex);
+    _shards[i].map.set_rehash_step (step);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::set_load_factor_policy (
+    const LoadFactorPolicy &policy)
+{
+  for (int i = 0; i < _shards_count; i++)
+  {
+    std::unique_lock<std::shared_mutex> lock (_shards[i].mutex);
+    _shards[i].map.set_load_factor_policy (policy);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+typename ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::shard &
+ConcurrentHashMap<KeyT, ValueT, Hash, KeyEqual>::shard_for (
+    const KeyT &key) const
+{
+  // the upper half of the hash, whatever the width of size_t
+  size_t key_hash = mix_hash (_hash (key));
+  return _shards[(key_hash >> (sizeof (size_t) * 4)) & (_shards_count - 1)];
+}
+
+#endif //_CONCURRENTHASHMAP_HPP_
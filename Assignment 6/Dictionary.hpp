@@ -2,6 +2,7 @@
 #define _DICTIONARY_H_
 
 #include "HashMap.hpp"
+#include <iterator>
 #define INVALID_KEY_ERROR_MSG "Invalid Key, the key doesn't exist in hash map"
 
 typedef HashMap<std::string, std::string> str_hash_map;
@@ -35,7 +36,17 @@ class Dictionary : public str_hash_map
    */
   bool erase (const std::string &str_key) override;
   /**
-   * get 2 iterators and insert all item from the iterator to the dictionary
+   * erase a key given as std::string_view or const char * without building
+   * a std::string, if key is not in the hash map raises exception
+   * @param str_key - a string's key
+   * @return true of key was deleted from the map
+   */
+  template<class K, typename std::enable_if<is_lookup_key<
+      std::string, std::hash<std::string>, K>::value, int>::type = 0>
+  bool erase (const K &str_key);
+  /**
+   * get 2 iterators and insert all item from the iterator to the dictionary,
+   * keys that already exist get the new value
    * @param begin_iter - an iterator to begin in
    * @param end_iter - an iterator to end at
    */
@@ -53,14 +64,36 @@ bool Dictionary::erase (const std::string &str_key)
   throw InvalidKey ();
 }
 
+template<class K, typename std::enable_if<is_lookup_key<
+    std::string, std::hash<std::string>, K>::value, int>::type>
+bool Dictionary::erase (const K &str_key)
+{
+  if (HashMap::erase (str_key))
+  {
+    return true;
+  }
+  throw InvalidKey ();
+}
+
 template<class IteratorT>
 void Dictionary::update (IteratorT begin_iter, IteratorT end_iter)
 {
+  typedef typename std::iterator_traits<IteratorT>::iterator_category
+      category;
+  if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value)
+  {
+    // the length of the range is known, grow once instead of on the way.
+    // the range may repeat keys of the dictionary, so the final size is only
+    // known to be at least the larger of the two
+    reserve (std::max (size (), (int) std::distance (begin_iter, end_iter)));
+  }
   for (auto it = begin_iter; it != end_iter; it++)
   {
-    const auto &key = it->first;
-    const auto &value = it->second;
-    operator[] (key) = value;
+    // an iterator that yields rvalues (std::move_iterator) moves the
+    // strings into the dictionary instead of copying them
+    auto &&entry = *it;
+    insert_or_assign (std::forward<decltype (entry)> (entry).first,
+                      std::forward<decltype (entry)> (entry).second);
   }
 }
 
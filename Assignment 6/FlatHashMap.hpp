@@ -0,0 +1,791 @@
+#ifndef _FLATHASHMAP_HPP_
+#define _FLATHASHMAP_HPP_
+
+#include "HashMap.hpp"
+#include <new>
+#include <stdexcept>
+
+#define EMPTY_SLOT 0
+#define MAX_PROBE_DISTANCE 255
+// doublings an insert may make for a probe distance, past the load factor
+#define MAX_PROBE_GROWTHS 1
+#define PROBE_ERROR_MSG "Too many keys with the same hash"
+
+/**
+ * an open addressing hash map that keeps all of its pairs in one contiguous
+ * slot array (robin hood linear probing, backward shift deletion).
+ * next to the slots there is an array of control bytes, a control byte is
+ * EMPTY_SLOT for a free slot, otherwise it is the probe distance of the pair
+ * from its home slot plus one.
+ * a slot is raw storage, a pair is constructed in it only while its control
+ * byte isn't EMPTY_SLOT, so KeyT and ValueT don't have to be default
+ * constructible (only the const operator[] needs a default ValueT).
+ * public api and the Hash and KeyEqual policies are the same as HashMap,
+ * except that the hash is always mixed (mix_hash): linear probing needs the
+ * low bits of the hashes to differ, and std::hash of integers is the
+ * identity. keys with the same mixed hash that no longer fit the probe
+ * distance of a control byte make insert throw std::runtime_error.
+ * a moved from map is empty with no slots, the first insert allocates them.
+ */
+template<class KeyT, class ValueT, class Hash = std::hash<KeyT>,
+    class KeyEqual = std::equal_to<>>
+class FlatHashMap
+{
+ public:
+  class ConstIterator;
+  typedef ConstIterator const_iterator;
+  typedef std::pair<KeyT, ValueT> pair;
+  typedef FlatHashMap<KeyT, ValueT, Hash, KeyEqual> FlatHashMapT;
+  typedef const std::vector<ValueT> value_vec;
+  typedef const std::vector<KeyT> key_vec;
+
+  /**
+   * default constructor
+   */
+  FlatHashMap ();
+  /**
+   * a constructor that get a vector of keys and values and initializes
+   * the hash map with those keys and values
+   * @param keys
+   * @param values
+   */
+  FlatHashMap (const key_vec &keys, const value_vec &values);
+  /**
+   * copy constructor, copies every pair into the same slot
+   * @param other - a hash map to copy
+   */
+  FlatHashMap (const FlatHashMapT &other);
+  /**
+   * move constructor, other is left empty with no slots
+   * @param other - a hash map to move from
+   */
+  FlatHashMap (FlatHashMapT &&other) noexcept;
+  /**
+   * destructor, destroys the pairs of the occupied slots
+   */
+  ~FlatHashMap ();
+  /**
+   * copy assignment
+   * @param assign_map - a hash map to copy
+   * @return this hash map
+   */
+  FlatHashMapT &operator= (const FlatHashMapT &assign_map);
+  /**
+   * move assignment, assign_map gets the pairs of this map
+   * @param assign_map - a hash map to move from
+   * @return this hash map
+   */
+  FlatHashMapT &operator= (FlatHashMapT &&assign_map) noexcept;
+  /**
+   * a getter for the size (number of pairs) of the hash map
+   * @return an int that represents the size
+   */
+  int size () const;
+  /**
+   * a getter for the capacity (number of slots) of the hash map
+   * @return an int that represents the capacity
+   */
+  int capacity () const;
+  /**
+   * check if the hash map is empty
+   * @return true - the hash map is empty
+   * @return false - the hash map is not empty
+   */
+  bool empty () const;
+  /**
+   * insert a pair of key and value to the hash map,
+   * if key already exist doesn't change the key that was already in hash map
+   * @param key - key to insert
+   * @param value - value to insert
+   * @return true - inserted the key
+   * @return false - the key already exist in hash map
+   */
+  bool insert (const KeyT &key, const ValueT &value);
+  /**
+   * check if a key is in the hash map
+   * @param key - a hash map key
+   * @return true - if key exist in map
+   * @return false - key doesn't exist in map
+   */
+  bool contains_key (const KeyT &key) const;
+  /**
+   * gets a key as parameter and return the a value attached to key
+   * if key isn't found, raise exception
+   * @param key - a hash map key
+   * @return the value attached to key as ref
+   */
+  ValueT &at (const KeyT &key);
+  /**
+   * gets a key as parameter and return the value of the key
+   * if key isn't found, raise exception
+   * @return - the value attached to key as const ref
+   */
+  const ValueT &at (const KeyT &key) const;
+  /**
+   * calculate the load factor of the hash map (size / capacity) of hash map
+   * @return a double of the load factor of map
+   */
+  double get_load_factor () const;
+  /**
+   * gets a key as parameter, if the key exist in the hash map, erases
+   * the key from the hash map
+   * @return true - the key was removed
+   * @return false - the key doesn't exist in hash map
+   */
+  bool erase (const KeyT &key);
+  /**
+   * removing all the elements, capacity stays the same
+   */
+  void clear ();
+  /**
+   * gets a key and returned the value that attached to key as reference,
+   * if key doesn't exist, append new key and value
+   * @param key - a hash map's key
+   * @return reference to the value of key
+   */
+  ValueT &operator[] (const KeyT &key);
+  /**
+   * gets a key and returned the value that attached to key
+   * @param key - a hash map's key
+   * @return const reference to the value of key
+   */
+  const ValueT &operator[] (const KeyT &key) const;
+  /**
+   * check if 2 hash map are equal
+   * @param compare_map - a hash map to compare (this) to
+   * @return true - hash maps are equal
+   * @return false - hash maps are unequal
+   */
+  bool operator== (const FlatHashMapT &compare_map) const;
+  /**
+   * check if 2 hash map are unequal
+   * @param compare_map - a hash map to compare (this) to
+   * @return true - hash maps are unequal
+   * @return false - hash maps are equal
+   */
+  bool operator!= (const FlatHashMapT &compare_map) const;
+
+  /**
+   * begin and end for const iterator implementation
+   */
+  const_iterator begin () const
+  { return ConstIterator (this); }
+  const_iterator cbegin () const
+  { return ConstIterator (this); }
+  const_iterator end () const
+  { return ConstIterator (this, -1); }
+  const_iterator cend () const
+  { return ConstIterator (this, -1); }
+
+ private:
+  /**
+   * storage for one pair, constructed and destroyed by the map
+   */
+  struct slot
+  {
+    alignas (pair) unsigned char storage[sizeof (pair)];
+  };
+
+  int _capacity;
+  int _size;
+  Hash _hash;
+  KeyEqual _key_equal;
+  std::vector<unsigned char> _control;
+  std::unique_ptr<slot[]> _slots;
+  /**
+   * the pair of an occupied slot
+   * @param slots - a slot array
+   * @param index - the index of the slot
+   * @return reference to the pair in the slot
+   */
+  static pair &pair_at (slot *slots, int index);
+  /**
+   * the pair of an occupied slot of this map
+   * @param index - the index of the slot
+   * @return reference to the pair in the slot
+   */
+  pair &slot_at (int index);
+  const pair &slot_at (int index) const;
+  /**
+   * destroy the pairs of the occupied slots and mark them empty
+   */
+  void destroy_slots ();
+  /**
+   * a hashing function, get a key and return the home slot of the key
+   * @param key - hash map's key
+   * @return an int from the hashing func
+   */
+  int hashing (const KeyT &key) const;
+  /**
+   * probe the slot array for key, stops as soon as the probe distance is
+   * bigger than the distance of the pair in the slot (robin hood invariant)
+   * @param key - hash map's key
+   * @return the slot of key, -1 if key isn't in the map
+   */
+  int find_slot (const KeyT &key) const;
+  /**
+   * place a pair that is known to not be in the map, without checking the
+   * load factor. robin hood may swap entry with pairs on the way, so the
+   * probe is first walked on the control bytes alone: if a probe distance
+   * would stop fitting a control byte nothing is changed
+   * @param entry - the pair to place, moved from when it was placed
+   * @return true - the pair was placed
+   * @return false - the map is unchanged, it has to grow to place entry
+   */
+  bool place (pair &entry);
+  /**
+   * if load factor is out of range, this function
+   * find the capacity that updated capacity
+   * @return an int that represent the valid capacity
+   */
+  int find_new_capacity () const;
+  /**
+   * move all the pairs to a slot array with new_capacity slots, doubles it
+   * again (without nesting) until every probe distance fits a control byte.
+   * the pairs fit the slot array they come from, so a shrink grows back at
+   * most to it
+   * @param new_capacity - new capacity to rehash the map to
+   */
+  void rehashing (int new_capacity);
+
+ public:
+  /**
+   * An Iterator class for FlatHashMap
+   */
+  class ConstIterator
+  {
+   private:
+    const FlatHashMapT *_iter_ptr_map;
+    int _ind_slot;
+
+   public:
+    /**
+     * mandatory typedef for iterator class
+     */
+    typedef pair value_type;
+    typedef const pair &reference;
+    typedef const pair *pointer;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::forward_iterator_tag iterator_category;
+
+    /**
+     * initializes constructor for iterator
+     * @param hash_map
+     */
+    explicit ConstIterator (const FlatHashMapT *hash_map)
+        : _iter_ptr_map (hash_map), _ind_slot (0)
+    { find_next_element (); }
+    /**
+     * @param hash_map - a pointer to the hash map
+     * @param ind_slot - the index of the slot iterator is in
+     */
+    ConstIterator (const FlatHashMapT *hash_map, int ind_slot)
+        : _iter_ptr_map (hash_map), _ind_slot (ind_slot)
+    {}
+
+    /**
+     * find the next occupied slot to iterate to, only control bytes are
+     * read while skipping empty slots
+     */
+    void find_next_element ()
+    {
+      const std::vector<unsigned char> &control = _iter_ptr_map->_control;
+      for (int i = _ind_slot; i < _iter_ptr_map->_capacity; ++i)
+      {
+        if (control[i] != EMPTY_SLOT)
+        {
+          _ind_slot = i;
+          return;
+        }
+      }
+      _ind_slot = -1;
+    }
+    /**
+     * gets the next element to iterate to
+     * @return the element after the iteration
+     */
+    const_iterator &operator++ ()
+    {
+      _ind_slot++;
+      find_next_element ();
+      return *this;
+    }
+
+    /**
+     * gets the next element to iterate to
+     * @return the element before the iteration
+     */
+    const_iterator operator++ (int)
+    {
+      const ConstIterator it (*this);
+      operator++ ();
+      return it;
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are equal
+     * @return false - iterators are unequal
+     */
+    bool operator== (const ConstIterator &compare_iter) const
+    {
+      return (_ind_slot == compare_iter._ind_slot
+              && _iter_ptr_map == compare_iter._iter_ptr_map);
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are unequal
+     * @return false - iterators are equal
+     */
+    bool operator!= (const ConstIterator &compare_iter) const
+    {
+      return !(operator== (compare_iter));
+    }
+
+    /**
+     * dereference to the pair of the iterator is currently at
+     * @return a pair of key and value
+     */
+    reference operator* () const
+    {
+      return _iter_ptr_map->slot_at (_ind_slot);
+    }
+
+    /**
+     * a pointer to the pair
+     * @return a pointer to the pair of key and value
+     */
+    pointer operator-> () const
+    {
+      return &(operator* ());
+    }
+  };
+};
+
+/** function implementation for FlatHashMap class - documentation in class */
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::FlatHashMap ()
+    : _capacity (INITIAL_CAPACITY), _size (0), _hash (), _key_equal (),
+      _control (INITIAL_CAPACITY, EMPTY_SLOT),
+      _slots (new slot[INITIAL_CAPACITY])
+{}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::FlatHashMap (const key_vec &keys,
+                                                        const value_vec &values)
+    : FlatHashMap ()
+{
+  if (keys.size () != values.size ())
+  {
+    throw std::length_error (VECTOR_LEN_ERROR_MSG);
+  }
+  for (int i = (int) keys.size () - 1; i >= 0; --i)
+  {
+    insert (keys[i], values[i]);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::FlatHashMap (
+    const FlatHashMapT &other)
+    : _capacity (other._capacity), _size (other._size), _hash (other._hash),
+      _key_equal (other._key_equal), _control (other._control),
+      _slots (new slot[other._capacity])
+{
+  for (int i = 0; i < _capacity; i++)
+  {
+    if (_control[i] == EMPTY_SLOT)
+    {
+      continue;
+    }
+    try
+    {
+      new (_slots[i].storage) pair (other.slot_at (i));
+    }
+    catch (...)
+    {
+      // the pairs after i were never constructed
+      std::fill (_control.begin () + i, _control.end (), EMPTY_SLOT);
+      destroy_slots ();
+      throw;
+    }
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::FlatHashMap (
+    FlatHashMapT &&other) noexcept
+    : _capacity (other._capacity), _size (other._size),
+      _hash (std::move (other._hash)),
+      _key_equal (std::move (other._key_equal)),
+      _control (std::move (other._control)), _slots (std::move (other._slots))
+{
+  other._capacity = 0, other._size = 0;
+  other._control.clear ();
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::~FlatHashMap ()
+{
+  destroy_slots ();
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual> &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator= (
+    const FlatHashMapT &assign_map)
+{
+  if (&assign_map != this)
+  {
+    *this = FlatHashMapT (assign_map);
+  }
+  return *this;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual> &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator= (
+    FlatHashMapT &&assign_map) noexcept
+{
+  // assign_map gets the pairs of this map and destroys them when destroyed
+  std::swap (_capacity, assign_map._capacity);
+  std::swap (_size, assign_map._size);
+  std::swap (_hash, assign_map._hash);
+  std::swap (_key_equal, assign_map._key_equal);
+  _control.swap (assign_map._control);
+  _slots.swap (assign_map._slots);
+  return *this;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::size () const
+{
+  return _size;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::capacity () const
+{
+  return _capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::empty () const
+{
+  return (_size == 0);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::insert (const KeyT &key,
+                                                       const ValueT &value)
+{
+  if (find_slot (key) != -1) // check if key exists
+  {
+    return false;
+  }
+  // grow before placing, so there is always a free slot to probe into.
+  // a moved from map has no slots and grows to the initial capacity
+  if (UPPER_LOAD_FACTOR < double (_size + 1) / (double) _capacity)
+  {
+    rehashing (std::max (_capacity * 2, INITIAL_CAPACITY));
+  }
+  pair entry (key, value);
+  for (int growths = 0; !place (entry); growths++)
+  {
+    // the probe distance doesn't fit a control byte anymore. with mixed
+    // hashes that only lasts past a doubling for keys whose hashes are
+    // the same, growing more would never end
+    if (growths == MAX_PROBE_GROWTHS)
+    {
+      throw std::runtime_error (PROBE_ERROR_MSG);
+    }
+    rehashing (_capacity * 2);
+  }
+  _size++;
+  return true;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::contains_key (const KeyT &key) const
+{
+  return find_slot (key) != -1;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+const ValueT &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::at (const KeyT &key) const
+{
+  int index = find_slot (key);
+  if (index == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  return slot_at (index).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+ValueT &FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::at (const KeyT &key)
+{
+  int index = find_slot (key);
+  if (index == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  return slot_at (index).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+double FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::get_load_factor () const
+{
+  double size = _size;
+  double capacity = _capacity;
+  return size / capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::erase (const KeyT &key)
+{
+  int index = find_slot (key);
+  if (index == -1)
+  {
+    return false;
+  }
+  // backward shift: pull every following pair that isn't in its home slot
+  // one slot back, so no tombstones are needed
+  int mask = _capacity - 1;
+  int next = (index + 1) & mask;
+  slot_at (index).~pair ();
+  while (_control[next] > 1)
+  {
+    _control[index] = _control[next] - 1;
+    pair &shifted = slot_at (next);
+    new (_slots[index].storage) pair (std::move (shifted));
+    shifted.~pair ();
+    index = next;
+    next = (next + 1) & mask;
+  }
+  _control[index] = EMPTY_SLOT;
+  _size--;
+  if (get_load_factor () < LOWER_LOAD_FACTOR)
+  {
+    rehashing (find_new_capacity ());
+  }
+  return true;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::clear ()
+{
+  destroy_slots ();
+  _size = 0;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+ValueT &FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator[] (const KeyT &key)
+{
+  int index = find_slot (key);
+  if (index == -1)
+  {
+    insert (key, ValueT ());
+    index = find_slot (key);
+  }
+  return slot_at (index).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+const ValueT &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator[] (const KeyT &key) const
+{
+  static const ValueT default_value{};
+  int index = find_slot (key);
+  if (index == -1)
+  {
+    return default_value;
+  }
+  return slot_at (index).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator== (
+    const FlatHashMapT &compare_map) const
+{
+  if (_size != compare_map._size)
+  {
+    return false;
+  }
+  for (const pair &cur_pair : compare_map)
+  {
+    int index = find_slot (cur_pair.first);
+    if (index == -1 || !(slot_at (index).second == cur_pair.second))
+    { return false; }
+  }
+  return true;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::operator!= (
+    const FlatHashMapT &compare_map) const
+{
+  return !operator== (compare_map);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::hashing (const KeyT &key) const
+{
+  size_t key_hash = mix_hash (_hash (key));
+  return key_hash & (this->_capacity - 1);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::find_slot (const KeyT &key) const
+{
+  if (_capacity == 0) // moved from
+  {
+    return -1;
+  }
+  int mask = _capacity - 1;
+  int index = hashing (key);
+  int dist = 1;
+  while (_control[index] >= dist)
+  {
+    if (_key_equal (slot_at (index).first, key))
+    {
+      return index;
+    }
+    index = (index + 1) & mask;
+    dist++;
+  }
+  return -1;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+bool FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::place (pair &entry)
+{
+  int mask = _capacity - 1;
+  int home = hashing (entry.first);
+  // the distances a placement would carry, without moving anything
+  int index = home;
+  unsigned char dist = 1;
+  while (_control[index] != EMPTY_SLOT)
+  {
+    dist = std::min (dist, _control[index]);
+    index = (index + 1) & mask;
+    dist++;
+    if (dist == MAX_PROBE_DISTANCE)
+    {
+      return false;
+    }
+  }
+  index = home;
+  dist = 1;
+  while (_control[index] != EMPTY_SLOT)
+  {
+    // robin hood: the pair that is closer to its home slot gives up its slot
+    if (_control[index] < dist)
+    {
+      std::swap (_control[index], dist);
+      std::swap (slot_at (index), entry);
+    }
+    index = (index + 1) & mask;
+    dist++;
+  }
+  _control[index] = dist;
+  new (_slots[index].storage) pair (std::move (entry));
+  return true;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+int FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::find_new_capacity () const
+{
+  int new_capacity = _capacity;
+  double new_load_factor = get_load_factor ();
+  while (new_load_factor < LOWER_LOAD_FACTOR && new_capacity > 1)
+  {
+    new_capacity /= 2;
+    new_load_factor = double (_size) / (double) new_capacity;
+  }
+  return new_capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::rehashing (int new_capacity)
+{
+  // pairs left without a slot by place, they go into the next table
+  std::vector<pair> pending, overflow;
+  while (true)
+  {
+    std::vector<unsigned char> old_control (new_capacity, EMPTY_SLOT);
+    std::unique_ptr<slot[]> old_slots (new slot[new_capacity]);
+    old_control.swap (_control);
+    old_slots.swap (_slots);
+    int old_capacity = _capacity;
+    _capacity = new_capacity;
+    for (int i = 0; i < old_capacity; i++)
+    {
+      if (old_control[i] != EMPTY_SLOT)
+      {
+        pair &entry = pair_at (old_slots.get (), i);
+        if (!place (entry))
+        {
+          overflow.push_back (std::move (entry));
+        }
+        entry.~pair ();
+      }
+    }
+    for (pair &entry : pending)
+    {
+      if (!place (entry))
+      {
+        overflow.push_back (std::move (entry));
+      }
+    }
+    if (overflow.empty ())
+    {
+      return;
+    }
+    pending.clear ();
+    pending.swap (overflow);
+    new_capacity = _capacity * 2;
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+typename FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::pair &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::pair_at (slot *slots, int index)
+{
+  return *std::launder (reinterpret_cast<pair *> (slots[index].storage));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+typename FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::pair &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::slot_at (int index)
+{
+  return pair_at (_slots.get (), index);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+const typename FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::pair &
+FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::slot_at (int index) const
+{
+  return pair_at (_slots.get (), index);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual>
+void FlatHashMap<KeyT, ValueT, Hash, KeyEqual>::destroy_slots ()
+{
+  for (int i = 0; i < _capacity; i++)
+  {
+    if (_control[i] != EMPTY_SLOT)
+    {
+      slot_at (i).~pair ();
+      _control[i] = EMPTY_SLOT;
+    }
+  }
+}
+
+#endif //_FLATHASHMAP_HPP_
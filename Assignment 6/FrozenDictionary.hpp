@@ -0,0 +1,560 @@
+#ifndef _FROZENDICTIONARY_HPP_
+#define _FROZENDICTIONARY_HPP_
+
+#include "Dictionary.hpp"
+#include <cstdint>
+#include <cstring>
+
+#define FROZEN_KEYS_PER_BUCKET 3
+#define FROZEN_MAX_ATTEMPTS 16
+#define FROZEN_MAX_SEEDS (1 << 20)
+#define FROZEN_DIRECT_SEED 0x80000000u
+#define FROZEN_BUILD_ERROR_MSG "Can't build a perfect hash for the keys"
+
+/**
+ * an immutable dictionary built once from a Dictionary or a range of pairs.
+ * the keys are placed by a minimal perfect hash (CHD, hash and displace):
+ * the keys are split into small buckets, and every bucket gets a seed that
+ * sends each of its keys to a different free slot of a table of exactly
+ * size () slots. a lookup reads the seed of its bucket, goes to the one
+ * slot the seed gives and compares the one key in it. a bucket of a single
+ * key is the last to be placed, when few slots are free, so instead of a
+ * seed it stores the slot of its key directly.
+ * all the keys and values are packed into a single string blob, a slot
+ * holds the offset and sizes of its key and value.
+ */
+class FrozenDictionary
+{
+ public:
+  class ConstIterator;
+  typedef ConstIterator const_iterator;
+  typedef std::pair<std::string_view, std::string_view> pair;
+
+  /**
+   * build from the pairs of a dictionary
+   * @param dictionary - the dictionary to freeze
+   */
+  explicit FrozenDictionary (const Dictionary &dictionary);
+  /**
+   * build from a range of pairs of strings, like Dictionary::update a
+   * repeated key gets the last value
+   * @param begin_iter - an iterator to begin in
+   * @param end_iter - an iterator to end at
+   */
+  template<class IteratorT>
+  FrozenDictionary (IteratorT begin_iter, IteratorT end_iter);
+  /**
+   * a getter for the size (number of pairs) of the dictionary
+   * @return an int that represents the size
+   */
+  int size () const;
+  /**
+   * check if the dictionary is empty
+   * @return true - the dictionary is empty
+   * @return false - the dictionary is not empty
+   */
+  bool empty () const;
+  /**
+   * check if a key is in the dictionary
+   * @param key - a dictionary key
+   * @return true - if key exist in the dictionary
+   * @return false - key doesn't exist in the dictionary
+   */
+  bool contains_key (std::string_view key) const;
+  /**
+   * gets a key as parameter and return the value attached to key, a view
+   * into the blob of the dictionary. if key isn't found, raise exception
+   * @param key - a dictionary key
+   * @return the value attached to key
+   */
+  std::string_view at (std::string_view key) const;
+  /**
+   * find the pair of a key
+   * @param key - a dictionary key
+   * @return iterator to the pair, end () if key doesn't exist
+   */
+  const_iterator find (std::string_view key) const;
+  /**
+   * iterators to the pairs, in the order of the slots
+   */
+  const_iterator begin () const;
+  const_iterator end () const;
+  const_iterator cbegin () const;
+  const_iterator cend () const;
+  /**
+   * @return bytes held by the slots, the seeds and the blob
+   */
+  size_t bytes_allocated () const;
+
+ private:
+  struct slot
+  {
+    uint64_t offset;
+    uint32_t key_size;
+    uint32_t value_size;
+  };
+
+  // the hash of every key is salted, a salt that fails to give a perfect
+  // hash is replaced by the next one
+  uint64_t _salt;
+  std::vector<uint32_t> _seeds;
+  std::vector<slot> _slots;
+  std::string _blob;
+  /**
+   * remove every pair but the last of a repeated key. the pairs are sorted
+   * by the hash of their key, so only the few pairs of the same hash are
+   * compared
+   * @param pairs - pairs in the order they were given
+   */
+  static void remove_repeated_keys (
+      std::vector<std::pair<std::string, std::string>> &pairs);
+  /**
+   * build the perfect hash and the blob from unique pairs
+   * @param pairs - pairs with unique keys
+   */
+  void build (std::vector<std::pair<std::string, std::string>> &pairs);
+  /**
+   * try to find a seed for every bucket with the current salt
+   * @param hashes - hash of every key
+   * @param slot_of_key - receives the slot of every key
+   * @return true if every bucket got a seed
+   */
+  bool place_keys (const std::vector<uint64_t> &hashes,
+                   std::vector<int> &slot_of_key);
+  /**
+   * @param key - a dictionary key
+   * @return the salted hash of key
+   */
+  uint64_t hash_key (std::string_view key) const;
+  /**
+   * @param key_hash - salted hash of a key
+   * @return the bucket of the key
+   */
+  int bucket_of (uint64_t key_hash) const;
+  /**
+   * @param key_hash - salted hash of a key
+   * @param seed - seed of the bucket of the key
+   * @return the slot of the key
+   */
+  int slot_of (uint64_t key_hash, uint32_t seed) const;
+  /**
+   * find the slot of a key, one probe and one compare
+   * @param key - a dictionary key
+   * @return index of the slot, -1 if key doesn't exist
+   */
+  int find_slot (std::string_view key) const;
+  /**
+   * the pair of a slot, pointing into the blob
+   * @param ind_slot - index of the slot
+   * @return the key and value of the slot
+   */
+  pair pair_at (int ind_slot) const;
+
+ public:
+  /**
+   * iterator over the pairs of a frozen dictionary, the pairs are views
+   * into the blob
+   */
+  class ConstIterator
+  {
+   private:
+    const FrozenDictionary *_iter_ptr_map;
+    int _ind_slot;
+    pair _pair;
+
+   public:
+    /**
+     * mandatory typedef for iterator class
+     */
+    typedef pair value_type;
+    typedef const pair &reference;
+    typedef const pair *pointer;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::forward_iterator_tag iterator_category;
+
+    /**
+     * @param frozen_map - a pointer to the frozen dictionary
+     * @param ind_slot - the index of the slot the iterator is at
+     */
+    ConstIterator (const FrozenDictionary *frozen_map, int ind_slot)
+        : _iter_ptr_map (frozen_map), _ind_slot (ind_slot)
+    { load_pair (); }
+
+    /**
+     * gets the next element to iterate to
+     * @return the element after the iteration
+     */
+    const_iterator &operator++ ()
+    {
+      _ind_slot++;
+      load_pair ();
+      return *this;
+    }
+
+    /**
+     * gets the next element to iterate to
+     * @return the element before the iteration
+     */
+    const_iterator operator++ (int)
+    {
+      const ConstIterator it (*this);
+      operator++ ();
+      return it;
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are equal
+     * @return false - iterators are unequal
+     */
+    bool operator== (const ConstIterator &compare_iter) const
+    {
+      return _ind_slot == compare_iter._ind_slot
+             && _iter_ptr_map == compare_iter._iter_ptr_map;
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are unequal
+     * @return false - iterators are equal
+     */
+    bool operator!= (const ConstIterator &compare_iter) const
+    {
+      return !(operator== (compare_iter));
+    }
+
+    /**
+     * dereference to the pair of the iterator is currently at
+     * @return a pair of key and value
+     */
+    reference operator* () const
+    {
+      return _pair;
+    }
+
+    /**
+     * a pointer to the pair
+     * @return a pointer to the pair of key and value
+     */
+    pointer operator-> () const
+    {
+      return &_pair;
+    }
+
+   private:
+    /**
+     * read the pair of the current slot, the end iterator has none
+     */
+    void load_pair ()
+    {
+      if (_ind_slot < _iter_ptr_map->size ())
+      {
+        _pair = _iter_ptr_map->pair_at (_ind_slot);
+      }
+    }
+  };
+};
+
+/** function implementation for FrozenDictionary class - documentation in
+ * class */
+
+inline FrozenDictionary::FrozenDictionary (const Dictionary &dictionary)
+    : _salt (0)
+{
+  std::vector<std::pair<std::string, std::string>> pairs (
+      dictionary.begin (), dictionary.end ());
+  build (pairs);
+}
+
+template<class IteratorT>
+FrozenDictionary::FrozenDictionary (IteratorT begin_iter, IteratorT end_iter)
+    : _salt (0)
+{
+  std::vector<std::pair<std::string, std::string>> pairs;
+  for (auto it = begin_iter; it != end_iter; it++)
+  {
+    auto &&entry = *it;
+    pairs.emplace_back (std::forward<decltype (entry)> (entry).first,
+                        std::forward<decltype (entry)> (entry).second);
+  }
+  remove_repeated_keys (pairs);
+  build (pairs);
+}
+
+inline int FrozenDictionary::size () const
+{
+  return (int) _slots.size ();
+}
+
+inline bool FrozenDictionary::empty () const
+{
+  return _slots.empty ();
+}
+
+inline bool FrozenDictionary::contains_key (std::string_view key) const
+{
+  return find_slot (key) != -1;
+}
+
+inline std::string_view FrozenDictionary::at (std::string_view key) const
+{
+  int ind_slot = find_slot (key);
+  if (ind_slot == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  return pair_at (ind_slot).second;
+}
+
+inline FrozenDictionary::const_iterator
+FrozenDictionary::find (std::string_view key) const
+{
+  int ind_slot = find_slot (key);
+  return ind_slot == -1 ? end () : const_iterator (this, ind_slot);
+}
+
+inline FrozenDictionary::const_iterator FrozenDictionary::begin () const
+{
+  return const_iterator (this, 0);
+}
+
+inline FrozenDictionary::const_iterator FrozenDictionary::end () const
+{
+  return const_iterator (this, size ());
+}
+
+inline FrozenDictionary::const_iterator FrozenDictionary::cbegin () const
+{
+  return begin ();
+}
+
+inline FrozenDictionary::const_iterator FrozenDictionary::cend () const
+{
+  return end ();
+}
+
+inline size_t FrozenDictionary::bytes_allocated () const
+{
+  return _seeds.capacity () * sizeof (uint32_t)
+         + _slots.capacity () * sizeof (slot) + _blob.capacity ();
+}
+
+inline void FrozenDictionary::remove_repeated_keys (
+    std::vector<std::pair<std::string, std::string>> &pairs)
+{
+  std::hash<std::string_view> hash;
+  std::vector<std::pair<size_t, int>> hash_of_pair (pairs.size ());
+  for (int i = 0; i < (int) pairs.size (); i++)
+  {
+    hash_of_pair[i] = {hash (pairs[i].first), i};
+  }
+  std::sort (hash_of_pair.begin (), hash_of_pair.end ());
+  std::vector<bool> repeated (pairs.size (), false);
+  for (size_t run = 0; run < hash_of_pair.size (); run++)
+  {
+    // pairs of the same hash are in order of index, a pair is repeated if
+    // a later one of the same hash has the same key
+    for (size_t later = run + 1; later < hash_of_pair.size ()
+                                 && hash_of_pair[later].first
+                                    == hash_of_pair[run].first; later++)
+    {
+      if (pairs[hash_of_pair[later].second].first
+          == pairs[hash_of_pair[run].second].first)
+      {
+        repeated[hash_of_pair[run].second] = true;
+        break;
+      }
+    }
+  }
+  int kept = 0;
+  for (int i = 0; i < (int) pairs.size (); i++)
+  {
+    if (!repeated[i])
+    {
+      if (kept != i)
+      {
+        pairs[kept] = std::move (pairs[i]);
+      }
+      kept++;
+    }
+  }
+  pairs.resize (kept);
+}
+
+inline void FrozenDictionary::build (
+    std::vector<std::pair<std::string, std::string>> &pairs)
+{
+  int count = (int) pairs.size ();
+  if (count == 0)
+  {
+    return;
+  }
+  _seeds.resize ((count + FROZEN_KEYS_PER_BUCKET - 1)
+                 / FROZEN_KEYS_PER_BUCKET);
+  _slots.resize (count);
+  std::vector<uint64_t> hashes (count);
+  std::vector<int> slot_of_key (count);
+  bool placed = false;
+  for (int attempt = 0; attempt < FROZEN_MAX_ATTEMPTS && !placed; attempt++)
+  {
+    _salt = mix_hash (attempt + 1);
+    for (int i = 0; i < count; i++)
+    {
+      hashes[i] = hash_key (pairs[i].first);
+    }
+    placed = place_keys (hashes, slot_of_key);
+  }
+  if (!placed) // only when two keys keep sharing their hash
+  {
+    throw std::runtime_error (FROZEN_BUILD_ERROR_MSG);
+  }
+  // pack the pairs into the blob in the order of the slots, so iterating
+  // reads the blob from start to end
+  std::vector<int> key_of_slot (count);
+  size_t blob_size = 0;
+  for (int i = 0; i < count; i++)
+  {
+    key_of_slot[slot_of_key[i]] = i;
+    blob_size += pairs[i].first.size () + pairs[i].second.size ();
+  }
+  _blob.reserve (blob_size);
+  for (int ind_slot = 0; ind_slot < count; ind_slot++)
+  {
+    const std::pair<std::string, std::string> &key_value =
+        pairs[key_of_slot[ind_slot]];
+    _slots[ind_slot] = slot{_blob.size (),
+                            (uint32_t) key_value.first.size (),
+                            (uint32_t) key_value.second.size ()};
+    _blob.append (key_value.first).append (key_value.second);
+  }
+}
+
+inline bool FrozenDictionary::place_keys (const std::vector<uint64_t> &hashes,
+                                          std::vector<int> &slot_of_key)
+{
+  int count = (int) hashes.size ();
+  int bucket_count = (int) _seeds.size ();
+  // group the keys by bucket (counting sort), and order the buckets from
+  // the largest: a large bucket needs many free slots at once, which is
+  // easy while the table is still empty
+  std::vector<int> starts (bucket_count + 1, 0);
+  for (int i = 0; i < count; i++)
+  {
+    starts[bucket_of (hashes[i]) + 1]++;
+  }
+  int largest = 0;
+  for (int b = 0; b < bucket_count; b++)
+  {
+    largest = std::max (largest, starts[b + 1]);
+    starts[b + 1] += starts[b];
+  }
+  std::vector<int> keys (count);
+  std::vector<int> next (starts.begin (), starts.end () - 1);
+  for (int i = 0; i < count; i++)
+  {
+    keys[next[bucket_of (hashes[i])]++] = i;
+  }
+  std::vector<std::vector<int>> buckets_of_size (largest + 1);
+  for (int b = 0; b < bucket_count; b++)
+  {
+    buckets_of_size[starts[b + 1] - starts[b]].push_back (b);
+  }
+
+  std::vector<bool> taken (count, false);
+  std::vector<int> slots;
+  for (int size_of_bucket = largest; size_of_bucket > 1; size_of_bucket--)
+  {
+    for (int b : buckets_of_size[size_of_bucket])
+    {
+      bool found = false;
+      for (uint32_t seed = 0; !found && seed < FROZEN_MAX_SEEDS; seed++)
+      {
+        slots.clear ();
+        for (int k = starts[b]; k < starts[b + 1]; k++)
+        {
+          int ind_slot = slot_of (hashes[keys[k]], seed);
+          if (taken[ind_slot] || std::find (slots.begin (), slots.end (),
+                                            ind_slot) != slots.end ())
+          {
+            break;
+          }
+          slots.push_back (ind_slot);
+        }
+        if ((int) slots.size () == size_of_bucket)
+        {
+          found = true;
+          _seeds[b] = seed;
+          for (int k = 0; k < size_of_bucket; k++)
+          {
+            taken[slots[k]] = true;
+            slot_of_key[keys[starts[b] + k]] = slots[k];
+          }
+        }
+      }
+      if (!found)
+      {
+        return false;
+      }
+    }
+  }
+  int free_slot = 0;
+  for (int b : buckets_of_size[1])
+  {
+    while (taken[free_slot])
+    {
+      free_slot++;
+    }
+    taken[free_slot] = true;
+    _seeds[b] = FROZEN_DIRECT_SEED | (uint32_t) free_slot;
+    slot_of_key[keys[starts[b]]] = free_slot;
+  }
+  return true;
+}
+
+inline uint64_t FrozenDictionary::hash_key (std::string_view key) const
+{
+  return mix_hash (std::hash<std::string_view> () (key) ^ _salt);
+}
+
+inline int FrozenDictionary::bucket_of (uint64_t key_hash) const
+{
+  return (int) ((key_hash >> 32) % _seeds.size ());
+}
+
+inline int FrozenDictionary::slot_of (uint64_t key_hash, uint32_t seed) const
+{
+  if (seed & FROZEN_DIRECT_SEED)
+  {
+    return (int) (seed & ~FROZEN_DIRECT_SEED);
+  }
+  return (int) (mix_hash (key_hash + seed * 0x9E3779B97F4A7C15ULL)
+                % _slots.size ());
+}
+
+inline int FrozenDictionary::find_slot (std::string_view key) const
+{
+  if (_slots.empty ())
+  {
+    return -1;
+  }
+  uint64_t key_hash = hash_key (key);
+  int ind_slot = slot_of (key_hash, _seeds[bucket_of (key_hash)]);
+  const slot &key_slot = _slots[ind_slot];
+  if (key_slot.key_size == key.size ()
+      && std::memcmp (_blob.data () + key_slot.offset, key.data (),
+                      key.size ()) == 0)
+  {
+    return ind_slot;
+  }
+  return -1;
+}
+
+inline FrozenDictionary::pair FrozenDictionary::pair_at (int ind_slot) const
+{
+  const slot &pair_slot = _slots[ind_slot];
+  const char *key = _blob.data () + pair_slot.offset;
+  return {std::string_view (key, pair_slot.key_size),
+          std::string_view (key + pair_slot.key_size, pair_slot.value_size)};
+}
+
+#endif //_FROZENDICTIONARY_HPP_
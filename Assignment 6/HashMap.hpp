@@ -4,23 +4,229 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <string>
+#include <string_view>
+#ifdef HASHMAP_STATS
+#include <atomic>
+#include <chrono>
+#endif
 
 #define UPPER_LOAD_FACTOR 0.75
 #define LOWER_LOAD_FACTOR 0.25
 #define INITIAL_CAPACITY 16
+#define OCCUPANCY_WORD_BITS 64
+#define LOOKUP_PREFETCH_DISTANCE 16
 #define VECTOR_LEN_ERROR_MSG "Vectors are not in the same length"
 #define OUT_OF_RANGE_ERROR_MSG "Key is not found"
+#define POLICY_ERROR_MSG "Invalid load factor policy"
 
-template<class KeyT, class ValueT>
+/**
+ * true if a hash (or key equal) function object declares is_transparent,
+ * which means it accepts other key types than the key type of the map
+ */
+template<class T, class = void>
+struct is_transparent : std::false_type
+{
+};
+template<class T>
+struct is_transparent<T, std::void_t<typename T::is_transparent>>
+    : std::true_type
+{
+};
+
+/**
+ * true for a key type K that can be searched in a hash map of KeyT without
+ * building a KeyT from it: with a transparent Hash any K is accepted, and a
+ * map with std::string keys and the default hash accepts anything that
+ * converts to std::string_view (std::string_view, const char *, string
+ * literals)
+ */
+template<class KeyT, class Hash, class K>
+struct is_lookup_key
+    : std::integral_constant<
+        bool, !std::is_same<K, KeyT>::value
+              && (is_transparent<Hash>::value
+                  || (std::is_same<KeyT, std::string>::value
+                      && std::is_same<Hash, std::hash<std::string>>::value
+                      && std::is_convertible<const K &,
+                                             std::string_view>::value))>
+{
+};
+
+/**
+ * finalizer that spreads every bit of a hash over the low bits, which are
+ * the only bits a power of two capacity looks at (xxh3 avalanche)
+ * @param key_hash - a hash value
+ * @return the mixed hash value
+ */
+inline size_t mix_hash (size_t key_hash)
+{
+  unsigned long long h = key_hash;
+  h ^= h >> 37;
+  h *= 0x165667919E3779F9ULL;
+  h ^= h >> 32;
+  return (size_t) h;
+}
+
+/**
+ * a hash function object that runs Hash and mixes its result. std::hash of
+ * integers is the identity, so keys like sequential ids only differ in
+ * their low bits or stride over them and collide once masked. use it as
+ * the Hash of a map: HashMap<int, ValueT, MixHash<int>>
+ */
+template<class KeyT, class Hash = std::hash<KeyT>>
+struct MixHash
+{
+  size_t operator() (const KeyT &key) const
+  {
+    return mix_hash (Hash{} (key));
+  }
+};
+
+/**
+ * when a HashMap grows and shrinks, see HashMap::set_load_factor_policy.
+ * the default policy is UPPER_LOAD_FACTOR and LOWER_LOAD_FACTOR, doubling
+ * on growth and shrinking down to a single bucket
+ * @var max_load_factor - grow when an insert passes it
+ * @var growth_factor - multiply the capacity by it when growing, a power
+ * of two
+ * @var shrink_load_factor - shrink when an erase drops below it, must be
+ * below max_load_factor / growth_factor so that a map that just grew isn't
+ * shrunk back by the next erase
+ * @var min_capacity - never shrink below it, a power of two. a map that
+ * is emptied and refilled (a cache) stops rehashing at every few calls
+ * once it is above the map's usual size
+ * @var shrink - false keeps the capacity when pairs are erased
+ */
+struct LoadFactorPolicy
+{
+  double max_load_factor = UPPER_LOAD_FACTOR;
+  int growth_factor = 2;
+  double shrink_load_factor = LOWER_LOAD_FACTOR;
+  int min_capacity = 1;
+  bool shrink = true;
+};
+
+/**
+ * true when a HashMap stores the hash of every key next to its pair. a key
+ * whose comparison is expensive (std::string) is then only compared with
+ * keys of the same hash, and a rehash or a copy places the pairs without
+ * hashing their keys again. arithmetic, enum and pointer keys hash and
+ * compare in an instruction and aren't worth the extra word per pair.
+ * specialize it for a key type to choose otherwise
+ */
+template<class KeyT>
+struct caches_hash
+    : std::integral_constant<bool, !std::is_arithmetic<KeyT>::value
+                                   && !std::is_enum<KeyT>::value
+                                   && !std::is_pointer<KeyT>::value>
+{
+};
+
+/**
+ * the hash of a key as stored in a bucket of a HashMap, empty when the
+ * key type doesn't cache its hash (see caches_hash)
+ */
+template<bool Cached>
+struct stored_hash
+{
+  size_t hash;
+
+  explicit stored_hash (size_t key_hash) : hash (key_hash)
+  {}
+  /**
+   * @return false if the key of the other hash can't be equal to this key
+   */
+  bool may_equal (size_t key_hash) const
+  { return hash == key_hash; }
+  bool may_equal (const stored_hash &other) const
+  { return hash == other.hash; }
+};
+
+template<>
+struct stored_hash<false>
+{
+  explicit stored_hash (size_t)
+  {}
+  bool may_equal (size_t) const
+  { return true; }
+  bool may_equal (const stored_hash &) const
+  { return true; }
+};
+
+#ifdef HASHMAP_STATS
+/**
+ * statistics of a hash map, returned by HashMap::stats when the code is
+ * compiled with HASHMAP_STATS
+ * @var size - number of pairs
+ * @var capacity - number of buckets
+ * @var lookups - number of buckets scanned for a key (find, insert, erase
+ * and the rest all scan one bucket per key)
+ * @var probes - number of keys compared by those scans, probes / lookups is
+ * the average cost of a lookup
+ * @var max_chain_length - size of the longest bucket
+ * @var rehashes - number of times the hash map was resized
+ * @var rehash_nanoseconds - time spent moving pairs to resized tables
+ * @var bytes_allocated - memory of the bucket arrays, the pairs and the
+ * occupancy bitmaps, without memory that keys and values allocate
+ * themselves
+ * @var bucket_histogram - bucket_histogram[n] is the number of buckets
+ * that hold n pairs
+ */
+struct HashMapStats
+{
+  int size;
+  int capacity;
+  unsigned long long lookups;
+  unsigned long long probes;
+  int max_chain_length;
+  unsigned long long rehashes;
+  unsigned long long rehash_nanoseconds;
+  size_t bytes_allocated;
+  std::vector<int> bucket_histogram;
+};
+#endif
+
+/**
+ * a generic hash map, Hash is the hash function object of the keys
+ * (std::hash by default, MixHash to mix it), KeyEqual compares keys
+ * (operator== by default) and Allocator allocates the pairs of the buckets
+ * and the bucket array itself (see ArenaAllocator in Arena.hpp)
+ */
+template<class KeyT, class ValueT, class Hash = std::hash<KeyT>,
+    class KeyEqual = std::equal_to<>,
+    class Allocator = std::allocator<std::pair<KeyT, ValueT>>>
 class HashMap
 {
  public:
   class ConstIterator;
   typedef ConstIterator const_iterator;
   typedef std::pair<KeyT, ValueT> pair;
-  typedef std::vector<std::pair<KeyT, ValueT>> bucket;
-  typedef HashMap<KeyT, ValueT> HashMapT;
-  typedef std::vector<std::pair<KeyT, ValueT>> *my_hash_map;
+  typedef Allocator allocator_type;
+
+  /**
+   * an element of a bucket: the hash of the key (if the key type caches
+   * it) followed by the pair
+   */
+  struct entry : stored_hash<caches_hash<KeyT>::value>
+  {
+    pair key_value;
+
+    template<class... Args>
+    explicit entry (size_t key_hash, Args &&... args)
+        : stored_hash<caches_hash<KeyT>::value> (key_hash),
+          key_value (std::forward<Args> (args)...)
+    {}
+  };
+
+  typedef std::vector<entry, typename std::allocator_traits<
+      Allocator>::template rebind_alloc<entry>> bucket;
+  typedef HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator> HashMapT;
+  typedef bucket *my_hash_map;
   typedef const std::vector<ValueT> value_vec;
   typedef const std::vector<KeyT> key_vec;
 
@@ -28,18 +234,32 @@ class HashMap
    * default constructor
    */
   HashMap ();
+  /**
+   * constructor of an empty hash map that allocates through allocator
+   * @param allocator - allocator of the pairs and buckets
+   */
+  explicit HashMap (const Allocator &allocator);
   /**
    * copy constructor
    * @param copy_hash_map - a hash map to copy data from
    */
   HashMap (const HashMap &copy_hash_map);
+  /**
+   * move constructor, takes the buckets of move_hash_map without copying
+   * any pair. move_hash_map is left an empty map without buckets, its
+   * first insert allocates them
+   * @param move_hash_map - a hash map to move data from
+   */
+  HashMap (HashMap &&move_hash_map) noexcept;
   /**
    * a constructor that get a vector of keys and values and initializes
    * the a hash map with those keys and values
    * @param keys
    * @param values
+   * @param allocator - allocator of the pairs and buckets
    */
-  HashMap (const key_vec &keys, const value_vec &values);
+  HashMap (const key_vec &keys, const value_vec &values,
+           const Allocator &allocator = Allocator ());
   /**
    * destructor for the hash map
    */
@@ -54,6 +274,12 @@ class HashMap
    * @return an int that represents the capacity
    */
   int capacity () const;
+  /**
+   * grow the hash map once so it can hold n pairs without rehashing,
+   * never shrinks the hash map
+   * @param n - number of pairs to make room for
+   */
+  void reserve (int n);
   /**
    * check if the hash map is empty
    * @return true - the hash map is empty
@@ -69,6 +295,57 @@ class HashMap
    * @return false - the key already exist in hash map
    */
   bool insert (const KeyT &key, const ValueT &value);
+  /**
+   * insert a pair of key and value to the hash map by moving them in,
+   * if key already exist key and value are left untouched
+   * @param key - key to insert
+   * @param value - value to insert
+   * @return true - inserted the key
+   * @return false - the key already exist in hash map
+   */
+  bool insert (KeyT &&key, ValueT &&value);
+  /**
+   * construct a pair from args and insert it if its key doesn't exist
+   * @param args - arguments for the constructor of the pair
+   * @return an iterator to the pair of the key, and true if it was inserted
+   */
+  template<class... Args>
+  std::pair<const_iterator, bool> emplace (Args &&... args);
+  /**
+   * insert key with a value constructed from args, if key already exist
+   * doesn't change the value that was already in hash map and args are
+   * left untouched
+   * @param key - key to insert
+   * @param args - arguments for the constructor of the value
+   * @return an iterator to the pair of key, and true if it was inserted
+   */
+  template<class... Args>
+  std::pair<const_iterator, bool> try_emplace (const KeyT &key,
+                                               Args &&... args);
+  template<class... Args>
+  std::pair<const_iterator, bool> try_emplace (KeyT &&key, Args &&... args);
+  /**
+   * insert a pair of key and value to the hash map,
+   * if key already exist assigns value to it
+   * @param key - key to insert
+   * @param value - value to insert or assign
+   * @return an iterator to the pair of key, and true if it was inserted
+   * (false if it was assigned)
+   */
+  template<class V>
+  std::pair<const_iterator, bool> insert_or_assign (const KeyT &key,
+                                                    V &&value);
+  template<class V>
+  std::pair<const_iterator, bool> insert_or_assign (KeyT &&key, V &&value);
+  /**
+   * search for a key in the hash map
+   * @param key - a hash map key
+   * @return an iterator to the pair of key, end() if key doesn't exist
+   */
+  const_iterator find (const KeyT &key) const;
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  const_iterator find (const K &key) const;
   /**
    * check if a key is in the hash map
    * @param key - a hash map key
@@ -76,6 +353,34 @@ class HashMap
    * @return false - key doesn't exist in map
    */
   bool contains_key (const KeyT &key) const;
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  bool contains_key (const K &key) const;
+  /**
+   * search for many keys, hashing ahead of the comparisons: the bucket of a
+   * key is prefetched 2 * LOOKUP_PREFETCH_DISTANCE keys before the key is
+   * compared and the pairs of the bucket LOOKUP_PREFETCH_DISTANCE keys
+   * before, so the two dependent cache misses of every lookup overlap with
+   * the other lookups instead of stalling one after the other
+   * @param keys_begin - an iterator to the first key
+   * @param keys_end - an iterator past the last key
+   * @param out - receives an iterator per key, end() if the key doesn't
+   * exist
+   * @return out after the last iterator written
+   */
+  template<class ForwardIt, class OutputIt>
+  OutputIt find_many (ForwardIt keys_begin, ForwardIt keys_end,
+                      OutputIt out) const;
+  /**
+   * check if many keys are in the hash map, prefetched like find_many
+   * @param keys_begin - an iterator to the first key
+   * @param keys_end - an iterator past the last key
+   * @param out - receives true or false per key
+   * @return out after the last result written
+   */
+  template<class ForwardIt, class OutputIt>
+  OutputIt contains_many (ForwardIt keys_begin, ForwardIt keys_end,
+                          OutputIt out) const;
   /**
    * gets a key as parameter and return the a value attached to key
    * if key isn't found, raise exception
@@ -83,12 +388,18 @@ class HashMap
    * @return the value attached to key as ref
    */
   ValueT &at (const KeyT &key);
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  ValueT &at (const K &key);
   /**
    * gets a key as parameter and return the value of the key
    * if key isn't found, raise exception
    * @return - the value attached to key as const ref
    */
   const ValueT &at (const KeyT &key) const;
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  const ValueT &at (const K &key) const;
   /**
    * calculate the load factor of the hash map (size / capacity) of hash map
    * @param key - a hash map key
@@ -116,23 +427,63 @@ class HashMap
    * @return false - the key doesn't exist in hash map
    */
   virtual bool erase (const KeyT &key);
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  bool erase (const K &key);
   /**
    * clear all the _buckets in the hashmap,
    * removing all the elements
    */
   void clear ();
+  /**
+   * set how many buckets are migrated per operation when the hash map is
+   * resized. 0 (the default) moves all the pairs at once, otherwise the old
+   * buckets are kept next to the new ones and every insert or erase moves
+   * rehash_step more of them, so no single call pays for the whole map
+   * @param step - number of buckets to migrate per operation
+   */
+  void set_rehash_step (int step);
+  /**
+   * set when the hash map grows and shrinks, raise exception if the policy
+   * is invalid. grows the hash map to the minimum capacity of the policy
+   * @param policy - the load factor policy
+   */
+  void set_load_factor_policy (const LoadFactorPolicy &policy);
+  /**
+   * @return the load factor policy of the hash map
+   */
+  const LoadFactorPolicy &load_factor_policy () const;
+#ifdef HASHMAP_STATS
+  /**
+   * collect the statistics of the hash map, the counters cover the life of
+   * the map (or since reset_stats) and the rest is read from the buckets
+   * @return the statistics of the hash map
+   */
+  HashMapStats stats () const;
+  /**
+   * zero the lookup and rehash counters of the statistics
+   */
+  void reset_stats ();
+#endif
   /**
    * assign a hash map got in parameter to this hash map
    * @param assign_map - map to assign member hash map to
    * @return a reference to this
    */
   HashMapT &operator= (const HashMapT &assign_map);
+  /**
+   * move assign a hash map, the two maps swap their buckets
+   * @param assign_map - map to move from
+   * @return a reference to this
+   */
+  HashMapT &operator= (HashMapT &&assign_map) noexcept;
   /**
    * gets a key and returned the value that attached to key
    * @param key - a hash map's key
    * @return const reference to the value of key
    */
   ValueT &operator[] (const KeyT &key);
+  ValueT &operator[] (KeyT &&key);
   /**
    * gets a key and returned the value that attached to key as reference,
    * if key doesn't exist, append new key and value
@@ -168,10 +519,244 @@ class HashMap
   { return ConstIterator (this, -1, -1); }
 
  private:
+  /**
+   * the place of a key in the hash map: the bucket the key is hashed to,
+   * the index of the pair inside the bucket (-1 if key isn't there) and
+   * the hash of the key, kept for inserting it
+   */
+  struct slot_handle
+  {
+    int ind_bucket;
+    int ind_pair;
+    size_t key_hash;
+  };
+
+  typedef typename std::allocator_traits<Allocator>::template
+  rebind_alloc<bucket> bucket_allocator;
+  typedef std::allocator_traits<bucket_allocator> bucket_traits;
+  // one bit per bucket, set while the bucket holds a pair
+  typedef std::vector<unsigned long long, typename std::allocator_traits<
+      Allocator>::template rebind_alloc<unsigned long long>> occupancy;
+
+  Allocator _allocator;
   int _capacity;
   int _size;
-  ValueT _default_value;
+  Hash _hash;
+  KeyEqual _key_equal;
   my_hash_map _buckets{};
+  int _rehash_step;
+  LoadFactorPolicy _policy;
+#ifdef HASHMAP_STATS
+  /**
+   * counters of the statistics. they are updated by const lookups too, and
+   * readers that share a map (ConcurrentHashMap) update them together, so
+   * they are relaxed atomics: a concurrent update may be lost, but never
+   * torn, and no lock instruction is paid per lookup
+   */
+  struct stats_counters
+  {
+    std::atomic<unsigned long long> lookups{0};
+    std::atomic<unsigned long long> probes{0};
+    std::atomic<unsigned long long> rehashes{0};
+    std::atomic<unsigned long long> rehash_nanoseconds{0};
+
+    stats_counters () = default;
+    stats_counters (const stats_counters &other)
+    { *this = other; }
+    stats_counters &operator= (const stats_counters &other)
+    {
+      lookups.store (other.lookups.load (std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+      probes.store (other.probes.load (std::memory_order_relaxed),
+                    std::memory_order_relaxed);
+      rehashes.store (other.rehashes.load (std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+      rehash_nanoseconds.store (
+          other.rehash_nanoseconds.load (std::memory_order_relaxed),
+          std::memory_order_relaxed);
+      return *this;
+    }
+    static void add (std::atomic<unsigned long long> &counter,
+                     unsigned long long amount)
+    {
+      counter.store (counter.load (std::memory_order_relaxed) + amount,
+                     std::memory_order_relaxed);
+    }
+  };
+  mutable stats_counters _stats;
+#endif
+  /**
+   * adds the time from its construction to its destruction to the rehash
+   * time of the statistics, does nothing without HASHMAP_STATS
+   */
+  struct rehash_timer
+  {
+#ifdef HASHMAP_STATS
+    stats_counters &counters;
+    std::chrono::steady_clock::time_point start;
+
+    explicit rehash_timer (const HashMap &map)
+        : counters (map._stats), start (std::chrono::steady_clock::now ())
+    {}
+    ~rehash_timer ()
+    {
+      stats_counters::add (
+          counters.rehash_nanoseconds,
+          std::chrono::duration_cast<std::chrono::nanoseconds> (
+              std::chrono::steady_clock::now () - start).count ());
+    }
+#else
+    explicit rehash_timer (const HashMap &)
+    {}
+#endif
+  };
+  /**
+   * count a scan of a bucket in the statistics, does nothing without
+   * HASHMAP_STATS
+   * @param probes - number of keys compared by the scan
+   */
+  void count_lookup (int probes) const;
+  // buckets of the table that is being migrated (nullptr when no rehash is
+  // in progress), buckets below _migrated were already moved
+  my_hash_map _old_buckets{};
+  int _old_capacity;
+  int _migrated;
+  // occupancy bitmaps of the current and the old table, iteration and
+  // operator== jump over empty buckets a word of 64 buckets at a time
+  occupancy _occupied;
+  occupancy _old_occupied;
+  /**
+   * allocate an array of empty buckets through the allocator
+   * @param capacity - number of buckets
+   * @return the bucket array, nullptr for 0 buckets
+   */
+  my_hash_map allocate_buckets (int capacity);
+  /**
+   * destroy and free an array of buckets allocated by allocate_buckets
+   * @param buckets - the bucket array, may be nullptr
+   * @param capacity - number of buckets in the array
+   */
+  void deallocate_buckets (my_hash_map buckets, int capacity);
+  /**
+   * get a bucket by its index, indexes from _capacity and on are the
+   * buckets of the old table during an incremental rehash
+   * @param ind_bucket - index of bucket
+   * @return reference to the bucket
+   */
+  bucket &bucket_at (int ind_bucket);
+  const bucket &bucket_at (int ind_bucket) const;
+  /**
+   * @return number of buckets in both tables
+   */
+  int total_buckets () const;
+  /**
+   * mark a bucket as holding pairs or as empty in the occupancy bitmaps
+   * @param ind_bucket - index of bucket, as in bucket_at
+   * @param occupied - true if the bucket holds a pair
+   */
+  void set_occupied (int ind_bucket, bool occupied);
+  /**
+   * find the first bucket that holds a pair, starting from a bucket
+   * @param ind_bucket - index of bucket to start from, as in bucket_at
+   * @return index of the bucket, -1 if all the buckets from ind_bucket on
+   * are empty
+   */
+  int next_occupied (int ind_bucket) const;
+  /**
+   * find the first set bit of a table's bitmap, starting from a bucket
+   * @param bitmap - occupancy bitmap of the table
+   * @param ind_bucket - index of bucket in the table to start from
+   * @param capacity - number of buckets of the table
+   * @return index of the bucket in the table, -1 if there is none
+   */
+  static int scan_occupancy (const occupancy &bitmap, int ind_bucket,
+                             int capacity);
+  /**
+   * @param capacity - number of buckets
+   * @return number of words in the occupancy bitmap of capacity buckets
+   */
+  static int occupancy_words (int capacity);
+  /**
+   * hash key once and scan its bucket once, every lookup, insert and erase
+   * is built on top of this function. a map without buckets (moved from)
+   * finds nothing, emplace_at then allocates the buckets
+   * @param key - hash map's key
+   * @return the slot handle of key
+   */
+  template<class K>
+  slot_handle find_slot (const K &key) const;
+  /**
+   * @param key_hash - the full hash of a key
+   * @return the index of the bucket of the key, as in bucket_at
+   */
+  int bucket_of_hash (size_t key_hash) const;
+  /**
+   * scan a bucket for key, keys of another hash are skipped without being
+   * compared when the hashes are cached
+   * @param ind_bucket - index of the bucket of key, as in bucket_at
+   * @param key_hash - the full hash of key
+   * @param key - hash map's key
+   * @return the slot handle of key
+   */
+  template<class K>
+  slot_handle find_in_bucket (int ind_bucket, size_t key_hash,
+                              const K &key) const;
+  /**
+   * find the slots of many keys with prefetching, see find_many
+   * @param keys_begin - an iterator to the first key
+   * @param keys_end - an iterator past the last key
+   * @param visit - called with the slot handle of every key, in order
+   */
+  template<class ForwardIt, class Visit>
+  void find_slots (ForwardIt keys_begin, ForwardIt keys_end,
+                   Visit visit) const;
+  /**
+   * @param handle - a handle returned by find_slot
+   * @return the value of the pair of handle, raise exception if the key
+   * of handle wasn't found
+   */
+  ValueT &value_at (slot_handle handle);
+  const ValueT &value_at (slot_handle handle) const;
+  /**
+   * remove the pair of handle and shrink the hash map if needed
+   * @param handle - a handle returned by find_slot
+   * @return true if a pair was removed, false if the key wasn't found
+   */
+  bool erase_at (slot_handle handle);
+  /**
+   * append a new pair to the bucket of handle, key must not be in the map.
+   * grows the hash map if needed, before key is moved into the pair
+   * @param handle - a handle returned by find_slot for key
+   * @param key - key to insert
+   * @param args - arguments for the constructor of the value
+   * @return the handle of the inserted pair
+   */
+  template<class K, class... Args>
+  slot_handle emplace_at (slot_handle handle, K &&key, Args &&... args);
+  /**
+   * find key, if it doesn't exist insert it with a value constructed from
+   * args. shared by insert, try_emplace and operator[]
+   * @param key - key to find or insert
+   * @param args - arguments for the constructor of the value
+   * @return the handle of the pair of key, and true if it was inserted
+   */
+  template<class K, class... Args>
+  std::pair<slot_handle, bool> try_emplace_slot (K &&key, Args &&... args);
+  /**
+   * find key, insert it with value or assign value to it.
+   * shared by the insert_or_assign overloads
+   * @param key - key to find or insert
+   * @param value - value to insert or assign
+   * @return the handle of the pair of key, and true if it was inserted
+   */
+  template<class K, class V>
+  std::pair<slot_handle, bool> insert_or_assign_slot (K &&key, V &&value);
+  /**
+   * @param handle - a handle returned by find_slot
+   * @return an iterator to the pair of handle, end() if the key of handle
+   * wasn't found
+   */
+  const_iterator iterator_at (slot_handle handle) const;
   /**
    * if load factor is out of range, this function
    * find the capacity that updated capacity
@@ -179,18 +764,54 @@ class HashMap
    */
   int find_new_capacity ();
   /**
-   * a hashing function, get a key and return the
-   * index to insert it in hash map
-   * @param key - hash map's key
-   * @return an int from the hashing func
+   * @param n - number of pairs
+   * @return the smallest capacity (starting from INITIAL_CAPACITY or the
+   * minimum capacity of the policy) that holds n pairs without passing the
+   * maximum load factor
+   */
+  int capacity_for (int n) const;
+  /**
+   * the full hash of a key, lookup keys hash the same as the key with the
+   * same characters
+   * @param key - hash map's key or lookup key
+   * @return the hash of key
    */
-  int hashing (const KeyT &key) const;
+  size_t hash_key (const KeyT &key) const;
+  template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+      int>::type = 0>
+  size_t hash_key (const K &key) const;
   /**
-   * gets new capacity and initialize a new hash map according
-   * to the new capacity
+   * the full hash of the key of an entry, read from the entry when it is
+   * cached
+   * @param element - an entry of a bucket
+   * @return the hash of its key
+   */
+  size_t entry_hash (const entry &element) const;
+  /**
+   * gets new capacity and allocates the buckets of the new capacity, the
+   * current buckets become the old table and are migrated at once or
+   * incrementally according to the rehash step
    * @param new_capacity - new capacity to rehash the Hashmap to
    */
   void rehashing (int new_capacity);
+  /**
+   * move the pairs of the next old bucket to the new table, pairs are
+   * moved and not copied and no duplicate check is needed
+   */
+  void migrate_bucket ();
+  /**
+   * migrate rehash_step old buckets, if an incremental rehash is in progress
+   */
+  void rehash_step ();
+  /**
+   * migrate all the old buckets that are left
+   */
+  void finish_rehash ();
+  /**
+   * copy all pairs of another hash map to the (empty) buckets of this map
+   * @param other - map to copy from
+   */
+  void copy_pairs (const HashMapT &other);
 
  public:
   /**
@@ -236,18 +857,22 @@ class HashMap
      */
     void find_next_element ()
     {
-      for (int i = _ind_bucket; i < _iter_ptr_map->_capacity; ++i)
+      // the next bucket that holds pairs is usually in the same word of
+      // the bitmap, find it here before calling next_occupied
+      _ind_pair = 0;
+      if (_ind_bucket < _iter_ptr_map->_capacity)
       {
-        const bucket &bucket = _iter_ptr_map->_buckets[i];
-        if (!bucket.empty ())
+        unsigned long long word =
+            _iter_ptr_map->_occupied[_ind_bucket / OCCUPANCY_WORD_BITS]
+            >> (_ind_bucket % OCCUPANCY_WORD_BITS);
+        if (word != 0)
         {
-          this->_ind_bucket = i;
-          this->_ind_pair = 0;
+          _ind_bucket += __builtin_ctzll (word);
           return;
         }
       }
-      _ind_bucket = -1;
-      _ind_pair = -1;
+      _ind_bucket = _iter_ptr_map->next_occupied (_ind_bucket);
+      _ind_pair = _ind_bucket == -1 ? -1 : 0;
     }
     /**
      * gets the next element to iterate to
@@ -255,7 +880,7 @@ class HashMap
      */
     const_iterator &operator++ ()
     {
-      if (_ind_pair + 1 == (int) _iter_ptr_map->_buckets[_ind_bucket].size ())
+      if (_ind_pair + 1 == (int) _iter_ptr_map->bucket_at (_ind_bucket).size ())
       {
         _ind_bucket++;
         find_next_element ();
@@ -306,7 +931,7 @@ class HashMap
      */
     reference operator* () const
     {
-      return _iter_ptr_map->_buckets[_ind_bucket][_ind_pair];
+      return _iter_ptr_map->bucket_at (_ind_bucket)[_ind_pair].key_value;
     }
 
     /**
@@ -322,162 +947,910 @@ class HashMap
 
 /** function implementation for HashMap class - documentation in class */
 
-template<class KeyT, class ValueT>
-HashMap<KeyT, ValueT>::HashMap ()
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::HashMap ()
+    : HashMap (Allocator ())
+{}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::HashMap (
+    const Allocator &allocator)
+    : _allocator (allocator), _occupied (_allocator),
+      _old_occupied (_allocator)
 {
   _capacity = INITIAL_CAPACITY;
   _size = 0;
-  _buckets = new bucket[INITIAL_CAPACITY];
+  _buckets = allocate_buckets (INITIAL_CAPACITY);
+  _rehash_step = 0, _old_capacity = 0, _migrated = 0;
+  _occupied.assign (occupancy_words (INITIAL_CAPACITY), 0);
 }
 
-template<class KeyT, class ValueT>
-HashMap<KeyT, ValueT>::HashMap (const key_vec &keys, const value_vec &values)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::HashMap (
+    const key_vec &keys, const value_vec &values, const Allocator &allocator)
+    : HashMap (allocator)
 {
   if (keys.size () != values.size ())
   {
     throw std::length_error (VECTOR_LEN_ERROR_MSG);
   }
-  _size = 0;
-  _capacity = INITIAL_CAPACITY;
-  _buckets = new bucket[_capacity];
+  // bulk load: size the buckets once for all the keys and append the pairs
+  // without checking the load factor on every insert
+  reserve ((int) keys.size ());
   for (int i = (int) keys.size () - 1; i >= 0; --i)
   {
-    if (contains_key (keys[i]))
-    {
-      continue;
-    }
-    else
+    slot_handle handle = find_slot (keys[i]);
+    if (handle.ind_pair == -1) // skipped if the key already exists
     {
-      insert (keys[i], values[i]);
+      _buckets[handle.ind_bucket].emplace_back (handle.key_hash, keys[i],
+                                                values[i]);
+      set_occupied (handle.ind_bucket, true);
+      _size++;
     }
   }
+  // with repeated keys, fit the capacity to what inserting one by one gives
+  if (capacity_for (_size) < _capacity)
+  {
+    rehashing (capacity_for (_size));
+  }
 }
 
-template<class KeyT, class ValueT>
-HashMap<KeyT, ValueT>::HashMap (const HashMap &copy_hash_map)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::HashMap (
+    const HashMap &copy_hash_map)
+    : _allocator (std::allocator_traits<Allocator>::
+                  select_on_container_copy_construction (
+        copy_hash_map._allocator)),
+      _occupied (_allocator), _old_occupied (_allocator)
 {
   _capacity = copy_hash_map._capacity;
   _size = copy_hash_map._size;
-  _buckets = new bucket[_capacity];
-  const my_hash_map &other_map = copy_hash_map._buckets;
-  for (int i = 0; i < _capacity; ++i)
+  _buckets = allocate_buckets (_capacity);
+  _occupied.assign (occupancy_words (_capacity), 0);
+  _rehash_step = copy_hash_map._rehash_step;
+  _policy = copy_hash_map._policy;
+  _hash = copy_hash_map._hash, _key_equal = copy_hash_map._key_equal;
+  _old_capacity = 0, _migrated = 0;
+  copy_pairs (copy_hash_map);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::HashMap (
+    HashMap &&move_hash_map) noexcept
+    : _allocator (std::move (move_hash_map._allocator)),
+      _capacity (move_hash_map._capacity), _size (move_hash_map._size),
+      _hash (std::move (move_hash_map._hash)),
+      _key_equal (std::move (move_hash_map._key_equal)),
+      _buckets (move_hash_map._buckets),
+      _rehash_step (move_hash_map._rehash_step),
+      _policy (move_hash_map._policy),
+      _old_buckets (move_hash_map._old_buckets),
+      _old_capacity (move_hash_map._old_capacity),
+      _migrated (move_hash_map._migrated),
+      _occupied (std::move (move_hash_map._occupied)),
+      _old_occupied (std::move (move_hash_map._old_occupied))
+{
+  move_hash_map._buckets = nullptr, move_hash_map._old_buckets = nullptr;
+  move_hash_map._capacity = 0, move_hash_map._size = 0;
+  move_hash_map._occupied.clear (), move_hash_map._old_occupied.clear ();
+#ifdef HASHMAP_STATS
+  _stats = move_hash_map._stats;
+#endif
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::~HashMap ()
+{
+  deallocate_buckets (_buckets, _capacity);
+  deallocate_buckets (_old_buckets, _old_capacity);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::size () const
+{
+  return _size;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::capacity () const
+{
+  return _capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::reserve (int n)
+{
+  int new_capacity = capacity_for (n);
+  if (new_capacity > _capacity)
+  {
+    rehashing (new_capacity);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::empty () const
+{
+  return (_size == 0);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::insert (
+    const KeyT &key, const ValueT &value)
+{
+  return try_emplace_slot (key, value).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::insert (
+    KeyT &&key, ValueT &&value)
+{
+  return try_emplace_slot (std::move (key), std::move (value)).second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class... Args>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::emplace (Args &&... args)
+{
+  rehash_step ();
+  pair entry (std::forward<Args> (args)...);
+  slot_handle handle = find_slot (entry.first);
+  bool inserted = false;
+  if (handle.ind_pair == -1) // key doesn't exist
+  {
+    handle = emplace_at (handle, std::move (entry.first),
+                         std::move (entry.second));
+    inserted = true;
+  }
+  return {iterator_at (handle), inserted};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class... Args>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::try_emplace (
+    const KeyT &key, Args &&... args)
+{
+  std::pair<slot_handle, bool> result =
+      try_emplace_slot (key, std::forward<Args> (args)...);
+  return {iterator_at (result.first), result.second};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class... Args>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::try_emplace (
+    KeyT &&key, Args &&... args)
+{
+  std::pair<slot_handle, bool> result =
+      try_emplace_slot (std::move (key), std::forward<Args> (args)...);
+  return {iterator_at (result.first), result.second};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class V>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::insert_or_assign (
+    const KeyT &key, V &&value)
+{
+  std::pair<slot_handle, bool> result =
+      insert_or_assign_slot (key, std::forward<V> (value));
+  return {iterator_at (result.first), result.second};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class V>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::insert_or_assign (
+    KeyT &&key, V &&value)
+{
+  std::pair<slot_handle, bool> result =
+      insert_or_assign_slot (std::move (key), std::forward<V> (value));
+  return {iterator_at (result.first), result.second};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find (const KeyT &key) const
+{
+  return iterator_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find (const K &key) const
+{
+  return iterator_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::contains_key (
+    const KeyT &key) const
+{
+  return find_slot (key).ind_pair != -1;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::contains_key (
+    const K &key) const
+{
+  return find_slot (key).ind_pair != -1;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class ForwardIt, class OutputIt>
+OutputIt HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find_many (
+    ForwardIt keys_begin, ForwardIt keys_end, OutputIt out) const
+{
+  find_slots (keys_begin, keys_end, [this, &out] (slot_handle handle)
+  { *out++ = iterator_at (handle); });
+  return out;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class ForwardIt, class OutputIt>
+OutputIt HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::contains_many (
+    ForwardIt keys_begin, ForwardIt keys_end, OutputIt out) const
+{
+  find_slots (keys_begin, keys_end, [&out] (slot_handle handle)
+  { *out++ = handle.ind_pair != -1; });
+  return out;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+const ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::at (const KeyT &key) const
+{
+  return value_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+const ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::at (const K &key) const
+{
+  return value_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+ValueT &HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::at (const KeyT &key)
+{
+  return value_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+ValueT &HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::at (const K &key)
+{
+  return value_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::erase (const KeyT &key)
+{
+  rehash_step ();
+  return erase_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::erase (const K &key)
+{
+  rehash_step ();
+  return erase_at (find_slot (key));
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+double
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::get_load_factor () const
+{
+  if (_capacity == 0) // moved from
+  {
+    return 0;
+  }
+  double size = _size;
+  double capacity = _capacity;
+  return size / capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket_size (
+    const KeyT &key) const
+{
+  slot_handle handle = find_slot (key);
+  if (handle.ind_pair == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  int size_of_bucket = (int) bucket_at (handle.ind_bucket).size ();
+  return size_of_bucket;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket_index (
+    const KeyT &key) const
+{
+  slot_handle handle = find_slot (key);
+  if (handle.ind_pair == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  // a key that wasn't migrated yet is reported by its index in the old table
+  return handle.ind_bucket < _capacity ? handle.ind_bucket
+                                       : handle.ind_bucket - _capacity;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::clear ()
+{
+  if (_buckets == nullptr) // a moved from map gets new buckets
   {
-    if (!other_map[i].empty ())
+    _capacity = capacity_for (0);
+    _buckets = allocate_buckets (_capacity);
+  }
+  for (int i = 0; i < _capacity; i++)
+  { _buckets[i].clear (); }
+  deallocate_buckets (_old_buckets, _old_capacity);
+  _old_buckets = nullptr;
+  _occupied.assign (occupancy_words (_capacity), 0);
+  _old_occupied.clear ();
+  _size = 0;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::set_rehash_step (int step)
+{
+  _rehash_step = step;
+  if (_rehash_step <= 0)
+  {
+    _rehash_step = 0;
+    rehash_timer timer (*this);
+    finish_rehash ();
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::set_load_factor_policy (
+    const LoadFactorPolicy &policy)
+{
+  bool power_of_two_growth = policy.growth_factor >= 2
+      && (policy.growth_factor & (policy.growth_factor - 1)) == 0;
+  bool power_of_two_minimum = policy.min_capacity >= 1
+      && (policy.min_capacity & (policy.min_capacity - 1)) == 0;
+  if (!(policy.max_load_factor > 0) || !power_of_two_growth
+      || !power_of_two_minimum || policy.shrink_load_factor < 0
+      || !(policy.shrink_load_factor * policy.growth_factor
+           < policy.max_load_factor))
+  {
+    throw std::invalid_argument (POLICY_ERROR_MSG);
+  }
+  _policy = policy;
+  if (_buckets != nullptr && _capacity < _policy.min_capacity)
+  {
+    rehashing (_policy.min_capacity);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+const LoadFactorPolicy &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::load_factor_policy () const
+{
+  return _policy;
+}
+
+#ifdef HASHMAP_STATS
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMapStats HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::stats () const
+{
+  HashMapStats stats{};
+  stats.size = _size;
+  stats.capacity = _capacity;
+  stats.lookups = _stats.lookups.load (std::memory_order_relaxed);
+  stats.probes = _stats.probes.load (std::memory_order_relaxed);
+  stats.rehashes = _stats.rehashes.load (std::memory_order_relaxed);
+  stats.rehash_nanoseconds =
+      _stats.rehash_nanoseconds.load (std::memory_order_relaxed);
+  stats.bytes_allocated =
+      total_buckets () * sizeof (bucket)
+      + (_occupied.capacity () + _old_occupied.capacity ())
+        * sizeof (unsigned long long);
+  for (int i = 0; i < total_buckets (); i++)
+  {
+    const bucket &vec = bucket_at (i);
+    int size_of_bucket = (int) vec.size ();
+    stats.bytes_allocated += vec.capacity () * sizeof (entry);
+    stats.max_chain_length = std::max (stats.max_chain_length,
+                                       size_of_bucket);
+    if (size_of_bucket >= (int) stats.bucket_histogram.size ())
     {
-      bucket vec (other_map[i]);
-      _buckets[i] = vec;
+      stats.bucket_histogram.resize (size_of_bucket + 1);
     }
+    stats.bucket_histogram[size_of_bucket]++;
   }
+  return stats;
 }
 
-template<class KeyT, class ValueT>
-HashMap<KeyT, ValueT>::~HashMap ()
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::reset_stats ()
 {
-  delete[] _buckets;
+  _stats.lookups = 0, _stats.probes = 0;
+  _stats.rehashes = 0, _stats.rehash_nanoseconds = 0;
 }
+#endif
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::size () const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator> &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator= (
+    const HashMapT &assign_map)
 {
-  return _size;
+  if (&assign_map == this)
+  { return *this; }
+  deallocate_buckets (_buckets, _capacity);
+  deallocate_buckets (_old_buckets, _old_capacity);
+  _old_buckets = nullptr;
+  _capacity = assign_map._capacity, _size = assign_map._size;
+  _rehash_step = assign_map._rehash_step;
+  _policy = assign_map._policy;
+  _hash = assign_map._hash, _key_equal = assign_map._key_equal;
+  _buckets = allocate_buckets (_capacity);
+  _occupied.assign (occupancy_words (_capacity), 0);
+  _old_occupied.clear ();
+  copy_pairs (assign_map);
+  return *this;
 }
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::capacity () const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator> &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator= (
+    HashMapT &&assign_map)
+noexcept
 {
-  return _capacity;
+  // assign_map gets the buckets of this map and frees them when destroyed
+  std::swap (_capacity, assign_map._capacity);
+  std::swap (_size, assign_map._size);
+  std::swap (_buckets, assign_map._buckets);
+  std::swap (_rehash_step, assign_map._rehash_step);
+  std::swap (_policy, assign_map._policy);
+#ifdef HASHMAP_STATS
+  std::swap (_stats, assign_map._stats);
+#endif
+  std::swap (_old_buckets, assign_map._old_buckets);
+  std::swap (_old_capacity, assign_map._old_capacity);
+  std::swap (_migrated, assign_map._migrated);
+  std::swap (_hash, assign_map._hash);
+  std::swap (_key_equal, assign_map._key_equal);
+  _occupied.swap (assign_map._occupied);
+  _old_occupied.swap (assign_map._old_occupied);
+  // the buckets are swapped together with the allocator that owns them
+  std::swap (_allocator, assign_map._allocator);
+  return *this;
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::empty () const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator[] (const KeyT &key)
 {
-  return (_size == 0);
+  slot_handle handle = try_emplace_slot (key).first;
+  return bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second;
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::insert (const KeyT &key, const ValueT &value)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator[] (KeyT &&key)
 {
-  if (contains_key (key)) // check if key exists
+  slot_handle handle = try_emplace_slot (std::move (key)).first;
+  return bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+const ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator[] (
+    const KeyT &key) const
+{
+  static const ValueT default_value{};
+  slot_handle handle = find_slot (key);
+  if (handle.ind_pair == -1)
+  {
+    return default_value;
+  }
+  return bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator== (
+    const HashMapT &compare_map) const
+{
+  if (_size != compare_map._size)
   {
     return false;
   }
-  int index = hashing (key);
-  bucket &vec = this->_buckets[index];
-  vec.push_back ({key, value});
-  _size++;
-  if (UPPER_LOAD_FACTOR < get_load_factor () && _size != 0)
+  // with the same stateless hash, the same capacity and no rehash in
+  // progress, equal maps hold the same keys in the same buckets: compare
+  // the bitmaps and then the buckets side by side, without hashing a key
+  if (std::is_empty<Hash>::value && _capacity == compare_map._capacity
+      && _old_buckets == nullptr && compare_map._old_buckets == nullptr)
   {
-    int new_capacity = find_new_capacity ();
-    rehashing (new_capacity);
+    if (_occupied != compare_map._occupied)
+    {
+      return false;
+    }
+    for (int i = next_occupied (0); i != -1; i = next_occupied (i + 1))
+    {
+      const bucket &my_bucket = _buckets[i];
+      const bucket &compare_bucket = compare_map._buckets[i];
+      if (my_bucket.size () != compare_bucket.size ())
+      {
+        return false;
+      }
+      for (const entry &cur_entry : compare_bucket)
+      {
+        const pair &cur_pair = cur_entry.key_value;
+        auto found = std::find_if (
+            my_bucket.begin (), my_bucket.end (), [&] (const entry &my_entry)
+            {
+              return my_entry.may_equal (cur_entry)
+                     && _key_equal (my_entry.key_value.first, cur_pair.first);
+            });
+        if (found == my_bucket.end ()
+            || found->key_value.second != cur_pair.second)
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+  for (const pair &cur_pair : compare_map)
+  {
+    slot_handle handle = find_slot (cur_pair.first);
+    if (handle.ind_pair == -1)
+    { return false; }
+    else
+    {
+      const ValueT &value = bucket_at (handle.ind_bucket)[handle.ind_pair]
+          .key_value.second;
+      if (value != cur_pair.second)
+      { return false; }
+    }
   }
   return true;
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::contains_key (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::operator!= (
+    const HashMapT &compare_map) const
+{
+  return !operator== (compare_map);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+size_t HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::hash_key (
+    const KeyT &key) const
+{
+  return _hash (key);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, typename std::enable_if<is_lookup_key<KeyT, Hash, K>::value,
+    int>::type>
+size_t
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::hash_key (const K &key) const
 {
-  int index = hashing (key);
-  bucket &vec = this->_buckets[index];
-  for (size_t i = 0; i < vec.size (); i++)
+  if constexpr (is_transparent<Hash>::value)
   {
-    if (vec[i].first == key)
-    { return true; }
+    return _hash (key);
   }
-  return false;
+  else
+  {
+    // std::hash of a std::string_view equals std::hash of a std::string
+    return std::hash<std::string_view>{} (std::string_view (key));
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+size_t HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::entry_hash (
+    const entry &element) const
+{
+  if constexpr (caches_hash<KeyT>::value)
+  {
+    return element.hash;
+  }
+  else
+  {
+    return hash_key (element.key_value.first);
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::slot_handle
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find_slot (const K &key) const
+{
+  size_t key_hash = hash_key (key);
+  if (_capacity == 0) // moved from, no buckets to scan
+  {
+    return slot_handle{-1, -1, key_hash};
+  }
+  return find_in_bucket (bucket_of_hash (key_hash), key_hash, key);
 }
 
-template<class KeyT, class ValueT>
-const ValueT &HashMap<KeyT, ValueT>::at (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket_of_hash (
+    size_t key_hash) const
 {
-  if (contains_key (key))
+  int index = key_hash & (_capacity - 1);
+  if (_old_buckets != nullptr)
   {
-    int index = hashing (key);
-    const bucket &my_bucket = _buckets[index];
-    for (size_t i = 0; i < my_bucket.size (); i++)
+    // buckets of the old table are migrated in order, a key whose old bucket
+    // wasn't migrated yet is still there
+    int old_index = key_hash & (_old_capacity - 1);
+    if (old_index >= _migrated)
     {
-      const KeyT &searched_key = my_bucket[i].first;
-      if (key == searched_key)
-      {
-        return my_bucket[i].second;
-      }
+      index = _capacity + old_index;
     }
   }
-  throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  return index;
 }
 
-template<class KeyT, class ValueT>
-ValueT &HashMap<KeyT, ValueT>::at (const KeyT &key)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::slot_handle
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find_in_bucket (
+    int ind_bucket, size_t key_hash, const K &key) const
 {
-  if (contains_key (key))
+  const bucket &vec = bucket_at (ind_bucket);
+  for (int i = 0; i < (int) vec.size (); i++)
   {
-    int index = hashing (key);
-    bucket &my_bucket = _buckets[index];
-    for (size_t i = 0; i < my_bucket.size (); i++)
+    if (vec[i].may_equal (key_hash) && _key_equal (vec[i].key_value.first, key))
     {
-      const KeyT &searched_key = my_bucket[i].first;
-      if (key == searched_key)
+      count_lookup (i + 1);
+      return slot_handle{ind_bucket, i, key_hash};
+    }
+  }
+  count_lookup ((int) vec.size ());
+  return slot_handle{ind_bucket, -1, key_hash};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class ForwardIt, class Visit>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find_slots (
+    ForwardIt keys_begin, ForwardIt keys_end, Visit visit) const
+{
+  if (_capacity == 0) // moved from, no buckets to scan
+  {
+    for (ForwardIt it = keys_begin; it != keys_end; ++it)
+    {
+      visit (find_slot (*it));
+    }
+    return;
+  }
+  // ring of the hashes and bucket indexes of the keys hashed and not
+  // compared yet
+  size_t hashes[2 * LOOKUP_PREFETCH_DISTANCE];
+  int indexes[2 * LOOKUP_PREFETCH_DISTANCE];
+  ForwardIt hashed = keys_begin;
+  size_t hashed_count = 0, prefetched_count = 0, resolved_count = 0;
+  for (ForwardIt it = keys_begin; it != keys_end; ++it, ++resolved_count)
+  {
+    for (; hashed != keys_end
+           && hashed_count < resolved_count + 2 * LOOKUP_PREFETCH_DISTANCE;
+         ++hashed, ++hashed_count)
+    {
+      size_t key_hash = hash_key (*hashed);
+      int index = bucket_of_hash (key_hash);
+      hashes[hashed_count % (2 * LOOKUP_PREFETCH_DISTANCE)] = key_hash;
+      indexes[hashed_count % (2 * LOOKUP_PREFETCH_DISTANCE)] = index;
+      __builtin_prefetch (&bucket_at (index));
+    }
+    // the bucket arrived meanwhile, prefetch the pairs it points to
+    for (; prefetched_count < hashed_count
+           && prefetched_count < resolved_count + LOOKUP_PREFETCH_DISTANCE;
+         ++prefetched_count)
+    {
+      const bucket &vec = bucket_at (
+          indexes[prefetched_count % (2 * LOOKUP_PREFETCH_DISTANCE)]);
+      if (!vec.empty ())
       {
-        return my_bucket[i].second;
+        __builtin_prefetch (vec.data ());
       }
     }
+    int ring = resolved_count % (2 * LOOKUP_PREFETCH_DISTANCE);
+    visit (find_in_bucket (indexes[ring], hashes[ring], *it));
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, class... Args>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::slot_handle
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::emplace_at (
+    slot_handle handle, K &&key, Args &&... args)
+{
+  if (_policy.max_load_factor < double (_size + 1) / (double) _capacity)
+  {
+    // a moved from map has no buckets and grows to the smallest table
+    rehashing (_capacity == 0 ? capacity_for (_size + 1)
+                              : _capacity * _policy.growth_factor);
+    // the bucket of key changed
+    handle.ind_bucket = bucket_of_hash (handle.key_hash);
+  }
+  bucket &vec = bucket_at (handle.ind_bucket);
+  vec.emplace_back (handle.key_hash, std::piecewise_construct,
+                    std::forward_as_tuple (std::forward<K> (key)),
+                    std::forward_as_tuple (std::forward<Args> (args)...));
+  set_occupied (handle.ind_bucket, true);
+  _size++;
+  return slot_handle{handle.ind_bucket, (int) vec.size () - 1,
+                     handle.key_hash};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, class... Args>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::slot_handle,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::try_emplace_slot (
+    K &&key, Args &&... args)
+{
+  rehash_step ();
+  slot_handle handle = find_slot (key);
+  if (handle.ind_pair != -1) // key exists
+  {
+    return {handle, false};
+  }
+  handle = emplace_at (handle, std::forward<K> (key),
+                       std::forward<Args> (args)...);
+  return {handle, true};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+template<class K, class V>
+std::pair<
+    typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::slot_handle,
+    bool>
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::insert_or_assign_slot (
+    K &&key, V &&value)
+{
+  rehash_step ();
+  slot_handle handle = find_slot (key);
+  if (handle.ind_pair != -1)
+  {
+    bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second =
+        std::forward<V> (value);
+    return {handle, false};
+  }
+  handle = emplace_at (handle, std::forward<K> (key), std::forward<V> (value));
+  return {handle, true};
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::const_iterator
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::iterator_at (
+    slot_handle handle) const
+{
+  if (handle.ind_pair == -1)
+  {
+    return end ();
+  }
+  return ConstIterator (this, handle.ind_bucket, handle.ind_pair);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::value_at (slot_handle handle)
+{
+  if (handle.ind_pair == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  return bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+const ValueT &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::value_at (
+    slot_handle handle) const
+{
+  if (handle.ind_pair == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
   }
-  throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  return bucket_at (handle.ind_bucket)[handle.ind_pair].key_value.second;
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::erase (const KeyT &key)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+bool
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::erase_at (slot_handle handle)
 {
-  if (!contains_key (key)) // if key exists
+  if (handle.ind_pair == -1) // if key doesn't exist
   {
     return false;
   }
   _size--; // decrease size (remove item from hashmap)
-  int index = hashing (key);
-  bucket &my_bucket = _buckets[index];
-  pair my_pair = std::make_pair (key, at (key));
-  my_bucket.erase (std::remove (my_bucket.begin (), my_bucket.end (),
-                                my_pair), my_bucket.end ());
-  if (get_load_factor () < LOWER_LOAD_FACTOR)
+  bucket &my_bucket = bucket_at (handle.ind_bucket);
+  my_bucket.erase (my_bucket.begin () + handle.ind_pair);
+  if (my_bucket.empty ())
+  {
+    set_occupied (handle.ind_bucket, false);
+  }
+  if (_policy.shrink && _capacity > _policy.min_capacity
+      && get_load_factor () < _policy.shrink_load_factor)
   {
     int new_capacity = find_new_capacity ();
     rehashing (new_capacity);
@@ -485,167 +1858,352 @@ bool HashMap<KeyT, ValueT>::erase (const KeyT &key)
   return true;
 }
 
-template<class KeyT, class ValueT>
-double HashMap<KeyT, ValueT>::get_load_factor () const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::rehashing (int new_capacity)
 {
-  double size = _size;
-  double capacity = _capacity;
-  return size / capacity;
+  rehash_timer timer (*this);
+#ifdef HASHMAP_STATS
+  stats_counters::add (_stats.rehashes, 1);
+#endif
+  finish_rehash (); // at most one old table at a time
+  _old_buckets = _buckets;
+  _old_capacity = _capacity, _migrated = 0;
+  _buckets = allocate_buckets (new_capacity);
+  _capacity = new_capacity;
+  _old_occupied.swap (_occupied);
+  _occupied.assign (occupancy_words (new_capacity), 0);
+  if (_rehash_step == 0)
+  {
+    finish_rehash ();
+  }
 }
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::bucket_size (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::migrate_bucket ()
 {
-  if (!contains_key (key))
+  bucket &old_bucket = _old_buckets[_migrated];
+  for (entry &cur_entry : old_bucket)
   {
-    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+    int ind_bucket = entry_hash (cur_entry) & (_capacity - 1);
+    _buckets[ind_bucket].push_back (std::move (cur_entry));
+    set_occupied (ind_bucket, true);
+  }
+  bucket (_allocator).swap (old_bucket); // release the memory of the bucket
+  set_occupied (_capacity + _migrated, false);
+  _migrated++;
+  if (_migrated == _old_capacity)
+  {
+    deallocate_buckets (_old_buckets, _old_capacity);
+    _old_buckets = nullptr;
+    _old_occupied.clear ();
   }
-  int ind = hashing (key);
-  int size_of_bucket = (int) _buckets[ind].size ();
-  return size_of_bucket;
 }
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::bucket_index (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::rehash_step ()
 {
-  if (!(contains_key (key)))
+  if (_old_buckets == nullptr)
   {
-    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+    return;
+  }
+  rehash_timer timer (*this);
+  for (int i = 0; i < _rehash_step && _old_buckets != nullptr; i++)
+  {
+    migrate_bucket ();
   }
-  int index = hashing (key);
-  return index;
 }
 
-template<class KeyT, class ValueT>
-void HashMap<KeyT, ValueT>::clear ()
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::finish_rehash ()
 {
-  for (int i = 0; i < _capacity; i++)
-  { _buckets[i].clear (); }
-  _size = 0;
+  while (_old_buckets != nullptr)
+  {
+    migrate_bucket ();
+  }
 }
 
-template<class KeyT, class ValueT>
-HashMap<KeyT, ValueT> &
-HashMap<KeyT, ValueT>::operator= (const HashMapT &assign_map)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::copy_pairs (
+    const HashMapT &other)
 {
-  if (&assign_map == this)
-  { return *this; }
-  delete[] _buckets;
-  _capacity = assign_map._capacity, _size = assign_map._size;
-  _buckets = new bucket[_capacity];
-  const my_hash_map &assign_from_map = assign_map._buckets;
-  for (int i = 0; i < _capacity; ++i)
+  // the pairs of other's old table too, they hash to this map's table
+  for (int i = other.next_occupied (0); i != -1;
+       i = other.next_occupied (i + 1))
   {
-    const bucket &get_bucket = assign_from_map[i];
-    if (!get_bucket.empty ())
+    for (const entry &cur_entry : other.bucket_at (i))
     {
-      bucket copied_bucket (assign_from_map[i]);
-      _buckets[i] = copied_bucket;
+      int ind_bucket = entry_hash (cur_entry) & (_capacity - 1);
+      _buckets[ind_bucket].push_back (cur_entry);
+      set_occupied (ind_bucket, true);
     }
   }
-  return *this;
 }
 
-template<class KeyT, class ValueT>
-ValueT &HashMap<KeyT, ValueT>::operator[] (const KeyT &key)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::my_hash_map
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::allocate_buckets (
+    int capacity)
+{
+  if (capacity == 0) // a copy of a moved from map
+  {
+    return nullptr;
+  }
+  bucket_allocator allocator (_allocator);
+  my_hash_map buckets = bucket_traits::allocate (allocator, capacity);
+  for (int i = 0; i < capacity; i++)
+  {
+    bucket_traits::construct (allocator, buckets + i, _allocator);
+  }
+  return buckets;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::deallocate_buckets (
+    my_hash_map buckets, int capacity)
 {
-  if (!contains_key (key))
+  if (buckets == nullptr)
+  {
+    return;
+  }
+  bucket_allocator allocator (_allocator);
+  for (int i = 0; i < capacity; i++)
   {
-    insert (key, ValueT ());
+    bucket_traits::destroy (allocator, buckets + i);
   }
-  return at (key);
+  bucket_traits::deallocate (allocator, buckets, capacity);
 }
 
-template<class KeyT, class ValueT>
-const ValueT &HashMap<KeyT, ValueT>::operator[] (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket_at (int ind_bucket)
 {
-  if (!contains_key (key))
+  if (ind_bucket < _capacity)
   {
-    return _default_value;
+    return _buckets[ind_bucket];
   }
-  return at (key);
+  return _old_buckets[ind_bucket - _capacity];
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::operator== (const HashMapT &compare_map) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+const typename HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket &
+HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::bucket_at (
+    int ind_bucket) const
 {
-  if (_size != compare_map._size)
+  if (ind_bucket < _capacity)
   {
-    return false;
+    return _buckets[ind_bucket];
+  }
+  return _old_buckets[ind_bucket - _capacity];
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::set_occupied (
+    int ind_bucket, bool occupied)
+{
+  occupancy &bitmap = ind_bucket < _capacity ? _occupied : _old_occupied;
+  if (ind_bucket >= _capacity)
+  {
+    ind_bucket -= _capacity;
   }
-  for (int i = 0; i < compare_map._capacity; i++)
+  unsigned long long bit = 1ULL << (ind_bucket % OCCUPANCY_WORD_BITS);
+  if (occupied)
   {
-    const bucket &my_bucket = compare_map._buckets[i];
-    for (int j = 0; j < (int) my_bucket.size (); j++)
+    bitmap[ind_bucket / OCCUPANCY_WORD_BITS] |= bit;
+  }
+  else
+  {
+    bitmap[ind_bucket / OCCUPANCY_WORD_BITS] &= ~bit;
+  }
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::next_occupied (
+    int ind_bucket) const
+{
+  if (ind_bucket < _capacity)
+  {
+    int found = scan_occupancy (_occupied, ind_bucket, _capacity);
+    if (found != -1)
     {
-      const pair &cur_pair = my_bucket[j];
-      const KeyT &key = cur_pair.first;
-      const ValueT &value = cur_pair.second;
-      if (!contains_key (key))
-      { return false; }
-      else
-      {
-        if (at (key) != value)
-        { return false; }
-      }
+      return found;
     }
+    ind_bucket = _capacity; // continue in the old table
   }
-  return true;
+  if (_old_buckets != nullptr && ind_bucket < _capacity + _old_capacity)
+  {
+    int found = scan_occupancy (_old_occupied, ind_bucket - _capacity,
+                                _old_capacity);
+    if (found != -1)
+    {
+      return _capacity + found;
+    }
+  }
+  return -1;
 }
 
-template<class KeyT, class ValueT>
-bool HashMap<KeyT, ValueT>::operator!= (const HashMapT &compare_map) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::scan_occupancy (
+    const occupancy &bitmap, int ind_bucket, int capacity)
 {
-  return !operator== (compare_map);
+  int ind_word = ind_bucket / OCCUPANCY_WORD_BITS;
+  int words = occupancy_words (capacity);
+  unsigned long long word = bitmap[ind_word]
+                            & (~0ULL << (ind_bucket % OCCUPANCY_WORD_BITS));
+  while (word == 0)
+  {
+    if (++ind_word == words)
+    {
+      return -1;
+    }
+    word = bitmap[ind_word];
+  }
+  return ind_word * OCCUPANCY_WORD_BITS + __builtin_ctzll (word);
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::occupancy_words (
+    int capacity)
+{
+  return (capacity + OCCUPANCY_WORD_BITS - 1) / OCCUPANCY_WORD_BITS;
+}
+
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+void HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::count_lookup (
+    int probes) const
+{
+#ifdef HASHMAP_STATS
+  stats_counters::add (_stats.lookups, 1);
+  stats_counters::add (_stats.probes, probes);
+#else
+  (void) probes;
+#endif
 }
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::hashing (const KeyT &key) const
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::total_buckets () const
 {
-  size_t key_hash = std::hash<KeyT>{} (key);
-  return key_hash & (this->_capacity - 1);
+  return _old_buckets == nullptr ? _capacity : _capacity + _old_capacity;
 }
 
-template<class KeyT, class ValueT>
-void HashMap<KeyT, ValueT>::rehashing (int new_capacity)
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::capacity_for (int n) const
 {
-  HashMapT temp (*this);
-  delete[] _buckets;
-  _capacity = new_capacity, _size = 0;
-  _buckets = new bucket[new_capacity];
-  for (int i = 0; i < temp._capacity; i++)
+  int new_capacity = std::max (INITIAL_CAPACITY, _policy.min_capacity);
+  while (_policy.max_load_factor < double (n) / (double) new_capacity)
   {
-    const bucket &my_bucket = temp._buckets[i];
-    for (int j = 0; j < (int) my_bucket.size (); j++)
-    {
-      const pair &cur_pair = my_bucket[j];
-      const KeyT &key = cur_pair.first;
-      const ValueT &value = cur_pair.second;
-      insert (key, value);
-    }
+    new_capacity *= 2;
   }
+  return new_capacity;
 }
 
-template<class KeyT, class ValueT>
-int HashMap<KeyT, ValueT>::find_new_capacity ()
+template<class KeyT, class ValueT, class Hash, class KeyEqual,
+    class Allocator>
+int HashMap<KeyT, ValueT, Hash, KeyEqual, Allocator>::find_new_capacity ()
 {
   int new_capacity = _capacity;
   double new_load_factor = get_load_factor ();
-  if (new_load_factor > UPPER_LOAD_FACTOR)
+  if (new_load_factor > _policy.max_load_factor)
   {
-    new_capacity *= 2;
+    new_capacity *= _policy.growth_factor;
   }
   else
   {
-    while (new_load_factor < LOWER_LOAD_FACTOR)
+    while (new_load_factor < _policy.shrink_load_factor
+           && new_capacity > _policy.min_capacity)
     {
       new_capacity /= 2;
       new_load_factor = double (_size) / (double) new_capacity;
     }
   }
-  if (new_capacity < 1)
-  { new_capacity = 1; }
   return new_capacity;
 }
 
+/**
+ * collision statistics of a hash map, see collision_stats
+ * @var size - number of pairs
+ * @var capacity - number of buckets
+ * @var used_buckets - buckets that hold at least one pair
+ * @var max_bucket_size - size of the longest bucket
+ * @var average_probe - average number of pairs compared by a successful
+ * lookup (1 when there are no collisions)
+ */
+struct CollisionStats
+{
+  int size;
+  int capacity;
+  int used_buckets;
+  int max_bucket_size;
+  double average_probe;
+};
+
+/**
+ * collect the collision statistics of a map (HashMap, Dictionary) through
+ * its bucket_index and bucket_size introspection, used to compare hash
+ * policies on a realistic set of keys
+ * @param map - a map to report on
+ * @return the collision statistics of map
+ */
+template<class MapT>
+CollisionStats collision_stats (const MapT &map)
+{
+  CollisionStats stats{map.size (), map.capacity (), 0, 0, 0};
+  std::vector<bool> used_bucket (map.capacity ());
+  double probes = 0;
+  for (const auto &cur_pair : map)
+  {
+    int index = map.bucket_index (cur_pair.first);
+    int size_of_bucket = map.bucket_size (cur_pair.first);
+    if (index >= (int) used_bucket.size ()) // old table of a rehash
+    {
+      used_bucket.resize (index + 1);
+    }
+    if (!used_bucket[index])
+    {
+      used_bucket[index] = true;
+      stats.used_buckets++;
+    }
+    stats.max_bucket_size = std::max (stats.max_bucket_size, size_of_bucket);
+    // the pairs of a bucket are found after 1, 2, ..., size compares
+    probes += (size_of_bucket + 1) / 2.0;
+  }
+  if (stats.size > 0)
+  {
+    stats.average_probe = probes / stats.size;
+  }
+  return stats;
+}
+
+/**
+ * print collision statistics in one line
+ * @param stream - a stream to print to
+ * @param stats - statistics to print
+ * @return the stream
+ */
+inline std::ostream &operator<< (std::ostream &stream,
+                                 const CollisionStats &stats)
+{
+  stream << "size: " << stats.size << ", capacity: " << stats.capacity
+         << ", used buckets: " << stats.used_buckets
+         << ", max bucket size: " << stats.max_bucket_size
+         << ", average probe: " << stats.average_probe;
+  return stream;
+}
+
 #endif //_HASHMAP_HPP_
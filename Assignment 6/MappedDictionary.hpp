@@ -0,0 +1,637 @@
+#ifndef _MAPPEDDICTIONARY_HPP_
+#define _MAPPEDDICTIONARY_HPP_
+
+#include "HashMap.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAPPED_MAGIC "DICTMAP1"
+#define MAPPED_MAGIC_SIZE 8
+#define MAPPED_WRITE_BUFFER_SIZE (1 << 20)
+#define MAPPED_TEMPORARY_SUFFIX ".tmp"
+#define MAPPED_OPEN_ERROR_MSG "Can't open the mapped dictionary file"
+#define MAPPED_FORMAT_ERROR_MSG "File is not a mapped dictionary"
+#define MAPPED_WRITE_ERROR_MSG "Can't write the mapped dictionary file"
+
+/**
+ * a read-only dictionary that runs its lookups directly against a file
+ * written by save_mapped and mapped into memory, nothing is parsed or
+ * copied when it is opened, the pages are read by the OS on first touch.
+ *
+ * the file is position independent, all the references inside it are
+ * offsets from its start:
+ * header   - magic, number of pairs, number of buckets, size of the strings
+ * offsets  - bucket_count + 1 indices, the entries of bucket i are
+ *            entries[offsets[i]] .. entries[offsets[i + 1]]
+ * entries  - hash of the key, offset of the key in the strings, key size and
+ *            value size, the value follows the key in the strings
+ * strings  - the keys and values, in the order of the entries
+ * the numbers are stored in the byte order of the machine that saved the
+ * file, and the hash is stable_hash, not std::hash, so a file stays valid
+ * across builds. opening a file reads the offsets and the entries once to
+ * check that every bucket and every string lies inside the file, the
+ * strings themselves are not read until a lookup compares them.
+ */
+class MappedDictionary
+{
+ public:
+  class ConstIterator;
+  typedef ConstIterator const_iterator;
+  typedef std::pair<std::string_view, std::string_view> pair;
+
+  /**
+   * map a file written by save_mapped, throws std::runtime_error if
+   * the file can't be opened or isn't a mapped dictionary
+   * @param path - path of the file
+   */
+  explicit MappedDictionary (const std::string &path);
+  /**
+   * a mapped dictionary owns its mapping, it can be moved but not copied
+   */
+  MappedDictionary (const MappedDictionary &) = delete;
+  MappedDictionary &operator= (const MappedDictionary &) = delete;
+  /**
+   * move constructor, move_dictionary is left without a mapping
+   * @param move_dictionary - a mapped dictionary to take the mapping from
+   */
+  MappedDictionary (MappedDictionary &&move_dictionary) noexcept;
+  /**
+   * move assignment, swaps the mappings
+   * @param assign_dictionary - a mapped dictionary to take the mapping from
+   * @return a reference to this
+   */
+  MappedDictionary &operator= (MappedDictionary &&assign_dictionary) noexcept;
+  /**
+   * destructor, unmaps the file
+   */
+  ~MappedDictionary ();
+  /**
+   * write the pairs of a map to a file that MappedDictionary can open,
+   * replacing the file at path only when the whole file was written. raise
+   * exception if the file can't be written
+   * @tparam MapT - an iterable map of strings (Dictionary, HashMap, ...)
+   * @param path - path of the file
+   * @param map - the map to save
+   */
+  template<class MapT>
+  static void save (const std::string &path, const MapT &map);
+  /**
+   * a getter for the size (number of pairs) of the dictionary
+   * @return an int that represents the size
+   */
+  int size () const;
+  /**
+   * a getter for the number of buckets of the dictionary
+   * @return an int that represents the capacity
+   */
+  int capacity () const;
+  /**
+   * check if the dictionary is empty
+   * @return true - the dictionary is empty
+   * @return false - the dictionary is not empty
+   */
+  bool empty () const;
+  /**
+   * check if a key is in the dictionary
+   * @param key - a dictionary key
+   * @return true - if key exist in the dictionary
+   * @return false - key doesn't exist in the dictionary
+   */
+  bool contains_key (std::string_view key) const;
+  /**
+   * gets a key as parameter and return the value attached to key,
+   * the value points into the mapped file and lives as long as the mapping.
+   * if key isn't found, raise exception
+   * @param key - a dictionary key
+   * @return the value attached to key
+   */
+  std::string_view at (std::string_view key) const;
+  /**
+   * find the pair of a key
+   * @param key - a dictionary key
+   * @return iterator to the pair, end () if key doesn't exist
+   */
+  const_iterator find (std::string_view key) const;
+  /**
+   * iterators to the pairs, in the order of the buckets
+   */
+  const_iterator begin () const;
+  const_iterator end () const;
+  const_iterator cbegin () const;
+  const_iterator cend () const;
+  /**
+   * the hash of the file format: 64 bit FNV-1a over words, mixed so that the
+   * low bits that choose the bucket depend on all the bytes of the key.
+   * changing it invalidates every saved file
+   * @param key - a dictionary key
+   * @return the hash of key
+   */
+  static uint64_t stable_hash (std::string_view key);
+
+ private:
+  struct header
+  {
+    char magic[MAPPED_MAGIC_SIZE];
+    uint64_t size;
+    uint64_t bucket_count;
+    uint64_t strings_size;
+  };
+  struct entry
+  {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t key_size;
+    uint64_t value_size;
+  };
+
+  void *_mapping;
+  size_t _mapping_size;
+  uint64_t _size;
+  uint64_t _bucket_count;
+  const uint64_t *_offsets;
+  const entry *_entries;
+  const char *_strings;
+  /**
+   * find the index of the entry of a key
+   * @param key - a dictionary key
+   * @return index of the entry, -1 if key doesn't exist
+   */
+  long find_entry (std::string_view key) const;
+  /**
+   * the pair of an entry, pointing into the mapped strings
+   * @param ind_entry - index of the entry
+   * @return the key and value of the entry
+   */
+  pair pair_at (uint64_t ind_entry) const;
+  /**
+   * add count items of item_size bytes to a size, unless it overflows
+   * @param total - the size to add to
+   * @param count - number of items
+   * @param item_size - size in bytes of an item
+   * @return true if the sum fits in 64 bits, false (and total unchanged)
+   * otherwise
+   */
+  static bool add_size (uint64_t &total, uint64_t count, uint64_t item_size);
+  /**
+   * check the offsets and the entries of the mapped file: the offsets start
+   * at 0, never decrease and end at the number of pairs, and the key and
+   * value of every entry are inside the strings
+   * @param strings_size - size in bytes of the strings
+   * @return true if every lookup stays inside the file
+   */
+  bool valid_layout (uint64_t strings_size) const;
+
+ public:
+  /**
+   * iterator over the pairs of a mapped dictionary, the pairs are views
+   * into the mapped file
+   */
+  class ConstIterator
+  {
+   private:
+    const MappedDictionary *_iter_ptr_map;
+    uint64_t _ind_entry;
+    pair _pair;
+
+   public:
+    /**
+     * mandatory typedef for iterator class
+     */
+    typedef pair value_type;
+    typedef const pair &reference;
+    typedef const pair *pointer;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::forward_iterator_tag iterator_category;
+
+    /**
+     * @param mapped_map - a pointer to the mapped dictionary
+     * @param ind_entry - the index of the entry the iterator is at
+     */
+    ConstIterator (const MappedDictionary *mapped_map, uint64_t ind_entry)
+        : _iter_ptr_map (mapped_map), _ind_entry (ind_entry)
+    { load_pair (); }
+
+    /**
+     * gets the next element to iterate to
+     * @return the element after the iteration
+     */
+    const_iterator &operator++ ()
+    {
+      _ind_entry++;
+      load_pair ();
+      return *this;
+    }
+
+    /**
+     * gets the next element to iterate to
+     * @return the element before the iteration
+     */
+    const_iterator operator++ (int)
+    {
+      const ConstIterator it (*this);
+      operator++ ();
+      return it;
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are equal
+     * @return false - iterators are unequal
+     */
+    bool operator== (const ConstIterator &compare_iter) const
+    {
+      return _ind_entry == compare_iter._ind_entry
+             && _iter_ptr_map == compare_iter._iter_ptr_map;
+    }
+
+    /**
+     * @param compare_iter - check if 2 iterators are equal
+     * @return true - iterators are unequal
+     * @return false - iterators are equal
+     */
+    bool operator!= (const ConstIterator &compare_iter) const
+    {
+      return !(operator== (compare_iter));
+    }
+
+    /**
+     * dereference to the pair of the iterator is currently at
+     * @return a pair of key and value
+     */
+    reference operator* () const
+    {
+      return _pair;
+    }
+
+    /**
+     * a pointer to the pair
+     * @return a pointer to the pair of key and value
+     */
+    pointer operator-> () const
+    {
+      return &_pair;
+    }
+
+   private:
+    /**
+     * read the pair of the current entry, the end iterator has none
+     */
+    void load_pair ()
+    {
+      if (_ind_entry < _iter_ptr_map->_size)
+      {
+        _pair = _iter_ptr_map->pair_at (_ind_entry);
+      }
+    }
+  };
+};
+
+/** function implementation for MappedDictionary class - documentation in
+ * class */
+
+inline MappedDictionary::MappedDictionary (const std::string &path)
+{
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd == -1)
+  {
+    throw std::runtime_error (MAPPED_OPEN_ERROR_MSG);
+  }
+  struct stat file_stat;
+  if (fstat (fd, &file_stat) == -1
+      || (size_t) file_stat.st_size < sizeof (header))
+  {
+    close (fd);
+    throw std::runtime_error (MAPPED_FORMAT_ERROR_MSG);
+  }
+  _mapping_size = (size_t) file_stat.st_size;
+  _mapping = mmap (nullptr, _mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd); // the mapping keeps the file open
+  if (_mapping == MAP_FAILED)
+  {
+    throw std::runtime_error (MAPPED_OPEN_ERROR_MSG);
+  }
+  const header *file_header = static_cast<const header *> (_mapping);
+  _size = file_header->size;
+  _bucket_count = file_header->bucket_count;
+  // a corrupt header can make any of the sizes wrap around
+  uint64_t expected_size = sizeof (header);
+  bool valid_sizes =
+      _bucket_count != 0 && (_bucket_count & (_bucket_count - 1)) == 0
+      && add_size (expected_size, _bucket_count + 1, sizeof (uint64_t))
+      && add_size (expected_size, _size, sizeof (entry))
+      && add_size (expected_size, file_header->strings_size, 1)
+      && expected_size == _mapping_size;
+  if (std::memcmp (file_header->magic, MAPPED_MAGIC, MAPPED_MAGIC_SIZE) != 0
+      || !valid_sizes)
+  {
+    munmap (_mapping, _mapping_size);
+    throw std::runtime_error (MAPPED_FORMAT_ERROR_MSG);
+  }
+  const char *base = static_cast<const char *> (_mapping);
+  _offsets = reinterpret_cast<const uint64_t *> (base + sizeof (header));
+  _entries = reinterpret_cast<const entry *> (_offsets + _bucket_count + 1);
+  _strings = reinterpret_cast<const char *> (_entries + _size);
+  if (!valid_layout (file_header->strings_size))
+  {
+    munmap (_mapping, _mapping_size);
+    throw std::runtime_error (MAPPED_FORMAT_ERROR_MSG);
+  }
+}
+
+inline MappedDictionary::MappedDictionary (
+    MappedDictionary &&move_dictionary) noexcept
+    : _mapping (move_dictionary._mapping),
+      _mapping_size (move_dictionary._mapping_size),
+      _size (move_dictionary._size),
+      _bucket_count (move_dictionary._bucket_count),
+      _offsets (move_dictionary._offsets),
+      _entries (move_dictionary._entries),
+      _strings (move_dictionary._strings)
+{
+  move_dictionary._mapping = nullptr;
+  move_dictionary._mapping_size = 0;
+  move_dictionary._size = 0;
+}
+
+inline MappedDictionary &
+MappedDictionary::operator= (MappedDictionary &&assign_dictionary) noexcept
+{
+  std::swap (_mapping, assign_dictionary._mapping);
+  std::swap (_mapping_size, assign_dictionary._mapping_size);
+  std::swap (_size, assign_dictionary._size);
+  std::swap (_bucket_count, assign_dictionary._bucket_count);
+  std::swap (_offsets, assign_dictionary._offsets);
+  std::swap (_entries, assign_dictionary._entries);
+  std::swap (_strings, assign_dictionary._strings);
+  return *this;
+}
+
+inline MappedDictionary::~MappedDictionary ()
+{
+  if (_mapping != nullptr)
+  {
+    munmap (_mapping, _mapping_size);
+  }
+}
+
+template<class MapT>
+void MappedDictionary::save (const std::string &path, const MapT &map)
+{
+  uint64_t size = (uint64_t) map.size ();
+  uint64_t bucket_count = 1;
+  while (bucket_count * UPPER_LOAD_FACTOR < size)
+  {
+    bucket_count *= 2;
+  }
+  // counting sort of the pairs by bucket, the entries of a bucket are
+  // stored together so a lookup reads a single run of entries
+  std::vector<uint64_t> offsets (bucket_count + 1, 0);
+  std::vector<uint64_t> hashes;
+  hashes.reserve (size);
+  for (const auto &key_value : map)
+  {
+    hashes.push_back (stable_hash (key_value.first));
+    offsets[(hashes.back () & (bucket_count - 1)) + 1]++;
+  }
+  for (uint64_t i = 0; i < bucket_count; i++)
+  {
+    offsets[i + 1] += offsets[i];
+  }
+  std::vector<uint64_t> next (offsets.begin (), offsets.end () - 1);
+  std::vector<std::pair<std::string_view, std::string_view>> pairs (size);
+  std::vector<entry> entries (size);
+  uint64_t ind_pair = 0;
+  for (const auto &key_value : map)
+  {
+    uint64_t hash = hashes[ind_pair++];
+    uint64_t ind_entry = next[hash & (bucket_count - 1)]++;
+    pairs[ind_entry] = {key_value.first, key_value.second};
+    entries[ind_entry].hash = hash;
+  }
+  uint64_t strings_size = 0;
+  for (uint64_t i = 0; i < size; i++)
+  {
+    entries[i].offset = strings_size;
+    entries[i].key_size = pairs[i].first.size ();
+    entries[i].value_size = pairs[i].second.size ();
+    strings_size += entries[i].key_size + entries[i].value_size;
+  }
+  header file_header;
+  std::memcpy (file_header.magic, MAPPED_MAGIC, MAPPED_MAGIC_SIZE);
+  file_header.size = size;
+  file_header.bucket_count = bucket_count;
+  file_header.strings_size = strings_size;
+
+  // written next to path and renamed over it once complete, so a failed
+  // write leaves the old file and mappings of the old file stay valid
+  std::string temporary_path = path + MAPPED_TEMPORARY_SUFFIX;
+  std::ofstream file (temporary_path, std::ios::binary | std::ios::trunc);
+  file.write (reinterpret_cast<const char *> (&file_header),
+              sizeof (header));
+  file.write (reinterpret_cast<const char *> (offsets.data ()),
+              (std::streamsize) (offsets.size () * sizeof (uint64_t)));
+  file.write (reinterpret_cast<const char *> (entries.data ()),
+              (std::streamsize) (entries.size () * sizeof (entry)));
+  // the strings are small, gather them into large writes
+  std::string buffer;
+  buffer.reserve (MAPPED_WRITE_BUFFER_SIZE);
+  for (const auto &key_value : pairs)
+  {
+    buffer.append (key_value.first).append (key_value.second);
+    if (buffer.size () >= MAPPED_WRITE_BUFFER_SIZE)
+    {
+      file.write (buffer.data (), (std::streamsize) buffer.size ());
+      buffer.clear ();
+    }
+  }
+  file.write (buffer.data (), (std::streamsize) buffer.size ());
+  file.close ();
+  if (!file || std::rename (temporary_path.c_str (), path.c_str ()) != 0)
+  {
+    std::remove (temporary_path.c_str ());
+    throw std::runtime_error (MAPPED_WRITE_ERROR_MSG);
+  }
+}
+
+inline int MappedDictionary::size () const
+{
+  return (int) _size;
+}
+
+inline int MappedDictionary::capacity () const
+{
+  return (int) _bucket_count;
+}
+
+inline bool MappedDictionary::empty () const
+{
+  return _size == 0;
+}
+
+inline bool MappedDictionary::contains_key (std::string_view key) const
+{
+  return find_entry (key) != -1;
+}
+
+inline std::string_view MappedDictionary::at (std::string_view key) const
+{
+  long ind_entry = find_entry (key);
+  if (ind_entry == -1)
+  {
+    throw std::out_of_range (OUT_OF_RANGE_ERROR_MSG);
+  }
+  return pair_at ((uint64_t) ind_entry).second;
+}
+
+inline MappedDictionary::const_iterator
+MappedDictionary::find (std::string_view key) const
+{
+  long ind_entry = find_entry (key);
+  return ind_entry == -1 ? end () : const_iterator (this, ind_entry);
+}
+
+inline MappedDictionary::const_iterator MappedDictionary::begin () const
+{
+  return const_iterator (this, 0);
+}
+
+inline MappedDictionary::const_iterator MappedDictionary::end () const
+{
+  return const_iterator (this, _size);
+}
+
+inline MappedDictionary::const_iterator MappedDictionary::cbegin () const
+{
+  return begin ();
+}
+
+inline MappedDictionary::const_iterator MappedDictionary::cend () const
+{
+  return end ();
+}
+
+inline uint64_t MappedDictionary::stable_hash (std::string_view key)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t i = 0;
+  // FNV-1a over 8 byte words instead of single bytes, a word at a time is
+  // several times faster for keys longer than a few characters
+  for (; i + sizeof (uint64_t) <= key.size (); i += sizeof (uint64_t))
+  {
+    uint64_t word;
+    std::memcpy (&word, key.data () + i, sizeof (uint64_t));
+    hash = (hash ^ word) * 0x100000001b3ULL;
+    hash ^= hash >> 32;
+  }
+  for (; i < key.size (); i++)
+  {
+    hash = (hash ^ (unsigned char) key[i]) * 0x100000001b3ULL;
+  }
+  return mix_hash (hash);
+}
+
+inline long MappedDictionary::find_entry (std::string_view key) const
+{
+  if (_size == 0)
+  {
+    return -1;
+  }
+  uint64_t hash = stable_hash (key);
+  uint64_t ind_bucket = hash & (_bucket_count - 1);
+  for (uint64_t i = _offsets[ind_bucket]; i < _offsets[ind_bucket + 1]; i++)
+  {
+    // the stored hash rejects almost every other key without reading its
+    // string
+    if (_entries[i].hash == hash && _entries[i].key_size == key.size ()
+        && std::memcmp (_strings + _entries[i].offset, key.data (),
+                        key.size ()) == 0)
+    {
+      return (long) i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * write a dictionary to a file that open_mapped can map, see
+ * MappedDictionary for the format. kept out of Dictionary so that only the
+ * code that uses snapshots includes the system headers of the mapping
+ * @tparam MapT - an iterable map of strings (Dictionary, HashMap, ...)
+ * @param map - the map to save
+ * @param path - path of the file
+ */
+template<class MapT>
+void save_mapped (const MapT &map, const std::string &path)
+{
+  MappedDictionary::save (path, map);
+}
+
+/**
+ * map a file written by save_mapped, the lookups run directly against the
+ * file without building a dictionary
+ * @param path - path of the file
+ * @return a read-only view of the saved dictionary
+ */
+inline MappedDictionary open_mapped (const std::string &path)
+{
+  return MappedDictionary (path);
+}
+
+inline MappedDictionary::pair
+MappedDictionary::pair_at (uint64_t ind_entry) const
+{
+  const entry &pair_entry = _entries[ind_entry];
+  const char *key = _strings + pair_entry.offset;
+  return {std::string_view (key, pair_entry.key_size),
+          std::string_view (key + pair_entry.key_size,
+                            pair_entry.value_size)};
+}
+
+inline bool MappedDictionary::add_size (uint64_t &total, uint64_t count,
+                                        uint64_t item_size)
+{
+  uint64_t left = UINT64_MAX - total;
+  if (count > left / item_size)
+  {
+    return false;
+  }
+  total += count * item_size;
+  return true;
+}
+
+inline bool MappedDictionary::valid_layout (uint64_t strings_size) const
+{
+  if (_offsets[0] != 0 || _offsets[_bucket_count] != _size)
+  {
+    return false;
+  }
+  for (uint64_t i = 0; i < _bucket_count; i++)
+  {
+    if (_offsets[i] > _offsets[i + 1])
+    {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < _size; i++)
+  {
+    // subtract instead of adding, the sizes of a corrupt entry can be huge
+    const entry &cur_entry = _entries[i];
+    if (cur_entry.offset > strings_size
+        || cur_entry.key_size > strings_size - cur_entry.offset
+        || cur_entry.value_size
+           > strings_size - cur_entry.offset - cur_entry.key_size)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif //_MAPPEDDICTIONARY_HPP_
@@ -0,0 +1,937 @@
+#include "FlatHashMap.hpp"
+#include "Dictionary.hpp"
+#include "ConcurrentHashMap.hpp"
+#include "Arena.hpp"
+#include "MappedDictionary.hpp"
+#include "FrozenDictionary.hpp"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <malloc.h>
+#include <random>
+#include <string>
+#include <thread>
+
+#define FLAT_LOOKUP_ROUNDS 3
+#define PROBE_KEYS 100000
+#define REHASH_KEYS 2000000
+#define REHASH_STEP 16
+#define TOKEN_KEYS 200000
+#define TOKENS 1000000
+#define STRIDED_KEYS 4096
+#define KEY_STRIDE 1024
+#define CONCURRENT_KEYS 1000000
+#define CONCURRENT_OPERATIONS 2000000
+#define MAX_BENCH_THREADS 64
+#define ARENA_KEYS 1000000
+#define ARENA_BENCH_BLOCK (1 << 20)
+#define ARENA_ROUNDS 3
+#define MAPPED_ENTRIES 5000000
+#define MAPPED_LOOKUPS 1000000
+#define MAPPED_TEXT_PATH "benchmark_dictionary.txt"
+#define MAPPED_FILE_PATH "benchmark_dictionary.dm"
+#define SPARSE_CAPACITY (1 << 20)
+#define ITERATE_ROUNDS 30
+#define COMPARE_ROUNDS 10
+#define POLICY_ROUNDS 5
+#define POLICY_CYCLES 1000000
+#define BOUNDARY_CYCLES 100000
+#define DRAIN_KEYS 4096
+#define DRAIN_ROUNDS 50
+#define BATCH_LOOKUPS 4000000
+#define BATCH_ROUNDS 3
+#define STATS_INSERTS 2000000
+#define STATS_LOOKUPS 4000000
+#define STATS_ROUNDS 5
+#define FROZEN_LOOKUPS 2000000
+#define FROZEN_ROUNDS 3
+#define ZIPF_WORDS 200000
+#define ZIPF_TOKENS 5000000
+#define ZIPF_ROUNDS 3
+#define URL_PREFIX "https://www.example.com/article/"
+
+/**
+ * seconds since an arbitrary point, to time a benchmark
+ * @return the seconds
+ */
+static double now ()
+{
+  return std::chrono::duration<double> (
+      std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+/**
+ * bytes currently allocated by malloc, to measure a map
+ * @return the bytes
+ */
+static size_t allocated_bytes ()
+{
+  struct mallinfo2 info = mallinfo2 ();
+  return info.uordblks + info.hblkhd;
+}
+
+/**
+ * keys of the string benchmarks, spread so they don't share prefixes
+ * @param n - number of keys
+ * @return n distinct keys
+ */
+static std::vector<std::string> string_keys (int n)
+{
+  std::vector<std::string> keys;
+  keys.reserve (n);
+  for (int i = 0; i < n; i++)
+  {
+    keys.push_back ("key_" + std::to_string ((long) i * 7919));
+  }
+  return keys;
+}
+
+/**
+ * lookups per second and bytes per entry of a map of string keys
+ * @param name - name of the map in the output
+ * @param n - number of keys
+ */
+template<class MapT>
+static void lookup_map (const char *name, int n)
+{
+  std::vector<std::string> keys = string_keys (n);
+  size_t before = allocated_bytes ();
+  MapT *map = new MapT;
+  for (int i = 0; i < n; i++)
+  {
+    map->insert (keys[i], i);
+  }
+  size_t bytes = allocated_bytes () - before;
+  double start = now ();
+  long sum = 0;
+  for (int round = 0; round < FLAT_LOOKUP_ROUNDS; round++)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      sum += map->at (keys[(size_t) i * 31 % n]);
+    }
+  }
+  double seconds = now () - start;
+  std::printf ("%-8s n=%-8d %6.1f Mlookups/s %6.1f bytes/entry (%ld)\n",
+               name, n, FLAT_LOOKUP_ROUNDS * n / seconds / 1e6,
+               (double) bytes / n, sum % 10);
+  delete map;
+}
+
+/**
+ * chained HashMap against the open addressing FlatHashMap
+ */
+static void bench_flat ()
+{
+  for (int n : {100000, 1000000})
+  {
+    lookup_map<HashMap<std::string, int>> ("chained", n);
+    lookup_map<FlatHashMap<std::string, int>> ("flat", n);
+  }
+}
+
+/**
+ * std::hash that counts its calls, one call is one pass over a bucket
+ */
+struct counting_hash
+{
+  static inline long calls = 0;
+  size_t operator() (int key) const
+  {
+    calls++;
+    return std::hash<int>{} (key);
+  }
+};
+
+/**
+ * std::equal_to that counts its calls
+ */
+struct counting_equal
+{
+  static inline long calls = 0;
+  bool operator() (int a, int b) const
+  {
+    calls++;
+    return a == b;
+  }
+};
+
+typedef HashMap<int, int, counting_hash, counting_equal> counting_map;
+
+/**
+ * prints the hashes and key compares per call of an operation
+ * @param name - name of the operation
+ * @param operation - runs the operation on key
+ * @param first_key - the key of the first call, PROBE_KEYS calls are made
+ */
+template<class Operation>
+static void count_probes (const char *name, Operation operation,
+                          int first_key)
+{
+  counting_hash::calls = 0, counting_equal::calls = 0;
+  for (int key = first_key; key < first_key + PROBE_KEYS; key++)
+  {
+    operation (key);
+  }
+  std::printf ("%-22s %5.2f hashes/call %5.2f compares/call\n", name,
+               (double) counting_hash::calls / PROBE_KEYS,
+               (double) counting_equal::calls / PROBE_KEYS);
+}
+
+/**
+ * hash passes and key compares of every HashMap operation, the map is
+ * reserved and doesn't shrink so no call rehashes it
+ */
+static void bench_probes ()
+{
+  counting_map map;
+  LoadFactorPolicy policy;
+  policy.shrink = false;
+  map.set_load_factor_policy (policy);
+  map.reserve (3 * PROBE_KEYS);
+  const counting_map &const_map = map;
+  count_probes ("insert", [&map] (int key) { map.insert (key, key); }, 0);
+  count_probes ("at", [&map] (int key) { map.at (key)++; }, 0);
+  count_probes ("const at", [&const_map] (int key)
+  { (void) const_map.at (key); }, 0);
+  count_probes ("contains_key (miss)", [&map] (int key)
+  { (void) map.contains_key (key); }, PROBE_KEYS);
+  count_probes ("operator[] (miss)", [&map] (int key)
+  { map[key] = key; }, PROBE_KEYS);
+  count_probes ("insert_or_assign", [&map] (int key)
+  { map.insert_or_assign (key, key); }, PROBE_KEYS / 2);
+  count_probes ("erase", [&map] (int key) { map.erase (key); }, 0);
+}
+
+/**
+ * the slowest single insert of long string pairs, with a growth rehash done
+ * at once (step 0) and incrementally (step REHASH_STEP)
+ */
+static void bench_rehash ()
+{
+  std::vector<std::string> keys;
+  keys.reserve (REHASH_KEYS);
+  for (int i = 0; i < REHASH_KEYS; i++)
+  {
+    keys.push_back ("key_number_" + std::to_string (i) + "_padding_past_sso");
+  }
+  for (int step : {0, REHASH_STEP})
+  {
+    HashMap<std::string, std::string> map;
+    map.set_rehash_step (step);
+    double worst = 0, start = now ();
+    for (const std::string &key : keys)
+    {
+      double before = now ();
+      map.insert (key, key);
+      worst = std::max (worst, now () - before);
+    }
+    std::printf ("step %-3d total %6.0f ms, worst insert %6.2f ms\n", step,
+                 (now () - start) * 1e3, worst * 1e3);
+  }
+}
+
+/**
+ * contains_key of tokens sliced from one text buffer, through a temporary
+ * std::string and directly through std::string_view
+ */
+static void bench_string_view ()
+{
+  Dictionary dictionary;
+  for (int i = 0; i < TOKEN_KEYS; i++)
+  {
+    dictionary.insert ("token_with_some_length_" + std::to_string (i), "v");
+  }
+  std::string text;
+  for (int i = 0; i < TOKENS; i++)
+  {
+    // half of the tokens are misses
+    text += "token_with_some_length_"
+            + std::to_string ((long) i * 7919 % (2 * TOKEN_KEYS)) + " ";
+  }
+  std::vector<std::string_view> tokens;
+  for (size_t begin = 0, end; begin < text.size (); begin = end + 1)
+  {
+    end = text.find (' ', begin);
+    tokens.push_back (std::string_view (text).substr (begin, end - begin));
+  }
+  for (bool view : {false, true})
+  {
+    double start = now ();
+    long hits = 0;
+    for (std::string_view token : tokens)
+    {
+      hits += view ? dictionary.contains_key (token)
+                   : dictionary.contains_key (std::string (token));
+    }
+    std::printf ("%-16s %5.1f M lookups/s (%ld hits)\n",
+                 view ? "std::string_view" : "std::string", TOKENS
+                 / (now () - start) / 1e6, hits);
+  }
+}
+
+/**
+ * the vector constructor with int keys, which reserves once and appends
+ * the pairs without a growth rehash
+ */
+static void bench_bulk_load ()
+{
+  for (int n : {1000000, 10000000})
+  {
+    std::vector<int> keys (n), values (n);
+    for (int i = 0; i < n; i++)
+    {
+      keys[i] = (int) (i * 2654435761u % 2147483647), values[i] = i;
+    }
+    double start = now ();
+    HashMap<int, int> map (keys, values);
+    std::printf ("n=%-8d %6.0f ms (capacity %d)\n", n,
+                 (now () - start) * 1e3, map.capacity ());
+  }
+}
+
+/**
+ * collision statistics of strided int keys with std::hash and MixHash
+ * @param name - name of the hash in the output
+ */
+template<class Hash>
+static void strided_collisions (const char *name)
+{
+  HashMap<int, int, Hash> map;
+  map.reserve (STRIDED_KEYS);
+  for (int i = 0; i < STRIDED_KEYS; i++)
+  {
+    map.insert (i * KEY_STRIDE, i);
+  }
+  std::cout << name << collision_stats (map) << std::endl;
+}
+
+/**
+ * keys i * 1024 hashed by the identity std::hash and by MixHash
+ */
+static void bench_collisions ()
+{
+  strided_collisions<std::hash<int>> ("std::hash     ");
+  strided_collisions<MixHash<int>> ("MixHash<int>  ");
+}
+
+/**
+ * throughput of ConcurrentHashMap with 1, 2, 4, ... threads, up to twice
+ * the hardware threads, for a read-heavy (5% writes) and a write-heavy
+ * (50% writes) mix of random keys
+ */
+static void bench_concurrent ()
+{
+  ConcurrentHashMap<int, int> map;
+  for (int i = 0; i < CONCURRENT_KEYS; i++)
+  {
+    map.insert (i, i);
+  }
+  int max_threads = std::min (
+      MAX_BENCH_THREADS,
+      std::max (8, 2 * (int) std::thread::hardware_concurrency ()));
+  for (int threads = 1; threads <= max_threads; threads *= 2)
+  {
+    for (int write_percent : {5, 50})
+    {
+      std::vector<std::thread> workers;
+      int operations = CONCURRENT_OPERATIONS / threads;
+      double start = now ();
+      for (int t = 0; t < threads; t++)
+      {
+        workers.emplace_back ([&map, operations, write_percent, t] ()
+                              {
+                                std::mt19937 random (t);
+                                long hits = 0;
+                                for (int i = 0; i < operations; i++)
+                                {
+                                  int key = (int) (random ()
+                                                   % CONCURRENT_KEYS);
+                                  if ((int) (random () % 100) < write_percent)
+                                  {
+                                    map.insert_or_assign (key, i);
+                                  }
+                                  else
+                                  {
+                                    hits += map.contains_key (key);
+                                  }
+                                }
+                                (void) hits;
+                              });
+      }
+      for (std::thread &worker : workers)
+      {
+        worker.join ();
+      }
+      std::printf ("threads %-3d writes %2d%% %6.1f Mops/s\n", threads,
+                   write_percent, (double) operations * threads
+                                  / (now () - start) / 1e6);
+    }
+  }
+}
+
+/**
+ * reserves and fills a map with ARENA_KEYS int pairs
+ * @param map - an empty map
+ */
+template<class MapT>
+static void build_reserved (MapT &map)
+{
+  map.reserve (ARENA_KEYS);
+  for (int i = 0; i < ARENA_KEYS; i++)
+  {
+    map.insert ((int) ((long) i * 7919), i);
+  }
+}
+
+/**
+ * a reserved HashMap<int, int> built and destroyed with std::allocator and
+ * with an ArenaAllocator
+ */
+static void bench_arena ()
+{
+  typedef ArenaAllocator<std::pair<int, int>> arena_allocator;
+  typedef HashMap<int, int, std::hash<int>, std::equal_to<>, arena_allocator>
+      arena_map;
+  for (int round = 0; round < ARENA_ROUNDS; round++)
+  {
+    double start = now ();
+    {
+      HashMap<int, int> map;
+      build_reserved (map);
+    }
+    double heap_ms = (now () - start) * 1e3;
+    start = now ();
+    {
+      MonotonicArena arena (ARENA_BENCH_BLOCK);
+      arena_map map{arena_allocator (arena)};
+      build_reserved (map);
+    }
+    double arena_ms = (now () - start) * 1e3;
+    std::printf ("build+destroy 1M: std::allocator %6.1f ms, "
+                 "arena %6.1f ms\n", heap_ms, arena_ms);
+  }
+}
+
+/**
+ * key number i of the mapped dictionary benchmark
+ * @param i - number of the key
+ * @return the key
+ */
+static std::string user_key (long i)
+{
+  char key[32];
+  std::snprintf (key, sizeof (key), "user:%09ld", i);
+  return key;
+}
+
+/**
+ * MAPPED_LOOKUPS random at calls on a dictionary
+ * @param dictionary - a Dictionary or a MappedDictionary of the keys
+ * @return milliseconds of the lookups
+ */
+template<class DictionaryT>
+static double mapped_lookups (const DictionaryT &dictionary)
+{
+  double start = now ();
+  size_t sum = 0;
+  for (long i = 0; i < MAPPED_LOOKUPS; i++)
+  {
+    sum += dictionary.at (user_key (i * 2654435761 % MAPPED_ENTRIES)).size ();
+  }
+  double ms = (now () - start) * 1e3;
+  return sum == 0 ? -1 : ms;
+}
+
+/**
+ * startup of a MAPPED_ENTRIES dictionary: parsing it from text against
+ * open_mapped of a saved file, then random lookups on both. the files are
+ * written to the current directory and removed at the end
+ */
+static void bench_mapped ()
+{
+  {
+    std::ofstream text (MAPPED_TEXT_PATH);
+    for (long i = 0; i < MAPPED_ENTRIES; i++)
+    {
+      text << user_key (i) << " value-" << i * 7 << '\n';
+    }
+  }
+  double start = now ();
+  Dictionary dictionary;
+  {
+    std::ifstream text (MAPPED_TEXT_PATH);
+    std::string key, value;
+    while (text >> key >> value)
+    {
+      dictionary.insert (std::move (key), std::move (value));
+    }
+  }
+  std::printf ("parse the text:                 %8.0f ms\n",
+               (now () - start) * 1e3);
+  start = now ();
+  save_mapped (dictionary, MAPPED_FILE_PATH);
+  std::printf ("save_mapped:                    %8.0f ms\n",
+               (now () - start) * 1e3);
+  start = now ();
+  MappedDictionary mapped = open_mapped (MAPPED_FILE_PATH);
+  bool found = mapped.contains_key (user_key (42));
+  std::printf ("open_mapped and a first lookup: %8.3f ms (%d)\n",
+               (now () - start) * 1e3, found);
+  std::printf ("1M lookups, parsed:             %8.0f ms\n",
+               mapped_lookups (dictionary));
+  std::printf ("1M lookups, mapped:             %8.0f ms\n",
+               mapped_lookups (mapped));
+  std::remove (MAPPED_TEXT_PATH);
+  std::remove (MAPPED_FILE_PATH);
+}
+
+/**
+ * the best time of a few runs of an operation
+ * @param rounds - number of runs
+ * @param operation - the operation to time
+ * @return the shortest run in milliseconds
+ */
+template<class Operation>
+static double best_ms (int rounds, Operation operation)
+{
+  double best = 0;
+  for (int round = 0; round < rounds; round++)
+  {
+    double start = now ();
+    operation ();
+    double ms = (now () - start) * 1e3;
+    best = round == 0 ? ms : std::min (best, ms);
+  }
+  return best;
+}
+
+/**
+ * iteration and operator== over 2^20 buckets at loads from 0.01 to 0.75.
+ * the maps are filled to 0.75 and erased down to the load, without
+ * shrinking, so the bitmap has to skip the buckets the erasures emptied.
+ * the two maps are filled and erased in opposite orders
+ */
+static void bench_sparse ()
+{
+  LoadFactorPolicy no_shrink;
+  no_shrink.shrink = false;
+  int full = SPARSE_CAPACITY * 3 / 4;
+  for (double load : {0.01, 0.05, 0.1, 0.25, 0.5, 0.75})
+  {
+    int n = (int) (load * SPARSE_CAPACITY);
+    HashMap<int, int> map, reversed;
+    map.set_load_factor_policy (no_shrink);
+    reversed.set_load_factor_policy (no_shrink);
+    map.reserve (full);
+    reversed.reserve (full);
+    for (int i = 0; i < full; i++)
+    {
+      map.insert ((int) (i * 2654435761LL), i);
+      reversed.insert ((int) ((full - 1 - i) * 2654435761LL), full - 1 - i);
+    }
+    for (int i = n; i < full; i++)
+    {
+      map.erase ((int) (i * 2654435761LL));
+      reversed.erase ((int) ((full - 1 - i + n) * 2654435761LL));
+    }
+    long sum = 0;
+    int equal = 0;
+    double iterate_ms = best_ms (ITERATE_ROUNDS, [&map, &sum] ()
+    {
+      for (const auto &cur_pair : map)
+      {
+        sum += cur_pair.second;
+      }
+    });
+    double compare_ms = best_ms (COMPARE_ROUNDS, [&] ()
+    { equal += map == reversed; });
+    std::printf ("load %.2f: iterate %6.2f ms, operator== %6.2f ms "
+                 "(%d %ld)\n", load, iterate_ms, compare_ms, equal, sum % 7);
+  }
+}
+
+/**
+ * ns per insert or erase of a cache that empties and refills (size
+ * 0 <-> 1), of an insert and erase around every growth boundary, and of
+ * draining and refilling DRAIN_KEYS keys
+ * @param name - name of the policy in the output
+ * @param policy - the load factor policy of the maps
+ */
+static void policy_cycles (const char *name, const LoadFactorPolicy &policy)
+{
+  HashMap<int, int> cache;
+  cache.set_load_factor_policy (policy);
+  double empty_ns = best_ms (POLICY_ROUNDS, [&cache] ()
+  {
+    for (int i = 0; i < POLICY_CYCLES; i++)
+    {
+      cache.insert (i, i);
+      cache.erase (i);
+    }
+  }) * 1e6 / (2 * POLICY_CYCLES);
+  double boundary_ns = 0;
+  int boundaries = 0;
+  for (int n = 12; n <= 6144; n *= 2, boundaries++)
+  {
+    HashMap<int, int> map;
+    map.set_load_factor_policy (policy);
+    for (int i = 0; i < n; i++)
+    {
+      map.insert (i, i);
+    }
+    boundary_ns += best_ms (POLICY_ROUNDS, [&map] ()
+    {
+      for (int i = 0; i < BOUNDARY_CYCLES; i++)
+      {
+        map.insert (-1, 0);
+        map.erase (-1);
+      }
+    }) * 1e6 / (2 * BOUNDARY_CYCLES);
+  }
+  HashMap<int, int> sessions;
+  sessions.set_load_factor_policy (policy);
+  double drain_ns = best_ms (POLICY_ROUNDS, [&sessions] ()
+  {
+    for (int round = 0; round < DRAIN_ROUNDS; round++)
+    {
+      for (int i = 0; i < DRAIN_KEYS; i++)
+      {
+        sessions.insert (i, i);
+      }
+      for (int i = 0; i < DRAIN_KEYS; i++)
+      {
+        sessions.erase (i);
+      }
+    }
+  }) * 1e6 / (2.0 * DRAIN_KEYS * DRAIN_ROUNDS);
+  std::printf ("%-18s 0<->1 %6.1f ns  boundary %5.1f ns  drain/refill %5.1f "
+               "ns\n", name, empty_ns, boundary_ns / boundaries, drain_ns);
+}
+
+/**
+ * insert/erase cycles under the default policy, a minimum capacity and no
+ * shrinking
+ */
+static void bench_policy ()
+{
+  LoadFactorPolicy policy;
+  policy_cycles ("default", policy);
+  policy.min_capacity = 16;
+  policy_cycles ("min_capacity 16", policy);
+  policy.min_capacity = 8192;
+  policy_cycles ("min_capacity 8192", policy);
+  policy = LoadFactorPolicy ();
+  policy.shrink = false;
+  policy_cycles ("shrink off", policy);
+}
+
+/**
+ * ns per key of a contains_key loop and of contains_many over maps of
+ * 2^16 (in cache), 2^20 and 2^24 keys, 75% of the keys are hits
+ */
+static void bench_batch ()
+{
+  for (int n : {1 << 16, 1 << 20, 1 << 24})
+  {
+    HashMap<long, long> map;
+    map.reserve (n);
+    std::mt19937_64 random (1);
+    std::vector<long> present;
+    present.reserve (n);
+    for (int i = 0; i < n; i++)
+    {
+      present.push_back ((long) (random () >> 1));
+      map.insert (present.back (), i);
+    }
+    std::vector<long> keys (BATCH_LOOKUPS);
+    for (int i = 0; i < BATCH_LOOKUPS; i++)
+    {
+      keys[i] = i % 4 == 0 ? (long) (random () >> 1)
+                           : present[random () % present.size ()];
+    }
+    std::vector<char> found (BATCH_LOOKUPS), batch_found (BATCH_LOOKUPS);
+    double loop_ms = best_ms (BATCH_ROUNDS, [&] ()
+    {
+      for (int i = 0; i < BATCH_LOOKUPS; i++)
+      {
+        found[i] = map.contains_key (keys[i]);
+      }
+    });
+    double batch_ms = best_ms (BATCH_ROUNDS, [&] ()
+    {
+      map.contains_many (keys.begin (), keys.end (), batch_found.begin ());
+    });
+    std::printf ("keys 2^%-2d contains_key loop %5.1f ns, contains_many "
+                 "%5.1f ns (%.2fx)\n", __builtin_ctz (n),
+                 loop_ms * 1e6 / BATCH_LOOKUPS, batch_ms * 1e6 / BATCH_LOOKUPS,
+                 loop_ms / batch_ms);
+  }
+}
+
+/**
+ * inserts and lookups of int keys, to compare the benchmarks binary with
+ * the benchmarks_stats one that is built with HASHMAP_STATS
+ */
+static void bench_stats ()
+{
+  long hits = 0;
+  double insert_ms = 0, lookup_ms = 0;
+  for (int round = 0; round < STATS_ROUNDS; round++)
+  {
+    double start = now ();
+    HashMap<int, int> map;
+    for (int i = 0; i < STATS_INSERTS; i++)
+    {
+      map.insert ((int) (i * 2654435761LL), i);
+    }
+    double ms = (now () - start) * 1e3;
+    insert_ms = round == 0 ? ms : std::min (insert_ms, ms);
+    start = now ();
+    for (int i = 0; i < STATS_LOOKUPS; i++)
+    {
+      hits += map.contains_key ((int) (i * 2654435761LL));
+    }
+    ms = (now () - start) * 1e3;
+    lookup_ms = round == 0 ? ms : std::min (lookup_ms, ms);
+  }
+#ifdef HASHMAP_STATS
+  const char *build = "with HASHMAP_STATS";
+#else
+  const char *build = "without HASHMAP_STATS";
+#endif
+  std::printf ("%-22s 2M inserts %4.0f ms, 4M lookups %4.0f ms (%ld)\n",
+               build, insert_ms, lookup_ms, hits);
+}
+
+/**
+ * bytes per entry and ns per random at of a Dictionary and of the
+ * FrozenDictionary built from it, with the keys of the mapped benchmark
+ */
+static void bench_frozen ()
+{
+  for (int n : {100000, 1000000, 5000000})
+  {
+    std::vector<std::pair<std::string, std::string>> entries;
+    entries.reserve (n);
+    for (long i = 0; i < n; i++)
+    {
+      entries.emplace_back (user_key (i * 2654435761 % 1000000007),
+                            "value-" + std::to_string (i));
+    }
+    std::mt19937 random (1);
+    std::vector<std::string> keys;
+    keys.reserve (FROZEN_LOOKUPS);
+    for (int i = 0; i < FROZEN_LOOKUPS; i++)
+    {
+      keys.push_back (entries[random () % n].first);
+    }
+    size_t before = allocated_bytes ();
+    Dictionary *dictionary = new Dictionary;
+    dictionary->update (entries.begin (), entries.end ());
+    size_t dictionary_bytes = allocated_bytes () - before;
+    before = allocated_bytes ();
+    double start = now ();
+    FrozenDictionary *frozen = new FrozenDictionary (*dictionary);
+    double freeze_seconds = now () - start;
+    size_t frozen_bytes = allocated_bytes () - before;
+    size_t sum = 0;
+    double dictionary_ms = best_ms (FROZEN_ROUNDS, [&] ()
+    {
+      for (const std::string &key : keys)
+      {
+        sum += dictionary->at (key).size ();
+      }
+    });
+    double frozen_ms = best_ms (FROZEN_ROUNDS, [&] ()
+    {
+      for (const std::string &key : keys)
+      {
+        sum += frozen->at (key).size ();
+      }
+    });
+    std::printf ("n=%-8d bytes/entry %5.1f / %5.1f, ns/lookup %5.1f / %5.1f,"
+                 " freeze %.2f s (%zu)\n", n, (double) dictionary_bytes / n,
+                 (double) frozen_bytes / n,
+                 dictionary_ms * 1e6 / FROZEN_LOOKUPS,
+                 frozen_ms * 1e6 / FROZEN_LOOKUPS, freeze_seconds, sum % 7);
+    delete frozen;
+    delete dictionary;
+  }
+}
+
+/**
+ * counts a Zipf(1) corpus of ZIPF_TOKENS tokens over ZIPF_WORDS words,
+ * then looks up every token (hits) and every token with a letter changed
+ * (misses), and copies the counts
+ * @param prefix - prepended to every word, URL_PREFIX makes long keys with
+ * a shared prefix
+ * @param max_load_factor - load factor of the counts
+ */
+static void zipf_counts (const std::string &prefix, double max_load_factor)
+{
+  std::mt19937 random (7);
+  std::vector<std::string> words;
+  words.reserve (ZIPF_WORDS);
+  {
+    HashMap<std::string, int> seen;
+    std::normal_distribution<> length (6, 3);
+    while ((int) words.size () < ZIPF_WORDS)
+    {
+      int letters = 2 + std::min (30, (int) std::round (std::abs (length (
+          random))));
+      std::string word = prefix;
+      for (int i = 0; i < letters; i++)
+      {
+        word += (char) ('a' + random () % 26);
+      }
+      if (seen.insert (word, 0))
+      {
+        words.push_back (word);
+      }
+    }
+  }
+  std::vector<double> cumulative (ZIPF_WORDS);
+  double total = 0;
+  for (int i = 0; i < ZIPF_WORDS; i++)
+  {
+    total += 1.0 / (i + 1);
+    cumulative[i] = total;
+  }
+  std::uniform_real_distribution<> uniform (0, total);
+  std::vector<std::string> tokens (ZIPF_TOKENS), misses (ZIPF_TOKENS);
+  for (int i = 0; i < ZIPF_TOKENS; i++)
+  {
+    tokens[i] = words[std::lower_bound (cumulative.begin (), cumulative.end (),
+                                        uniform (random))
+                      - cumulative.begin ()];
+    misses[i] = tokens[i];
+    misses[i][prefix.size () + random () % (misses[i].size ()
+                                             - prefix.size ())] =
+        (char) ('A' + random () % 26);
+  }
+  LoadFactorPolicy policy;
+  policy.max_load_factor = max_load_factor;
+  policy.shrink_load_factor = max_load_factor / 4;
+  Dictionary counts;
+  counts.set_load_factor_policy (policy);
+  size_t sum = 0;
+  double count_ms = best_ms (ZIPF_ROUNDS, [&] ()
+  {
+    counts.clear ();
+    for (const std::string &token : tokens)
+    {
+      // a tally in the value, kept short so it stays in the string
+      std::string &count = counts[token];
+      count.push_back ('x');
+      if (count.size () > 8)
+      {
+        count = "1";
+      }
+    }
+  });
+  double hit_ms = best_ms (ZIPF_ROUNDS, [&] ()
+  {
+    for (const std::string &token : tokens)
+    {
+      sum += counts.at (token).size ();
+    }
+  });
+  double miss_ms = best_ms (ZIPF_ROUNDS, [&] ()
+  {
+    for (const std::string &miss : misses)
+    {
+      sum += counts.contains_key (miss);
+    }
+  });
+  double copy_ms = best_ms (ZIPF_ROUNDS, [&] ()
+  {
+    Dictionary copy (counts);
+    sum += copy.size ();
+  });
+  std::printf ("%-10s load %.2f: count %5.1f M/s, hits %5.1f M/s, misses "
+               "%5.1f M/s, copy %5.1f ms (%zu)\n",
+               prefix.empty () ? "words" : "url-like", max_load_factor,
+               ZIPF_TOKENS / count_ms / 1e3, ZIPF_TOKENS / hit_ms / 1e3,
+               ZIPF_TOKENS / miss_ms / 1e3, copy_ms, sum % 7);
+}
+
+/**
+ * word frequency counting on short words and on long url-like keys, at
+ * the default load factor and at a load factor of 4
+ */
+static void bench_zipf ()
+{
+  for (const char *prefix : {"", URL_PREFIX})
+  {
+    zipf_counts (prefix, UPPER_LOAD_FACTOR);
+    zipf_counts (prefix, 4);
+  }
+}
+
+/**
+ * a benchmark and its name
+ */
+struct named_benchmark
+{
+  const char *name;
+  void (*run) ();
+};
+
+static const named_benchmark benchmarks[] = {
+    {"flat", bench_flat},
+    {"probes", bench_probes},
+    {"rehash", bench_rehash},
+    {"string_view", bench_string_view},
+    {"bulk_load", bench_bulk_load},
+    {"collisions", bench_collisions},
+    {"concurrent", bench_concurrent},
+    {"arena", bench_arena},
+    {"mapped", bench_mapped},
+    {"sparse", bench_sparse},
+    {"policy", bench_policy},
+    {"batch", bench_batch},
+    {"stats", bench_stats},
+    {"frozen", bench_frozen},
+    {"zipf", bench_zipf},
+};
+
+/**
+ * runs the benchmarks named in the arguments, all of them without arguments
+ * @return EXIT_FAILURE if a name isn't a benchmark
+ * @return EXIT_SUCCESS otherwise
+ */
+int main (int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    bool found = false;
+    for (const named_benchmark &benchmark : benchmarks)
+    {
+      found = found || std::strcmp (argv[i], benchmark.name) == 0;
+    }
+    if (!found)
+    {
+      std::fprintf (stderr, "Unknown benchmark: %s\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  for (const named_benchmark &benchmark : benchmarks)
+  {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; i++)
+    {
+      selected = selected || std::strcmp (argv[i], benchmark.name) == 0;
+    }
+    if (selected)
+    {
+      std::printf ("== %s\n", benchmark.name);
+      benchmark.run ();
+    }
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,1192 @@
+#include "FlatHashMap.hpp"
+#include "Dictionary.hpp"
+#include "ConcurrentHashMap.hpp"
+#include "MappedDictionary.hpp"
+#include "Arena.hpp"
+#include "FrozenDictionary.hpp"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#define TEST_KEYS 1000
+#define LONG_VALUE_LENGTH 200
+#define TEST_THREADS 8
+#define TEST_MAPPED_PATH "tests_dictionary.dm"
+#define MAPPED_HEADER_SIZE 32
+#define MAPPED_HEADER_BUCKETS 16
+#define MAPPED_HEADER_STRINGS 24
+#define MAPPED_ENTRY_SIZE 32
+#define COLLIDING_KEYS 300
+#define COLLIDING_SHIFT 32
+#define TEST_ARENA_BLOCK (1 << 20)
+#define STATS_CHAIN 10
+#define FROZEN_MAX_KEY_LENGTH 8
+#define CACHED_KEYS 12
+#define ID_HASH_SHIFT 20
+
+static std::atomic<long> allocations{0};
+
+/**
+ * counting replacement of the global operator new, the tests read
+ * allocations before and after an operation. the counter is atomic since
+ * some tests allocate from several threads. the replacements are never
+ * inlined, so g++ doesn't pair the malloc of one with the free of the
+ * other (-Wmismatched-new-delete)
+ */
+__attribute__ ((noinline)) void *operator new (size_t size)
+{
+  allocations++;
+  void *memory = std::malloc (size ? size : 1);
+  if (memory == nullptr)
+  {
+    throw std::bad_alloc ();
+  }
+  return memory;
+}
+
+__attribute__ ((noinline)) void operator delete (void *memory) noexcept
+{
+  std::free (memory);
+}
+
+__attribute__ ((noinline)) void operator delete (void *memory,
+                                                  size_t) noexcept
+{
+  std::free (memory);
+}
+
+/**
+ * a value that counts how many times it was copied
+ */
+struct Tracked
+{
+  static inline int copies = 0;
+  std::string text;
+  Tracked () = default;
+  explicit Tracked (std::string value) : text (std::move (value))
+  {}
+  Tracked (const Tracked &other) : text (other.text)
+  { copies++; }
+  Tracked (Tracked &&other) = default;
+  Tracked &operator= (const Tracked &other)
+  {
+    text = other.text;
+    copies++;
+    return *this;
+  }
+  Tracked &operator= (Tracked &&other) = default;
+  bool operator!= (const Tracked &other) const
+  { return text != other.text; }
+};
+
+/**
+ * a key type with no default constructor, FlatHashMap must never create
+ * one on its own
+ */
+struct Word
+{
+  std::string text;
+  explicit Word (std::string word) : text (std::move (word))
+  {}
+  bool operator== (const Word &other) const
+  { return text == other.text; }
+};
+
+/**
+ * hash of a Word, the hash of its text
+ */
+struct WordHash
+{
+  size_t operator() (const Word &word) const
+  { return std::hash<std::string>{} (word.text); }
+};
+
+/**
+ * a hash that gives every key the same value
+ */
+struct ConstantHash
+{
+  size_t operator() (int) const
+  { return 0; }
+};
+
+/**
+ * a key that caches its hash in a HashMap (it isn't arithmetic), with a
+ * hash and an equality that count their calls
+ */
+struct Id
+{
+  int number;
+};
+
+static int id_hashes = 0;
+static int id_compares = 0;
+
+/**
+ * hash of an Id, the number in the high bits: every Id goes to bucket 0
+ * of a map smaller than 2^ID_HASH_SHIFT buckets, with a hash of its own
+ */
+struct IdHash
+{
+  size_t operator() (const Id &id) const
+  {
+    id_hashes++;
+    return (size_t) id.number << ID_HASH_SHIFT;
+  }
+};
+
+/**
+ * equality of Ids
+ */
+struct IdEqual
+{
+  bool operator() (const Id &lhs, const Id &rhs) const
+  {
+    id_compares++;
+    return lhs.number == rhs.number;
+  }
+};
+
+/**
+ * a key of the tests, long enough to be on the heap
+ * @param i - number of the key
+ * @return the key
+ */
+static std::string test_key (int i)
+{
+  return "a key long enough to skip the small string buffer "
+         + std::to_string (i);
+}
+
+/**
+ * check a hash map against a std::unordered_map: iterating visits every
+ * pair once and at finds every pair of the reference
+ * @param map - the hash map to check
+ * @param reference - the pairs the hash map should hold
+ * @return true if the hash map holds exactly the pairs of reference
+ */
+static bool matches_reference (const HashMap<int, int> &map,
+                               const std::unordered_map<int, int> &reference)
+{
+  int count = 0;
+  for (const HashMap<int, int>::pair &cur_pair : map)
+  {
+    auto found = reference.find (cur_pair.first);
+    if (found == reference.end () || found->second != cur_pair.second)
+    {
+      return false;
+    }
+    count++;
+  }
+  for (const std::pair<const int, int> &cur_pair : reference)
+  {
+    if (map.at (cur_pair.first) != cur_pair.second)
+    {
+      return false;
+    }
+  }
+  return count == map.size () && map.size () == (int) reference.size ();
+}
+
+/**
+ * Tests that FlatHashMap holds keys and values that have no default
+ * constructor through insert, erase, clear and a copy.
+ * @return 0 upon success.
+ */
+int test_flat_no_default_constructor ()
+{
+  FlatHashMap<Word, Word, WordHash> map;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (Word (test_key (i)), Word (std::to_string (i)));
+  }
+  for (int i = 0; i < TEST_KEYS; i += 2)
+  {
+    if (!map.erase (Word (test_key (i))))
+    {
+      return 1;
+    }
+  }
+  FlatHashMap<Word, Word, WordHash> copy (map);
+  if (copy != map || copy.size () != TEST_KEYS / 2)
+  {
+    return 1;
+  }
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    if (copy.contains_key (Word (test_key (i))) != (i % 2 == 1)
+        || (i % 2 == 1
+            && copy.at (Word (test_key (i))).text != std::to_string (i)))
+    {
+      return 1;
+    }
+  }
+  map.clear ();
+  return !(map.empty () && map.begin () == map.end ());
+}
+
+/**
+ * Tests that erasing from FlatHashMap keeps the other pairs and shrinks
+ * the slot array once the map is almost empty.
+ * @return 0 upon success.
+ */
+int test_flat_erase ()
+{
+  FlatHashMap<std::string, int> map;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (test_key (i), i);
+  }
+  int full_capacity = map.capacity ();
+  for (int i = 0; i < TEST_KEYS - 1; i++)
+  {
+    if (!map.erase (test_key (i)) || map.contains_key (test_key (i)))
+    {
+      return 1;
+    }
+    if (map.at (test_key (TEST_KEYS - 1)) != TEST_KEYS - 1)
+    {
+      return 1;
+    }
+  }
+  return !(map.size () == 1 && map.capacity () < full_capacity);
+}
+
+/**
+ * Tests that a moved from FlatHashMap is a valid empty map.
+ * @return 0 upon success.
+ */
+int test_flat_moved_from ()
+{
+  FlatHashMap<std::string, int> map;
+  map.insert (test_key (1), 1);
+  FlatHashMap<std::string, int> other (std::move (map));
+  if (!map.empty () || map.contains_key (test_key (1))
+      || map.begin () != map.end () || map.erase (test_key (1)))
+  {
+    return 1;
+  }
+  map.insert (test_key (2), 2);
+  map[test_key (3)] = 3;
+  other = std::move (map);
+  return !(other.size () == 2 && other.at (test_key (3)) == 3);
+}
+
+/**
+ * Tests FlatHashMap on integer keys that only differ above their low 32
+ * bits, which std::hash leaves as they are, and that keys with one hash
+ * make insert throw once they don't fit a probe instead of growing the
+ * map forever, keeping the pairs that were inserted.
+ * @return 0 upon success.
+ */
+int test_flat_colliding_keys ()
+{
+  FlatHashMap<long long, int> map;
+  for (int i = 0; i < COLLIDING_KEYS; i++)
+  {
+    map.insert ((long long) i << COLLIDING_SHIFT, i);
+  }
+  for (int i = 0; i < COLLIDING_KEYS; i++)
+  {
+    if (map.at ((long long) i << COLLIDING_SHIFT) != i)
+    {
+      return 1;
+    }
+  }
+  if (map.size () != COLLIDING_KEYS || map.capacity () > 4 * COLLIDING_KEYS)
+  {
+    return 1;
+  }
+  FlatHashMap<int, int, ConstantHash> same_hash;
+  int inserted = 0;
+  try
+  {
+    for (; inserted < COLLIDING_KEYS; inserted++)
+    {
+      same_hash.insert (inserted, inserted);
+    }
+    return 1;
+  }
+  catch (const std::runtime_error &)
+  {}
+  for (int i = 0; i < inserted; i++)
+  {
+    if (same_hash.at (i) != i)
+    {
+      return 1;
+    }
+  }
+  return !(same_hash.size () == inserted && !same_hash.contains_key (inserted)
+           && same_hash.capacity () <= 8 * inserted);
+}
+
+/**
+ * Tests that inserting rvalues into HashMap through insert, try_emplace,
+ * emplace, operator[] and insert_or_assign copies no value.
+ * @return 0 upon success.
+ */
+int test_rvalue_inserts_copy_nothing ()
+{
+  Tracked::copies = 0;
+  HashMap<int, Tracked> map;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (int (i), Tracked (test_key (i)));
+    map.try_emplace (i + TEST_KEYS, test_key (i));
+    map.emplace (i + 2 * TEST_KEYS, Tracked (test_key (i)));
+    map[i + 3 * TEST_KEYS] = Tracked (test_key (i));
+    map.insert_or_assign (i, Tracked (test_key (-i)));
+  }
+  HashMap<int, Tracked> moved (std::move (map));
+  map = std::move (moved);
+  return !(Tracked::copies == 0 && map.size () == 4 * TEST_KEYS
+           && map.at (1).text == test_key (-1));
+}
+
+/**
+ * Tests that Dictionary::update from a std::move_iterator range allocates
+ * no string: it makes exactly two allocations per entry (a key and a value)
+ * less than the same update from copies.
+ * @return 0 upon success.
+ */
+int test_move_update_allocates_no_string ()
+{
+  std::vector<std::pair<std::string, std::string>> entries;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    entries.emplace_back (test_key (i), std::string (LONG_VALUE_LENGTH, 'v'));
+  }
+  std::vector<std::pair<std::string, std::string>> moved_entries (entries);
+  Dictionary copied, moved;
+  copied.reserve (TEST_KEYS), moved.reserve (TEST_KEYS);
+  long before = allocations;
+  copied.update (entries.begin (), entries.end ());
+  long copy_allocations = allocations - before;
+  before = allocations;
+  moved.update (std::make_move_iterator (moved_entries.begin ()),
+                std::make_move_iterator (moved_entries.end ()));
+  long move_allocations = allocations - before;
+  return !(copy_allocations - move_allocations == 2 * TEST_KEYS
+           && moved == copied);
+}
+
+/**
+ * Tests that a moved from HashMap and Dictionary are valid empty maps:
+ * lookups find nothing, and inserting allocates new buckets.
+ * @return 0 upon success.
+ */
+int test_hash_map_moved_from ()
+{
+  static_assert (std::is_nothrow_move_constructible<Dictionary>::value,
+                 "moving a Dictionary must not throw");
+  HashMap<std::string, int> map;
+  map.insert (test_key (1), 1);
+  HashMap<std::string, int> other (std::move (map));
+  const HashMap<std::string, int> &const_map = map;
+  bool found[1] = {true};
+  std::string keys[1] = {test_key (1)};
+  map.contains_many (keys, keys + 1, found);
+  if (!map.empty () || map.contains_key (test_key (1)) || found[0]
+      || map.find (test_key (1)) != map.end () || map.erase (test_key (1))
+      || map.begin () != map.end () || const_map[test_key (1)] != 0
+      || map.get_load_factor () != 0)
+  {
+    return 1;
+  }
+  try
+  {
+    map.at (test_key (1));
+    return 1;
+  }
+  catch (const std::out_of_range &)
+  {}
+  HashMap<std::string, int> copy (map);
+  if (!(copy == map))
+  {
+    return 1;
+  }
+  copy.insert (test_key (2), 2);
+  map[test_key (3)] = 3;
+  Dictionary dictionary;
+  dictionary.insert ("key", "value");
+  Dictionary moved_dictionary (std::move (dictionary));
+  dictionary.insert_or_assign ("key", "other value");
+  return !(copy.at (test_key (2)) == 2 && map.at (test_key (3)) == 3
+           && dictionary.at ("key") == "other value"
+           && moved_dictionary.at ("key") == "value");
+}
+
+/**
+ * Tests that looking up a Dictionary with std::string_view and const char *
+ * keys allocates no temporary std::string.
+ * @return 0 upon success.
+ */
+int test_string_view_lookup_allocates_nothing ()
+{
+  Dictionary dictionary;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    dictionary.insert (test_key (i), test_key (i));
+  }
+  std::string text = test_key (7) + "|" + test_key (-7);
+  std::string_view hit = std::string_view (text).substr (0, text.find ('|'));
+  std::string_view miss = std::string_view (text).substr (text.find ('|') + 1);
+  std::string erased = test_key (8);
+  const char *c_string = erased.c_str ();
+  long before = allocations;
+  bool found = dictionary.contains_key (hit) && !dictionary.contains_key (miss)
+               && dictionary.at (hit) == hit
+               && dictionary.find (miss) == dictionary.end ()
+               && dictionary.erase (c_string);
+  return !(found && allocations == before
+           && !dictionary.contains_key (c_string));
+}
+
+/**
+ * Tests that updating a Dictionary twice with the same keys keeps the
+ * capacity of inserting them once.
+ * @return 0 upon success.
+ */
+int test_repeated_update_keeps_capacity ()
+{
+  std::vector<std::pair<std::string, std::string>> entries;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    entries.emplace_back (test_key (i), test_key (-i));
+  }
+  Dictionary dictionary;
+  dictionary.update (entries.begin (), entries.end ());
+  int capacity = dictionary.capacity ();
+  dictionary.update (entries.begin (), entries.end ());
+  return !(dictionary.capacity () == capacity
+           && dictionary.size () == TEST_KEYS);
+}
+
+/**
+ * Tests a HashMap that migrates one bucket per operation against
+ * std::unordered_map while a rehash is pending: insert, insert_or_assign,
+ * erase, at, iteration, a copy and a copy assignment.
+ * @return 0 upon success.
+ */
+int test_incremental_rehash ()
+{
+  HashMap<int, int> map;
+  std::unordered_map<int, int> reference;
+  map.set_rehash_step (1);
+  int next_key = 0;
+  while (map.capacity () < TEST_KEYS) // stops right after a growth
+  {
+    map.insert (next_key, next_key);
+    reference.emplace (next_key, next_key);
+    next_key++;
+  }
+  // every iteration migrates at most 4 of the capacity / 2 old buckets
+  for (int i = 0; i < map.capacity () / 16; i++)
+  {
+    map.insert (next_key, -next_key);
+    reference.emplace (next_key, -next_key);
+    next_key++;
+    bool erased = reference.erase (2 * i) == 1;
+    map.insert_or_assign (3 * i + 1, i);
+    reference.insert_or_assign (3 * i + 1, i);
+    if (map.insert (3 * i + 1, -i) || map.erase (2 * i) != erased
+        || map.contains_key (2 * i) || map.at (3 * i + 1) != i
+        || map.at (next_key - 1) != 1 - next_key)
+    {
+      return 1;
+    }
+    if (i % 16 == 0)
+    {
+      HashMap<int, int> copy (map);
+      HashMap<int, int> assigned;
+      assigned = map;
+      if (!matches_reference (map, reference)
+          || !matches_reference (copy, reference)
+          || !matches_reference (assigned, reference) || !(copy == map)
+          || !(map == assigned))
+      {
+        return 1;
+      }
+    }
+  }
+  map.set_rehash_step (0); // finishes the rehash
+  return !matches_reference (map, reference);
+}
+
+/**
+ * Tests a HashMap on an ArenaAllocator: the map fits in the first block of
+ * the arena, so inserting allocates nothing from the heap, a request larger
+ * than a block gets a block of its own and a request whose size overflows
+ * throws std::bad_array_new_length.
+ * @return 0 upon success.
+ */
+int test_arena_allocator ()
+{
+  typedef ArenaAllocator<std::pair<int, int>> arena_allocator;
+  MonotonicArena arena (TEST_ARENA_BLOCK);
+  arena_allocator allocator (arena);
+  int result = 0;
+  {
+    HashMap<int, int, std::hash<int>, std::equal_to<>, arena_allocator> map{
+        allocator};
+    long before = allocations;
+    for (int i = 0; i < TEST_KEYS; i++)
+    {
+      map.insert (i, -i);
+    }
+    result |= allocations != before || arena.block_count () != 1;
+    for (int i = 0; i < TEST_KEYS; i++)
+    {
+      result |= map.at (i) != -i;
+    }
+  }
+  allocator.allocate (TEST_ARENA_BLOCK / sizeof (std::pair<int, int>) + 1);
+  result |= arena.block_count () != 2;
+  try
+  {
+    allocator.allocate (allocator.max_size () + 1);
+    return 1;
+  }
+  catch (const std::bad_array_new_length &)
+  {}
+  arena.release ();
+  return result || arena.block_count () != 0 || arena.bytes_allocated () != 0;
+}
+
+/**
+ * Tests that the occupancy bitmap of a HashMap follows erasures and
+ * rehashes: iterating a map erased down from a full table visits size ()
+ * pairs, and operator== matches a map filled with only the pairs left,
+ * before and after the erased map shrinks and grows.
+ * @return 0 upon success.
+ */
+int test_erase_keeps_occupancy ()
+{
+  LoadFactorPolicy no_shrink;
+  no_shrink.shrink = false;
+  HashMap<int, int> map, survivors;
+  std::unordered_map<int, int> reference;
+  map.set_load_factor_policy (no_shrink);
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (i, i);
+  }
+  int capacity = map.capacity ();
+  // every 8th key survives, so most buckets were emptied by erase
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    if (i % 8 == 0)
+    {
+      survivors.insert (i, i);
+      reference.emplace (i, i);
+    }
+    else
+    {
+      map.erase (i);
+    }
+  }
+  HashMap<int, int> same_capacity;
+  same_capacity.reserve (TEST_KEYS);
+  for (const std::pair<const int, int> &cur_pair : reference)
+  {
+    same_capacity.insert (cur_pair.first, cur_pair.second);
+  }
+  int result = map.capacity () != capacity
+               || same_capacity.capacity () != capacity
+               || !matches_reference (map, reference) || !(map == survivors)
+               || !(same_capacity == map) || map != same_capacity;
+  same_capacity.erase (0);
+  result |= map == same_capacity || same_capacity == map;
+  // shrinks on the next erase, then grows back
+  map.set_load_factor_policy (LoadFactorPolicy ());
+  map.erase (8);
+  reference.erase (8);
+  result |= map.capacity () >= capacity || !matches_reference (map, reference);
+  for (int i = 1; i < TEST_KEYS; i += 8)
+  {
+    map.insert (i, -i);
+    reference.emplace (i, -i);
+  }
+  result |= !matches_reference (map, reference) || map == survivors;
+  return result;
+}
+
+/**
+ * fill a map with TEST_KEYS keys and erase them all
+ * @param map - the map to fill and empty
+ * @return the largest capacity the map had
+ */
+static int fill_and_empty (HashMap<int, int> &map)
+{
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (i, i);
+  }
+  int capacity = map.capacity ();
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.erase (i);
+  }
+  return capacity;
+}
+
+/**
+ * Tests set_load_factor_policy: invalid policies throw and leave the map
+ * and its policy unchanged, a map erased to empty doesn't shrink below the
+ * minimum capacity, and doesn't shrink at all with shrinking off.
+ * @return 0 upon success.
+ */
+int test_load_factor_policy ()
+{
+  LoadFactorPolicy bad_policies[8];
+  bad_policies[0].max_load_factor = 0;
+  bad_policies[1].max_load_factor = std::nan ("");
+  bad_policies[2].growth_factor = 3;
+  bad_policies[3].growth_factor = 1;
+  bad_policies[4].min_capacity = 0;
+  bad_policies[5].min_capacity = 48;
+  bad_policies[6].shrink_load_factor = -1;
+  bad_policies[7].shrink_load_factor = 0.5; // shrinks right after growing
+  LoadFactorPolicy policy;
+  policy.max_load_factor = 0.5;
+  policy.shrink_load_factor = 0.2;
+  policy.min_capacity = 64;
+  HashMap<int, int> map;
+  map.set_load_factor_policy (policy);
+  map.insert (1, 1);
+  int result = map.capacity () != 64;
+  for (const LoadFactorPolicy &bad_policy : bad_policies)
+  {
+    try
+    {
+      map.set_load_factor_policy (bad_policy);
+      return 1;
+    }
+    catch (const std::invalid_argument &error)
+    {
+      result |= std::strcmp (error.what (), POLICY_ERROR_MSG) != 0;
+    }
+    const LoadFactorPolicy &kept = map.load_factor_policy ();
+    result |= kept.max_load_factor != 0.5 || kept.min_capacity != 64
+              || map.capacity () != 64 || map.size () != 1
+              || map.at (1) != 1;
+  }
+  map.erase (1);
+  result |= fill_and_empty (map) <= 64 || map.capacity () != 64;
+  policy.shrink = false;
+  map.set_load_factor_policy (policy);
+  int capacity = fill_and_empty (map);
+  result |= map.capacity () != capacity || !map.empty ();
+  map.insert (1, 1);
+  return result || map.capacity () != capacity || map.at (1) != 1;
+}
+
+/**
+ * check find_many and contains_many against find and contains_key
+ * @param map - the map to search
+ * @param keys - keys to search for
+ * @return true if the batches answer like the single lookups
+ */
+static bool batch_matches_single (const HashMap<int, int> &map,
+                                  const std::vector<int> &keys)
+{
+  std::vector<HashMap<int, int>::const_iterator> found;
+  std::vector<char> contained (keys.size () + 1, 2);
+  auto found_end = map.find_many (keys.begin (), keys.end (),
+                                  std::back_inserter (found));
+  char *contained_end = map.contains_many (keys.begin (), keys.end (),
+                                           contained.data ());
+  *found_end = map.end (); // a back_inserter is still usable
+  if (found.size () != keys.size () + 1
+      || contained_end != contained.data () + keys.size ()
+      || contained.back () != 2)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < keys.size (); i++)
+  {
+    bool hit = map.contains_key (keys[i]);
+    if (found[i] != map.find (keys[i]) || contained[i] != hit
+        || (hit && found[i]->first != keys[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Tests find_many and contains_many against find and contains_key on an
+ * empty range, on keys that all miss, on hits mixed with misses, and while
+ * an incremental rehash is pending.
+ * @return 0 upon success.
+ */
+int test_find_many ()
+{
+  HashMap<int, int> map;
+  std::vector<int> misses, mixed;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (2 * i, i);
+    misses.push_back (2 * i + 1);
+    mixed.push_back (i % 3 == 0 ? 2 * i + 1 : 4 * i);
+  }
+  int result = !batch_matches_single (map, {})
+               || !batch_matches_single (map, misses)
+               || !batch_matches_single (map, mixed);
+  map.set_rehash_step (1);
+  int capacity = map.capacity ();
+  for (int i = TEST_KEYS; map.capacity () == capacity; i++)
+  {
+    map.insert (2 * i, i);
+  }
+  // the growth left capacity / 2 buckets to migrate, a lookup migrates none
+  return result || !batch_matches_single (map, misses)
+         || !batch_matches_single (map, mixed);
+}
+
+#ifdef HASHMAP_STATS
+/**
+ * Tests the counters of HashMap::stats after known sequences: keys of one
+ * bucket cost one probe per key already in it, distinct keys of the
+ * identity hash cost none, and the map counts its growths and shrinks.
+ * built by make tests_stats.
+ * @return 0 upon success.
+ */
+int test_stats_counters ()
+{
+  HashMap<int, int, ConstantHash> chain;
+  for (int i = 0; i < STATS_CHAIN; i++)
+  {
+    chain.insert (i, i);
+  }
+  // insert i scans the i keys before it: 0 + 1 + ... + (STATS_CHAIN - 1)
+  HashMapStats stats = chain.stats ();
+  int result = stats.lookups != STATS_CHAIN
+               || stats.probes != STATS_CHAIN * (STATS_CHAIN - 1) / 2
+               || stats.rehashes != 0 || stats.max_chain_length != STATS_CHAIN
+               || stats.bucket_histogram[STATS_CHAIN] != 1
+               || stats.bucket_histogram[0] != stats.capacity - 1;
+  chain.reset_stats ();
+  for (int i = 0; i < STATS_CHAIN; i++)
+  {
+    result |= !chain.contains_key (i);
+  }
+  result |= chain.contains_key (-1); // a miss compares every key
+  stats = chain.stats ();
+  result |= stats.lookups != STATS_CHAIN + 1
+            || stats.probes != STATS_CHAIN * (STATS_CHAIN + 1) / 2
+                               + STATS_CHAIN;
+  HashMap<int, int> map;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.insert (i, i);
+  }
+  // 16 buckets grow 7 times to 2048, the first that holds 1000 keys
+  stats = map.stats ();
+  result |= stats.lookups != TEST_KEYS || stats.probes != 0
+            || stats.rehashes != 7 || stats.capacity != 2048
+            || stats.max_chain_length != 1;
+  map.reset_stats ();
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    map.erase (i);
+  }
+  // and shrink 10 times on the way down to a single bucket
+  stats = map.stats ();
+  return result || stats.lookups != TEST_KEYS || stats.probes != TEST_KEYS
+         || stats.rehashes != 10 || stats.capacity != 1;
+}
+#endif
+
+/**
+ * check a frozen dictionary against the dictionary it was built from
+ * @param frozen - the frozen dictionary
+ * @param dictionary - the source of frozen
+ * @param misses - keys that neither of them holds
+ * @return true if frozen holds exactly the pairs of dictionary
+ */
+static bool frozen_matches (const FrozenDictionary &frozen,
+                            const Dictionary &dictionary,
+                            const std::vector<std::string> &misses)
+{
+  int count = 0;
+  for (const FrozenDictionary::pair &cur_pair : frozen)
+  {
+    count++;
+    if (dictionary.at (std::string (cur_pair.first)) != cur_pair.second)
+    {
+      return false;
+    }
+  }
+  for (const auto &cur_pair : dictionary)
+  {
+    if (!frozen.contains_key (cur_pair.first)
+        || frozen.at (cur_pair.first) != cur_pair.second
+        || frozen.find (cur_pair.first)->second != cur_pair.second)
+    {
+      return false;
+    }
+  }
+  for (const std::string &miss : misses)
+  {
+    if (frozen.contains_key (miss) || frozen.find (miss) != frozen.end ())
+    {
+      return false;
+    }
+    try
+    {
+      frozen.at (miss);
+      return false;
+    }
+    catch (const std::out_of_range &)
+    {}
+  }
+  return count == dictionary.size () && frozen.size () == dictionary.size ()
+         && frozen.empty () == dictionary.empty ();
+}
+
+/**
+ * Tests FrozenDictionary against the Dictionary it freezes, for random key
+ * sets of several sizes from empty and a single key up, with random key
+ * lengths (the empty key included) and with keys that miss.
+ * @return 0 upon success.
+ */
+int test_frozen_random_keys ()
+{
+  std::mt19937 random (1);
+  int result = 0;
+  for (int size : {0, 1, 2, 3, 17, 100, TEST_KEYS})
+  {
+    Dictionary dictionary;
+    std::vector<std::string> misses;
+    while (dictionary.size () < size || (int) misses.size () < size + 1)
+    {
+      std::string key (random () % FROZEN_MAX_KEY_LENGTH, '\0');
+      for (char &c : key)
+      {
+        c = (char) ('a' + random () % 4);
+      }
+      if (dictionary.size () < size)
+      {
+        dictionary.insert (key, std::to_string (random ()));
+      }
+      else if (!dictionary.contains_key (key))
+      {
+        misses.push_back (key);
+      }
+    }
+    result |= !frozen_matches (FrozenDictionary (dictionary), dictionary,
+                               misses);
+  }
+  return result;
+}
+
+/**
+ * Tests the stored hash of a HashMap with a key that caches it: a lookup
+ * in a bucket of keys of other hashes compares only the key of its own
+ * hash, and a rehash, a copy and an erase place the other pairs without
+ * hashing their keys again.
+ * @return 0 upon success.
+ */
+int test_cached_hash ()
+{
+  static_assert (caches_hash<Id>::value && caches_hash<std::string>::value
+                 && !caches_hash<int>::value, "only Id and strings cache");
+  HashMap<Id, int, IdHash, IdEqual> map;
+  for (int i = 0; i < CACHED_KEYS; i++)
+  {
+    map.insert (Id{i}, i);
+  }
+  id_hashes = 0, id_compares = 0;
+  int result = map.bucket_size (Id{0}) != CACHED_KEYS;
+  for (int i = 0; i < CACHED_KEYS; i++)
+  {
+    result |= map.at (Id{i}) != i;
+  }
+  // one compare per hit, none for a miss in the same bucket
+  result |= map.contains_key (Id{-1}) || id_hashes != CACHED_KEYS + 2
+            || id_compares != CACHED_KEYS + 1;
+  id_hashes = 0, id_compares = 0;
+  map.reserve (TEST_KEYS);
+  HashMap<Id, int, IdHash, IdEqual> copy (map);
+  HashMap<Id, int, IdHash, IdEqual> assigned;
+  assigned = map;
+  result |= id_hashes != 0 || id_compares != 0;
+  result |= !map.erase (Id{0}) || id_hashes != 1 || id_compares != 1;
+  for (int i = 1; i < CACHED_KEYS; i++)
+  {
+    result |= map.at (Id{i}) != i || copy.at (Id{i}) != i
+              || assigned.at (Id{i}) != i;
+  }
+  return result || map.contains_key (Id{0}) || copy.at (Id{0}) != 0
+         || map.size () != CACHED_KEYS - 1 || copy.size () != CACHED_KEYS;
+}
+
+/**
+ * Tests ConcurrentHashMap with TEST_THREADS threads that insert, read and
+ * erase disjoint keys at the same time (run under -fsanitize=thread to
+ * check the locking).
+ * @return 0 upon success.
+ */
+int test_concurrent_disjoint_writers ()
+{
+  ConcurrentHashMap<int, int> map (16);
+  std::atomic<int> failures{0};
+  std::vector<std::thread> workers;
+  for (int t = 0; t < TEST_THREADS; t++)
+  {
+    workers.emplace_back ([&map, &failures, t] ()
+                          {
+                            for (int i = 0; i < TEST_KEYS; i++)
+                            {
+                              int key = t * TEST_KEYS + i;
+                              if (!map.insert (key, i) || map.at (key) != i
+                                  || (i % 3 == 0 && !map.erase (key)))
+                              {
+                                failures++;
+                              }
+                            }
+                          });
+  }
+  for (std::thread &worker : workers)
+  {
+    worker.join ();
+  }
+  int expected_size = TEST_THREADS * (TEST_KEYS - (TEST_KEYS + 2) / 3);
+  return !(failures == 0 && map.size () == expected_size);
+}
+
+/**
+ * Tests that a Dictionary saved by save_mapped and mapped back by
+ * open_mapped has the same pairs.
+ * @return 0 upon success.
+ */
+int test_mapped_round_trip ()
+{
+  Dictionary dictionary;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    dictionary.insert (test_key (i), std::to_string (i));
+  }
+  save_mapped (dictionary, TEST_MAPPED_PATH);
+  int result = 0;
+  {
+    MappedDictionary mapped = open_mapped (TEST_MAPPED_PATH);
+    result = mapped.size () != dictionary.size ()
+             || mapped.contains_key (test_key (-1));
+    for (const MappedDictionary::pair &cur_pair : mapped)
+    {
+      result |= dictionary.at (cur_pair.first) != cur_pair.second
+                || mapped.at (cur_pair.first) != cur_pair.second;
+    }
+  }
+  std::remove (TEST_MAPPED_PATH);
+  return result;
+}
+
+/**
+ * Tests that save_mapped replaces a saved file without touching the file a
+ * MappedDictionary has open, leaves no temporary file behind, and throws
+ * without creating files when the directory doesn't exist.
+ * @return 0 upon success.
+ */
+int test_mapped_save_replaces ()
+{
+  Dictionary old_dictionary, new_dictionary;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    old_dictionary.insert (test_key (i), std::to_string (i));
+  }
+  new_dictionary.insert (test_key (-1), "new");
+  save_mapped (old_dictionary, TEST_MAPPED_PATH);
+  int result = 0;
+  {
+    MappedDictionary old_mapped = open_mapped (TEST_MAPPED_PATH);
+    save_mapped (new_dictionary, TEST_MAPPED_PATH);
+    MappedDictionary new_mapped = open_mapped (TEST_MAPPED_PATH);
+    result |= old_mapped.size () != TEST_KEYS || new_mapped.size () != 1
+              || new_mapped.at (test_key (-1)) != "new";
+    for (int i = 0; i < TEST_KEYS; i++)
+    {
+      result |= old_mapped.at (test_key (i)) != std::to_string (i);
+    }
+  }
+  std::string temporary_path = TEST_MAPPED_PATH MAPPED_TEMPORARY_SUFFIX;
+  result |= std::ifstream (temporary_path).good ();
+  std::string missing_path = "missing directory/" TEST_MAPPED_PATH;
+  try
+  {
+    save_mapped (new_dictionary, missing_path);
+    result = 1;
+  }
+  catch (const std::runtime_error &error)
+  {
+    result |= std::strcmp (error.what (), MAPPED_WRITE_ERROR_MSG) != 0;
+  }
+  std::remove (TEST_MAPPED_PATH);
+  return result;
+}
+
+/**
+ * read a whole file
+ * @param path - path of the file
+ * @return the bytes of the file
+ */
+static std::string read_file (const std::string &path)
+{
+  std::ifstream file (path, std::ios::binary);
+  return std::string (std::istreambuf_iterator<char> (file),
+                      std::istreambuf_iterator<char> ());
+}
+
+/**
+ * write bytes to TEST_MAPPED_PATH and check that opening it throws the
+ * format error
+ * @param bytes - the content of the file
+ * @return true if open_mapped rejected the file
+ */
+static bool rejects_mapped (const std::string &bytes)
+{
+  std::ofstream (TEST_MAPPED_PATH, std::ios::binary | std::ios::trunc)
+      .write (bytes.data (), (std::streamsize) bytes.size ());
+  try
+  {
+    open_mapped (TEST_MAPPED_PATH);
+    return false;
+  }
+  catch (const std::runtime_error &error)
+  {
+    return std::strcmp (error.what (), MAPPED_FORMAT_ERROR_MSG) == 0;
+  }
+}
+
+/**
+ * replace a number of a saved mapped dictionary
+ * @param bytes - the content of the file
+ * @param position - offset in bytes of the number
+ * @param value - the new number
+ * @return a copy of bytes with the number replaced
+ */
+static std::string patch_number (std::string bytes, size_t position,
+                                 uint64_t value)
+{
+  bytes.replace (position, sizeof (value),
+                 reinterpret_cast<const char *> (&value), sizeof (value));
+  return bytes;
+}
+
+/**
+ * Tests that open_mapped throws the format error for a truncated file and
+ * for files whose header, bucket offsets or entries point outside of it.
+ * @return 0 upon success.
+ */
+int test_mapped_corrupt_files ()
+{
+  Dictionary dictionary;
+  for (int i = 0; i < TEST_KEYS; i++)
+  {
+    dictionary.insert (test_key (i), std::to_string (i));
+  }
+  save_mapped (dictionary, TEST_MAPPED_PATH);
+  std::string bytes = read_file (TEST_MAPPED_PATH);
+  // the header is the magic and 3 numbers: pairs, buckets and strings size
+  uint64_t buckets;
+  std::memcpy (&buckets, &bytes[MAPPED_HEADER_BUCKETS], sizeof (buckets));
+  size_t offsets = MAPPED_HEADER_SIZE;
+  size_t entries = offsets + (buckets + 1) * sizeof (uint64_t);
+  std::string corrupt_files[] = {
+      bytes.substr (0, bytes.size () / 2),
+      bytes.substr (0, MAPPED_HEADER_SIZE - 1),
+      patch_number (bytes, 0, 0),
+      // (2^61 + 1) * 8 bytes of offsets wrap around to 8 bytes, and the
+      // strings size makes the wrapped sum the size of the file
+      patch_number (patch_number (bytes, MAPPED_HEADER_BUCKETS,
+                                  (uint64_t) 1 << 61),
+                    MAPPED_HEADER_STRINGS,
+                    bytes.size () - MAPPED_HEADER_SIZE - sizeof (uint64_t)
+                    - TEST_KEYS * MAPPED_ENTRY_SIZE),
+      patch_number (bytes, offsets + sizeof (uint64_t), TEST_KEYS + 1),
+      patch_number (bytes, offsets + buckets * sizeof (uint64_t), 0),
+      patch_number (bytes, entries + sizeof (uint64_t), bytes.size ()),
+      patch_number (bytes, entries + 2 * sizeof (uint64_t), UINT64_MAX),
+  };
+  int result = rejects_mapped (bytes);
+  for (const std::string &corrupt_file : corrupt_files)
+  {
+    result |= !rejects_mapped (corrupt_file);
+  }
+  std::remove (TEST_MAPPED_PATH);
+  return result;
+}
+
+/**
+ * a test and its name
+ */
+struct named_test
+{
+  const char *name;
+  int (*run) ();
+};
+
+static const named_test tests[] = {
+    {"flat_no_default_constructor", test_flat_no_default_constructor},
+    {"flat_erase", test_flat_erase},
+    {"flat_moved_from", test_flat_moved_from},
+    {"flat_colliding_keys", test_flat_colliding_keys},
+    {"rvalue_inserts_copy_nothing", test_rvalue_inserts_copy_nothing},
+    {"move_update_allocates_no_string", test_move_update_allocates_no_string},
+    {"hash_map_moved_from", test_hash_map_moved_from},
+    {"string_view_lookup_allocates_nothing",
+     test_string_view_lookup_allocates_nothing},
+    {"repeated_update_keeps_capacity", test_repeated_update_keeps_capacity},
+    {"incremental_rehash", test_incremental_rehash},
+    {"arena_allocator", test_arena_allocator},
+    {"erase_keeps_occupancy", test_erase_keeps_occupancy},
+    {"load_factor_policy", test_load_factor_policy},
+    {"find_many", test_find_many},
+    {"frozen_random_keys", test_frozen_random_keys},
+    {"cached_hash", test_cached_hash},
+#ifdef HASHMAP_STATS
+    {"stats_counters", test_stats_counters},
+#endif
+    {"concurrent_disjoint_writers", test_concurrent_disjoint_writers},
+    {"mapped_round_trip", test_mapped_round_trip},
+    {"mapped_corrupt_files", test_mapped_corrupt_files},
+    {"mapped_save_replaces", test_mapped_save_replaces},
+};
+
+/**
+ * runs the tests named in the arguments, all of them without arguments
+ * @return EXIT_FAILURE if a test failed
+ * @return EXIT_SUCCESS if all the tests passed successfully
+ */
+int main (int argc, char *argv[])
+{
+  int failed = 0;
+  for (const named_test &test : tests)
+  {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; i++)
+    {
+      selected = selected || std::strcmp (argv[i], test.name) == 0;
+    }
+    if (!selected)
+    {
+      continue;
+    }
+    int result = test.run ();
+    std::cout << (result ? "FAIL " : "ok   ") << test.name << std::endl;
+    failed += result != 0;
+  }
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}